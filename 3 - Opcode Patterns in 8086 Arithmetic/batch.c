@@ -0,0 +1,805 @@
+function bool InitializeBatch(BatchSimulator *batch)
+{
+	ZeroStruct(batch);
+
+	if (!HostHasAVX2())
+	{
+		return false;
+	}
+
+	// Only the pages a lane touches ever get backed
+	batch->memory = AllocatePages(BATCH_LANES*SIM_MEMORY_SIZE);
+	batch->code   = AllocatePages(Kilobytes(64));
+	batch->icache = AllocatePages(SIM_ICACHE_ENTRY_COUNT*sizeof(Instruction));
+
+	if (!batch->memory || !batch->code || !batch->icache)
+	{
+		FreeBatch(batch);
+		return false;
+	}
+
+	String address_space =
+	{
+		.count = Kilobytes(64),
+		.bytes = batch->code,
+	};
+	InitializeDecoder(&batch->decoder, address_space);
+
+	ResetBatch(batch);
+
+	return true;
+}
+
+function void FreeBatch(BatchSimulator *batch)
+{
+	FreePages(batch->memory, BATCH_LANES*SIM_MEMORY_SIZE);
+	FreePages(batch->code, Kilobytes(64));
+	FreePages(batch->icache, SIM_ICACHE_ENTRY_COUNT*sizeof(Instruction));
+	ZeroStruct(batch);
+}
+
+function void ResetBatch(BatchSimulator *batch)
+{
+	ZeroStruct(&batch->words);
+	ZeroStruct(&batch->ip);
+	ZeroStruct(&batch->flags);
+	ZeroStruct(&batch->lazy_kind);
+	ZeroStruct(&batch->error);
+	ZeroStruct(&batch->error_message);
+	ZeroStruct(&batch->instruction_counts);
+	ZeroStruct(&batch->pending_counts);
+
+	batch->pending_steps = 0;
+	batch->step_count    = 0;
+}
+
+function bool LoadBatchProgram(BatchSimulator *batch, String code)
+{
+	if (code.count > Kilobytes(64))
+	{
+		return false;
+	}
+
+	// Nothing was decoded past the old end
+	u32 old_end = batch->code_end;
+	for (u32 at = 0; at < old_end; at++)
+	{
+		batch->icache[at].source_byte_count = 0;
+	}
+
+	memset(batch->code, 0, old_end);
+	memcpy(batch->code, code.bytes, code.count);
+	batch->code_end = (u32)code.count;
+
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		memcpy(BatchLaneMemory(batch, lane), code.bytes, code.count);
+	}
+
+	ZeroStruct(&batch->ip);
+
+	return true;
+}
+
+function u8 *BatchLaneMemory(BatchSimulator *batch, u32 lane)
+{
+	return batch->memory + lane*SIM_MEMORY_SIZE;
+}
+
+function u16 ReadBatchRegister(BatchSimulator *batch, u32 lane, Register reg)
+{
+	u8  offset = register_byte_offsets[reg];
+	u16 word   = batch->words[offset / 2][lane];
+
+	u16 result = word;
+	if (reg < AX)
+	{
+		result = (offset & 1) ? (word >> 8) : (word & 0xFF);
+	}
+
+	return result;
+}
+
+function void WriteBatchRegister(BatchSimulator *batch, u32 lane, Register reg, u16 value)
+{
+	u8   offset = register_byte_offsets[reg];
+	u16 *word   = &batch->words[offset / 2][lane];
+
+	if (reg >= AX)
+	{
+		*word = value;
+	}
+	else if (offset & 1)
+	{
+		*word = (u16)((*word & 0x00FF) | (value << 8));
+	}
+	else
+	{
+		*word = (u16)((*word & 0xFF00) | (value & 0xFF));
+	}
+}
+
+function CPUFlags ReadBatchFlags(BatchSimulator *batch, u32 lane)
+{
+	CPUFlags result = batch->flags[lane];
+
+	if (batch->lazy_kind[lane] != LazyFlags_None)
+	{
+		LazyFlags lazy =
+		{
+			.kind   = (LazyFlagsKind)batch->lazy_kind[lane],
+			.wide   = (batch->lazy_sign[lane] == 0x8000),
+			.carry  = (u8)batch->lazy_carry[lane],
+			.a      = batch->lazy_a[lane],
+			.b      = batch->lazy_b[lane],
+			.result = batch->lazy_result[lane],
+		};
+
+		result &= ~CPUFLAGS_ARITHMETIC;
+		result |= EvaluateLazyFlags(&lazy, CPUFLAGS_ARITHMETIC);
+	}
+
+	return result;
+}
+
+//
+// Rows
+//
+
+force_inline target_avx2 __m256i SplatRow(u16 value)
+{
+	return _mm256_set1_epi16((short)value);
+}
+
+force_inline target_avx2 __m256i LoadRow(u16 *row)
+{
+	return _mm256_loadu_si256((__m256i *)row);
+}
+
+// Only the lanes in mask
+force_inline target_avx2 void StoreRow(u16 *row, __m256i value, __m256i mask)
+{
+	_mm256_storeu_si256((__m256i *)row, _mm256_blendv_epi8(LoadRow(row), value, mask));
+}
+
+force_inline target_avx2 __m256i IsZeroRow(__m256i value)
+{
+	return _mm256_cmpeq_epi16(value, _mm256_setzero_si256());
+}
+
+force_inline target_avx2 __m256i IsNonZeroRow(__m256i value)
+{
+	return _mm256_xor_si256(IsZeroRow(value), SplatRow(0xFFFF));
+}
+
+// Bit 2*lane is set for every lane in mask
+force_inline target_avx2 u32 LaneBits(__m256i mask)
+{
+	return (u32)_mm256_movemask_epi8(mask);
+}
+
+force_inline bool LaneIn(u32 lane_bits, u32 lane)
+{
+	return (lane_bits >> (2*lane)) & 1;
+}
+
+force_inline target_avx2 u16 MinimumOfRow(__m256i value)
+{
+	__m128i half = _mm_min_epu16(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+	return (u16)_mm_cvtsi128_si32(_mm_minpos_epu16(half));
+}
+
+//
+// Registers and memory
+//
+
+force_inline target_avx2 __m256i ReadRegisterRow(BatchSimulator *batch, Register reg)
+{
+	u8      offset = register_byte_offsets[reg];
+	__m256i result = LoadRow(batch->words[offset / 2]);
+
+	if (reg < AX)
+	{
+		result = (offset & 1) ? _mm256_srli_epi16(result, 8) : _mm256_and_si256(result, SplatRow(0x00FF));
+	}
+
+	return result;
+}
+
+force_inline target_avx2 void WriteRegisterRow(BatchSimulator *batch, Register reg, __m256i value, __m256i mask)
+{
+	u8   offset = register_byte_offsets[reg];
+	u16 *row    = batch->words[offset / 2];
+
+	if (reg < AX)
+	{
+		__m256i old = LoadRow(row);
+		if (offset & 1)
+		{
+			value = _mm256_or_si256(_mm256_and_si256(old, SplatRow(0x00FF)), _mm256_slli_epi16(value, 8));
+		}
+		else
+		{
+			value = _mm256_or_si256(_mm256_and_si256(old, SplatRow(0xFF00)), _mm256_and_si256(value, SplatRow(0x00FF)));
+		}
+	}
+
+	StoreRow(row, value, mask);
+}
+
+force_inline target_avx2 __m256i EffectiveAddressRow(BatchSimulator *batch, EffectiveAddress *ea)
+{
+	__m256i result = SplatRow((u16)ea->disp);
+
+	if (ea->reg1)
+	{
+		result = _mm256_add_epi16(result, ReadRegisterRow(batch, ea->reg1));
+	}
+
+	if (ea->reg2)
+	{
+		result = _mm256_add_epi16(result, ReadRegisterRow(batch, ea->reg2));
+	}
+
+	return result;
+}
+
+// Same as ReadMemory and WriteMemory, on a lane's memory
+force_inline u16 ReadLaneMemory(u8 *memory, u16 segment, u16 offset, bool wide)
+{
+	u32 segment_base = (u32)segment << 4;
+
+	u16 result = memory[LinearAddress(segment_base, offset)];
+	if (wide)
+	{
+		result |= (u16)(memory[LinearAddress(segment_base, (u16)(offset + 1))] << 8);
+	}
+	return result;
+}
+
+force_inline void WriteLaneMemory(u8 *memory, u16 segment, u16 offset, bool wide, u16 value)
+{
+	u32 segment_base = (u32)segment << 4;
+
+	memory[LinearAddress(segment_base, offset)] = (u8)value;
+	if (wide)
+	{
+		memory[LinearAddress(segment_base, (u16)(offset + 1))] = (u8)(value >> 8);
+	}
+}
+
+function target_avx2 __m256i ReadMemoryRow(BatchSimulator *batch, u16 *segments, __m256i offset_row, bool wide, u32 lane_bits)
+{
+	u16 offsets[BATCH_LANES];
+	_mm256_storeu_si256((__m256i *)offsets, offset_row);
+
+	u16 values[BATCH_LANES] = { 0 };
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		if (LaneIn(lane_bits, lane))
+		{
+			values[lane] = ReadLaneMemory(BatchLaneMemory(batch, lane), segments[lane], offsets[lane], wide);
+		}
+	}
+
+	return LoadRow(values);
+}
+
+function target_avx2 void WriteMemoryRow(BatchSimulator *batch, u16 *segments, __m256i offset_row, bool wide, __m256i value_row, u32 lane_bits)
+{
+	u16 offsets[BATCH_LANES];
+	u16 values[BATCH_LANES];
+	_mm256_storeu_si256((__m256i *)offsets, offset_row);
+	_mm256_storeu_si256((__m256i *)values, value_row);
+
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		if (LaneIn(lane_bits, lane))
+		{
+			WriteLaneMemory(BatchLaneMemory(batch, lane), segments[lane], offsets[lane], wide, values[lane]);
+		}
+	}
+}
+
+force_inline u16 *SegmentRowOf(BatchSimulator *batch, EffectiveAddress *ea)
+{
+	return batch->words[register_byte_offsets[SegmentOfAddress(ea)] / 2];
+}
+
+function target_avx2 __m256i ReadOperandRow(BatchSimulator *batch, Operand *operand, bool wide, u32 lane_bits)
+{
+	__m256i result = _mm256_setzero_si256();
+
+	switch (operand->kind)
+	{
+		case Operand_Reg:
+		case Operand_SegReg:
+		{
+			result = ReadRegisterRow(batch, operand->reg);
+		} break;
+
+		case Operand_Mem:
+		{
+			result = ReadMemoryRow(batch, SegmentRowOf(batch, &operand->mem), EffectiveAddressRow(batch, &operand->mem), wide, lane_bits);
+		} break;
+	}
+
+	return result;
+}
+
+function target_avx2 void WriteOperandRow(BatchSimulator *batch, Operand *operand, bool wide, __m256i value, __m256i mask)
+{
+	switch (operand->kind)
+	{
+		case Operand_Reg:
+		case Operand_SegReg:
+		{
+			WriteRegisterRow(batch, operand->reg, value, mask);
+		} break;
+
+		case Operand_Mem:
+		{
+			WriteMemoryRow(batch, SegmentRowOf(batch, &operand->mem), EffectiveAddressRow(batch, &operand->mem), wide, value, LaneBits(mask));
+		} break;
+	}
+}
+
+function target_avx2 __m256i SourceRow(BatchSimulator *batch, Instruction *inst, bool wide, u32 lane_bits)
+{
+	__m256i result;
+
+	if (inst->flags & InstructionFlag_DataLO)
+	{
+		result = SplatRow(wide ? (u16)inst->data : inst->data_lo);
+	}
+	else
+	{
+		result = ReadOperandRow(batch, &inst->op2, wide, lane_bits);
+	}
+
+	return result;
+}
+
+function target_avx2 void PushRow(BatchSimulator *batch, __m256i value, __m256i mask)
+{
+	__m256i sp = _mm256_sub_epi16(LoadRow(batch->words[Slot_SP]), SplatRow(2));
+	StoreRow(batch->words[Slot_SP], sp, mask);
+	WriteMemoryRow(batch, batch->words[Slot_SS], sp, true, value, LaneBits(mask));
+}
+
+function target_avx2 __m256i PopRow(BatchSimulator *batch, __m256i mask)
+{
+	__m256i sp     = LoadRow(batch->words[Slot_SP]);
+	__m256i result = ReadMemoryRow(batch, batch->words[Slot_SS], sp, true, LaneBits(mask));
+	StoreRow(batch->words[Slot_SP], _mm256_add_epi16(sp, SplatRow(2)), mask);
+	return result;
+}
+
+//
+// Flags
+//
+
+force_inline target_avx2 void RecordFlagsRow(BatchSimulator *batch, LazyFlagsKind kind, __m256i a, __m256i b, __m256i result,
+											 bool wide, __m256i carry, __m256i mask)
+{
+	StoreRow(batch->lazy_kind,   SplatRow(kind),                   mask);
+	StoreRow(batch->lazy_sign,   SplatRow(wide ? 0x8000 : 0x0080), mask);
+	StoreRow(batch->lazy_carry,  carry,                            mask);
+	StoreRow(batch->lazy_a,      a,                                mask);
+	StoreRow(batch->lazy_b,      b,                                mask);
+	StoreRow(batch->lazy_result, result,                           mask);
+}
+
+// EvaluateLazyFlags for one flag on every lane at once. All ones in the lanes
+// where it's set.
+function target_avx2 __m256i FlagSetRow(BatchSimulator *batch, CPUFlags flag)
+{
+	__m256i kind   = LoadRow(batch->lazy_kind);
+	__m256i sign   = LoadRow(batch->lazy_sign);
+	__m256i a      = LoadRow(batch->lazy_a);
+	__m256i b      = LoadRow(batch->lazy_b);
+	__m256i result = LoadRow(batch->lazy_result);
+
+	__m256i adds = _mm256_or_si256(_mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Add)), _mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Inc)));
+	__m256i subs = _mm256_or_si256(_mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Sub)), _mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Dec)));
+
+	// Nonzero in the lanes where the flag is set
+	__m256i bits = _mm256_setzero_si256();
+
+	switch (flag)
+	{
+		case CPUFlag_ZF:
+		{
+			bits = IsZeroRow(result);
+		} break;
+
+		case CPUFlag_SF:
+		{
+			bits = _mm256_and_si256(result, sign);
+		} break;
+
+		case CPUFlag_PF:
+		{
+			__m256i parity = _mm256_and_si256(result, SplatRow(0x00FF));
+			parity = _mm256_xor_si256(parity, _mm256_srli_epi16(parity, 4));
+			parity = _mm256_xor_si256(parity, _mm256_srli_epi16(parity, 2));
+			parity = _mm256_xor_si256(parity, _mm256_srli_epi16(parity, 1));
+			bits = _mm256_andnot_si256(parity, SplatRow(1));
+		} break;
+
+		case CPUFlag_CF:
+		{
+			// The carry out of the top bit, worked out from the top bits of
+			// the operands and the result, so the width doesn't matter. Inc
+			// and dec keep theirs in lazy_carry.
+			__m256i not_result = _mm256_xor_si256(result, SplatRow(0xFFFF));
+			__m256i not_a      = _mm256_xor_si256(a, SplatRow(0xFFFF));
+
+			__m256i add_carry = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(_mm256_or_si256(a, b), not_result));
+			__m256i sub_carry = _mm256_or_si256(_mm256_and_si256(not_a, b), _mm256_and_si256(_mm256_or_si256(not_a, b), result));
+
+			__m256i add = _mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Add));
+			__m256i sub = _mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Sub));
+
+			bits = _mm256_and_si256(_mm256_or_si256(_mm256_and_si256(add, add_carry), _mm256_and_si256(sub, sub_carry)), sign);
+
+			__m256i inc_dec = _mm256_or_si256(_mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Inc)), _mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_Dec)));
+			bits = _mm256_or_si256(bits, _mm256_and_si256(inc_dec, LoadRow(batch->lazy_carry)));
+		} break;
+
+		case CPUFlag_OF:
+		{
+			__m256i add_overflow = _mm256_and_si256(_mm256_xor_si256(a, result), _mm256_xor_si256(b, result));
+			__m256i sub_overflow = _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, result));
+
+			bits = _mm256_or_si256(_mm256_and_si256(adds, add_overflow), _mm256_and_si256(subs, sub_overflow));
+			bits = _mm256_and_si256(bits, sign);
+		} break;
+	}
+
+	__m256i lazy_set   = IsNonZeroRow(bits);
+	__m256i stored_set = IsNonZeroRow(_mm256_and_si256(LoadRow(batch->flags), SplatRow(flag)));
+	__m256i none       = _mm256_cmpeq_epi16(kind, SplatRow(LazyFlags_None));
+
+	return _mm256_blendv_epi8(lazy_set, stored_set, none);
+}
+
+function target_avx2 __m256i ConditionRow(BatchSimulator *batch, Mnemonic mnemonic)
+{
+	__m256i result = _mm256_setzero_si256();
+	__m256i all    = SplatRow(0xFFFF);
+
+	switch (mnemonic)
+	{
+		case JO:  { result = FlagSetRow(batch, CPUFlag_OF);                        } break;
+		case JNO: { result = _mm256_xor_si256(FlagSetRow(batch, CPUFlag_OF), all); } break;
+		case JB:  { result = FlagSetRow(batch, CPUFlag_CF);                        } break;
+		case JAE: { result = _mm256_xor_si256(FlagSetRow(batch, CPUFlag_CF), all); } break;
+		case JE:  { result = FlagSetRow(batch, CPUFlag_ZF);                        } break;
+		case JNE: { result = _mm256_xor_si256(FlagSetRow(batch, CPUFlag_ZF), all); } break;
+		case JS:  { result = FlagSetRow(batch, CPUFlag_SF);                        } break;
+		case JNS: { result = _mm256_xor_si256(FlagSetRow(batch, CPUFlag_SF), all); } break;
+		case JP:  { result = FlagSetRow(batch, CPUFlag_PF);                        } break;
+		case JPO: { result = _mm256_xor_si256(FlagSetRow(batch, CPUFlag_PF), all); } break;
+
+		case JBE:
+		case JA:
+		{
+			result = _mm256_or_si256(FlagSetRow(batch, CPUFlag_CF), FlagSetRow(batch, CPUFlag_ZF));
+			if (mnemonic == JA)
+			{
+				result = _mm256_xor_si256(result, all);
+			}
+		} break;
+
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		{
+			__m256i less = _mm256_xor_si256(FlagSetRow(batch, CPUFlag_SF), FlagSetRow(batch, CPUFlag_OF));
+			if (mnemonic == JLE || mnemonic == JG)
+			{
+				less = _mm256_or_si256(less, FlagSetRow(batch, CPUFlag_ZF));
+			}
+
+			result = (mnemonic == JL || mnemonic == JLE) ? less : _mm256_xor_si256(less, all);
+		} break;
+	}
+
+	return result;
+}
+
+//
+// Execution
+//
+
+function void BatchError(BatchSimulator *batch, u32 lane_bits, String message)
+{
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		if (LaneIn(lane_bits, lane))
+		{
+			batch->error[lane]         = 0xFFFF;
+			batch->error_message[lane] = message;
+		}
+	}
+}
+
+// The same decode as FetchInstruction, except out of the shared code
+function Instruction *FetchBatchInstruction(BatchSimulator *batch, u16 ip, u32 lane_bits)
+{
+	Instruction *inst = &batch->icache[ip];
+	if (inst->source_byte_count)
+	{
+		return inst;
+	}
+
+	Decoder *decoder = &batch->decoder;
+	decoder->at = decoder->base + ip;
+
+	if (!DecodeNextInstruction(decoder, inst))
+	{
+		BatchError(batch, lane_bits, decoder->error_message);
+
+		// Other lanes may still be going somewhere that does decode
+		decoder->error          = false;
+		inst->source_byte_count = 0;
+		return NULL;
+	}
+
+	return inst;
+}
+
+// ExecuteInstruction, on the lanes in active, which are all at ip
+function target_avx2 void ExecuteBatchInstruction(BatchSimulator *batch, Instruction *inst, u16 ip, __m256i active)
+{
+	u32 lane_bits = LaneBits(active);
+
+	if ((inst->mnemonic == MOV || inst->mnemonic == POP) &&
+		inst->op1.kind == Operand_SegReg && inst->op1.reg == CS)
+	{
+		BatchError(batch, lane_bits, StringLit("Loading CS is not supported"));
+		return;
+	}
+
+	if (inst->flags & InstructionFlag_Far)
+	{
+		BatchError(batch, lane_bits, StringLit("Unsupported instruction"));
+		return;
+	}
+
+	// Jumps are relative to the next instruction
+	u16     next_ip = (u16)(ip + inst->source_byte_count);
+	__m256i new_ip  = SplatRow(next_ip);
+
+	bool    wide  = InstructionIsWide(inst);
+	__m256i width = SplatRow(wide ? 0xFFFF : 0x00FF);
+
+	__m256i zero = _mm256_setzero_si256();
+	__m256i one  = SplatRow(1);
+
+	switch (inst->mnemonic)
+	{
+		case MOV:
+		{
+			WriteOperandRow(batch, &inst->op1, wide, SourceRow(batch, inst, wide, lane_bits), active);
+		} break;
+
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		case CMP:
+		{
+			__m256i a = ReadOperandRow(batch, &inst->op1, wide, lane_bits);
+			__m256i b = SourceRow(batch, inst, wide, lane_bits);
+
+			__m256i carry_in = zero;
+			if (inst->mnemonic == ADC || inst->mnemonic == SBB)
+			{
+				carry_in = _mm256_and_si256(FlagSetRow(batch, CPUFlag_CF), one);
+			}
+
+			__m256i       result = zero;
+			LazyFlagsKind kind   = LazyFlags_Logic;
+
+			switch (inst->mnemonic)
+			{
+				case ADD:
+				case ADC:
+				{
+					result = _mm256_add_epi16(_mm256_add_epi16(a, b), carry_in);
+					kind   = LazyFlags_Add;
+				} break;
+
+				case SUB:
+				case SBB:
+				case CMP:
+				{
+					result = _mm256_sub_epi16(_mm256_sub_epi16(a, b), carry_in);
+					kind   = LazyFlags_Sub;
+				} break;
+
+				case AND: { result = _mm256_and_si256(a, b); } break;
+				case OR:  { result = _mm256_or_si256(a, b);  } break;
+				case XOR: { result = _mm256_xor_si256(a, b); } break;
+			}
+
+			result = _mm256_and_si256(result, width);
+			RecordFlagsRow(batch, kind, a, b, result, wide, carry_in, active);
+
+			if (inst->mnemonic != CMP)
+			{
+				WriteOperandRow(batch, &inst->op1, wide, result, active);
+			}
+		} break;
+
+		case INC:
+		case DEC:
+		{
+			__m256i a     = ReadOperandRow(batch, &inst->op1, wide, lane_bits);
+			__m256i carry = _mm256_and_si256(FlagSetRow(batch, CPUFlag_CF), one);
+
+			__m256i result = (inst->mnemonic == INC) ? _mm256_add_epi16(a, one) : _mm256_sub_epi16(a, one);
+			result = _mm256_and_si256(result, width);
+
+			RecordFlagsRow(batch, inst->mnemonic == INC ? LazyFlags_Inc : LazyFlags_Dec, a, one, result, wide, carry, active);
+			WriteOperandRow(batch, &inst->op1, wide, result, active);
+		} break;
+
+		case XCHG:
+		{
+			__m256i a = ReadOperandRow(batch, &inst->op1, wide, lane_bits);
+			__m256i b = ReadOperandRow(batch, &inst->op2, wide, lane_bits);
+			WriteOperandRow(batch, &inst->op1, wide, b, active);
+			WriteOperandRow(batch, &inst->op2, wide, a, active);
+		} break;
+
+		case PUSH:
+		{
+			PushRow(batch, ReadOperandRow(batch, &inst->op1, true, lane_bits), active);
+		} break;
+
+		case POP:
+		{
+			WriteOperandRow(batch, &inst->op1, true, PopRow(batch, active), active);
+		} break;
+
+		case CALL:
+		{
+			__m256i target = ReadOperandRow(batch, &inst->op1, true, lane_bits);
+			PushRow(batch, new_ip, active);
+			new_ip = target;
+		} break;
+
+		case JMP:
+		{
+			new_ip = ReadOperandRow(batch, &inst->op1, true, lane_bits);
+		} break;
+
+		case JO:
+		case JNO:
+		case JB:
+		case JAE:
+		case JE:
+		case JNE:
+		case JBE:
+		case JA:
+		case JS:
+		case JNS:
+		case JP:
+		case JPO:
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		{
+			new_ip = _mm256_blendv_epi8(new_ip, SplatRow((u16)(next_ip + inst->data)), ConditionRow(batch, inst->mnemonic));
+		} break;
+
+		case LOOP:
+		case LOOPE:
+		case LOOPNE:
+		{
+			__m256i cx = _mm256_sub_epi16(LoadRow(batch->words[Slot_CX]), one);
+			StoreRow(batch->words[Slot_CX], cx, active);
+
+			__m256i taken = IsNonZeroRow(cx);
+			if (inst->mnemonic == LOOPE)
+			{
+				taken = _mm256_and_si256(taken, FlagSetRow(batch, CPUFlag_ZF));
+			}
+			else if (inst->mnemonic == LOOPNE)
+			{
+				taken = _mm256_andnot_si256(FlagSetRow(batch, CPUFlag_ZF), taken);
+			}
+
+			new_ip = _mm256_blendv_epi8(new_ip, SplatRow((u16)(next_ip + inst->data)), taken);
+		} break;
+
+		case JCXZ:
+		{
+			__m256i taken = IsZeroRow(LoadRow(batch->words[Slot_CX]));
+			new_ip = _mm256_blendv_epi8(new_ip, SplatRow((u16)(next_ip + inst->data)), taken);
+		} break;
+
+		default:
+		{
+			BatchError(batch, lane_bits, StringLit("Unsupported instruction"));
+			return;
+		} break;
+	}
+
+	StoreRow(batch->ip, new_ip, active);
+
+	// Lanes in active are all ones, which is minus one
+	_mm256_storeu_si256((__m256i *)batch->pending_counts, _mm256_sub_epi16(LoadRow(batch->pending_counts), active));
+}
+
+function void FlushBatchCounts(BatchSimulator *batch)
+{
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		batch->instruction_counts[lane] += batch->pending_counts[lane];
+		batch->pending_counts[lane]      = 0;
+	}
+
+	batch->pending_steps = 0;
+}
+
+function target_avx2 u64 RunBatch(BatchSimulator *batch)
+{
+	u64 start = 0;
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		start += batch->instruction_counts[lane];
+	}
+
+	if (batch->code_end)
+	{
+		// Lanes keep running while IP <= last and they haven't hit an error
+		__m256i last = SplatRow((u16)(batch->code_end - 1));
+		__m256i none = SplatRow(0xFFFF);
+
+		for (;;)
+		{
+			__m256i ip      = LoadRow(batch->ip);
+			__m256i running = _mm256_cmpeq_epi16(_mm256_max_epu16(ip, last), last);
+			running = _mm256_andnot_si256(LoadRow(batch->error), running);
+
+			if (_mm256_testz_si256(running, running))
+			{
+				break;
+			}
+
+			u16     step_ip = MinimumOfRow(_mm256_blendv_epi8(none, ip, running));
+			__m256i active  = _mm256_and_si256(_mm256_cmpeq_epi16(ip, SplatRow(step_ip)), running);
+
+			Instruction *inst = FetchBatchInstruction(batch, step_ip, LaneBits(active));
+			if (inst)
+			{
+				ExecuteBatchInstruction(batch, inst, step_ip, active);
+			}
+
+			batch->step_count++;
+			if (++batch->pending_steps == 0xFFFF)
+			{
+				FlushBatchCounts(batch);
+			}
+		}
+	}
+
+	FlushBatchCounts(batch);
+
+	u64 end = 0;
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		end += batch->instruction_counts[lane];
+	}
+
+	return end - start;
+}
@@ -0,0 +1,84 @@
+// Runs one program on BATCH_LANES separate machines at once, in lockstep, for
+// running the same routine over lots of different inputs. Registers, IP and
+// the lazy flags are kept as structure of arrays, a row of BATCH_LANES values
+// each, so an instruction on registers is done for every lane with a handful
+// of AVX2 operations. Each lane has its own 1MB of memory, which is accessed
+// lane by lane.
+//
+// Lanes that branch different ways are handled with a mask: every step runs
+// the instruction at the lowest IP any lane is at, on the lanes that are at
+// it, while the rest wait. Lanes that jumped forward wait for the ones that
+// didn't at the join, and lanes that leave a loop early wait for the others
+// to finish it.
+//
+// The code is decoded from the program as it was loaded, and shared between
+// all the lanes, so a lane writing over its code doesn't change what it runs.
+// There are no I/O ports either, a lane stops on IN or OUT with an error.
+// Apart from that a lane ends up exactly where a Simulator would with the
+// same registers and memory, instruction count and errors included.
+//
+// Needs AVX2, InitializeBatch fails without it.
+
+#define BATCH_LANES 16
+
+typedef struct BatchSimulator
+{
+	// A row per register slot, as in Simulator.regs. Byte registers are the
+	// halves of the rows of AX..BX.
+	u16 words[Slot_Count][BATCH_LANES];
+	u16 ip[BATCH_LANES];
+
+	// Simulator.flags and Simulator.lazy_flags, a row per field. The sign bit
+	// of the operand width (0x80 or 0x8000) stands in for LazyFlags.wide.
+	u16 flags[BATCH_LANES];
+	u16 lazy_kind[BATCH_LANES];
+	u16 lazy_sign[BATCH_LANES];
+	u16 lazy_carry[BATCH_LANES];
+	u16 lazy_a[BATCH_LANES];
+	u16 lazy_b[BATCH_LANES];
+	u16 lazy_result[BATCH_LANES];
+
+	// 0xFFFF for a lane that stopped on an error, with its IP left at the
+	// instruction that caused it
+	u16    error[BATCH_LANES];
+	String error_message[BATCH_LANES];
+
+	u64 instruction_counts[BATCH_LANES];
+
+	// Instructions are counted here a step at a time and moved over to
+	// instruction_counts before the rows can overflow
+	u16 pending_counts[BATCH_LANES];
+	u32 pending_steps;
+
+	// How many instructions were run in lockstep, over one or more lanes each
+	u64 step_count;
+
+	// BATCH_LANES*SIM_MEMORY_SIZE bytes, one lane's memory after the other
+	u8 *memory;
+
+	// The program as loaded, in a 64k address space of its own, and the
+	// instructions decoded from it, as in Simulator.icache
+	u8          *code;
+	u32          code_end;
+	Decoder      decoder;
+	Instruction *icache;
+} BatchSimulator;
+
+// Returns false if the host doesn't have AVX2 or there was no memory
+function bool InitializeBatch(BatchSimulator *batch);
+function void FreeBatch(BatchSimulator *batch);
+
+// Every lane back to power-on state, memory and code left alone
+function void ResetBatch(BatchSimulator *batch);
+
+// Into the start of every lane's memory, with every IP at 0
+function bool LoadBatchProgram(BatchSimulator *batch, String code);
+
+function u8      *BatchLaneMemory(BatchSimulator *batch, u32 lane);
+function u16      ReadBatchRegister(BatchSimulator *batch, u32 lane, Register reg);
+function void     WriteBatchRegister(BatchSimulator *batch, u32 lane, Register reg, u16 value);
+function CPUFlags ReadBatchFlags(BatchSimulator *batch, u32 lane);
+
+// Runs until every lane has reached the end of the program or stopped on an
+// error. Returns the number of instructions executed, summed over the lanes.
+function u64 RunBatch(BatchSimulator *batch);
@@ -0,0 +1,1431 @@
+#define BLOCK_CACHE_MAP_COUNT  Kilobytes(64)
+#define BLOCK_CACHE_MAX_BLOCKS Kilobytes(16)
+#define BLOCK_CACHE_MAX_OPS    (BLOCK_CACHE_MAX_BLOCKS*8)
+
+function bool EnableBlockCache(Simulator *sim)
+{
+	if (sim->blocks)
+	{
+		return true;
+	}
+
+	BlockCache *cache = calloc(1, sizeof(BlockCache));
+	if (!cache)
+	{
+		return false;
+	}
+
+	cache->block_capacity = BLOCK_CACHE_MAX_BLOCKS;
+	cache->op_capacity    = BLOCK_CACHE_MAX_OPS;
+	cache->dispatch       = MicroDispatch_Threaded;
+	cache->fuse           = FusePairs_All;
+	cache->loops          = true;
+
+	cache->map    = AllocatePages(BLOCK_CACHE_MAP_COUNT*sizeof(Block *));
+	cache->blocks = AllocatePages(cache->block_capacity*sizeof(Block));
+	cache->ops    = AllocatePages(cache->op_capacity*sizeof(MicroOp));
+
+	sim->blocks = cache;
+
+	if (!cache->map || !cache->blocks || !cache->ops)
+	{
+		DisableBlockCache(sim);
+		return false;
+	}
+
+	return true;
+}
+
+function void DisableBlockCache(Simulator *sim)
+{
+	BlockCache *cache = sim->blocks;
+	if (cache)
+	{
+		DisableJit(sim);
+
+		FreePages(cache->map,    BLOCK_CACHE_MAP_COUNT*sizeof(Block *));
+		FreePages(cache->blocks, cache->block_capacity*sizeof(Block));
+		FreePages(cache->ops,    cache->op_capacity*sizeof(MicroOp));
+		free(cache);
+
+		sim->blocks = NULL;
+	}
+}
+
+function void FlushBlockCache(BlockCache *cache)
+{
+	memset(cache->map, 0, BLOCK_CACHE_MAP_COUNT*sizeof(Block *));
+	cache->block_count = 0;
+	cache->op_count    = 0;
+	cache->generation += 1;
+
+	if (cache->jit)
+	{
+		ResetJit(cache->jit);
+	}
+}
+
+function void InvalidateBlocks(BlockCache *cache, u32 address, u32 count)
+{
+	// Any block that overlaps starts less than BLOCK_MAX_BYTES before
+	u32 first = address >= BLOCK_MAX_BYTES ? address - BLOCK_MAX_BYTES + 1 : 0;
+	u32 end   = Min(address + count, BLOCK_CACHE_MAP_COUNT);
+
+	for (u32 start = first; start < end; start++)
+	{
+		Block *block = cache->map[start];
+		if (block)
+		{
+			// end_ip is 0 for a block that runs up to the end of the 64k
+			u32 block_end = block->start_ip + (u16)(block->end_ip - block->start_ip);
+			if (address < block_end)
+			{
+				block->stale      = true;
+				cache->map[start] = NULL;
+
+				cache->blocks_invalidated += 1;
+			}
+		}
+	}
+}
+
+//
+// Execution
+//
+
+force_inline u16 MicroAddress(Simulator *sim, MicroOp *op)
+{
+	return (u16)(sim->regs.words[op->ea_base] + sim->regs.words[op->ea_index] + op->ea_disp);
+}
+
+force_inline u16 ReadMicroOperand(Simulator *sim, MicroOp *op, OperandClass operand, u8 reg)
+{
+	u16 result = 0;
+
+	switch (operand)
+	{
+		case OperandClass_Reg:
+		{
+			result = op->wide ? sim->regs.words[reg / 2] : sim->regs.bytes[reg];
+		} break;
+
+		case OperandClass_Mem:
+		{
+			result = ReadMemory(sim, sim->segment_bases[op->ea_segment], MicroAddress(sim, op), op->wide);
+		} break;
+
+		case OperandClass_Imm:
+		{
+			result = op->imm;
+		} break;
+	}
+
+	return result;
+}
+
+force_inline void WriteMicroOperand(Simulator *sim, MicroOp *op, OperandClass operand, u8 reg, u16 value)
+{
+	switch (operand)
+	{
+		case OperandClass_Reg:
+		{
+			if (op->wide)
+			{
+				sim->regs.words[reg / 2] = value;
+			}
+			else
+			{
+				sim->regs.bytes[reg] = (u8)value;
+			}
+		} break;
+
+		case OperandClass_Mem:
+		{
+			WriteMemory(sim, sim->segment_bases[op->ea_segment], MicroAddress(sim, op), op->wide, value);
+		} break;
+	}
+}
+
+// The one implementation of every micro-op. The threaded handlers call it with
+// constant mnemonic and operand classes, so each one compiles down to just its
+// own case.
+force_inline u16 ExecuteMicroOpAs(Simulator *sim, MicroOp *op, Mnemonic mnemonic, OperandClass dest, OperandClass source)
+{
+	u16 next_ip = op->next_ip;
+
+	switch (mnemonic)
+	{
+		case MOV:
+		{
+			u16 value = ReadMicroOperand(sim, op, source, op->source_reg);
+			WriteMicroOperand(sim, op, dest, op->dest_reg, value);
+		} break;
+
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		case CMP:
+		{
+			u16 a = ReadMicroOperand(sim, op, dest,   op->dest_reg);
+			u16 b = ReadMicroOperand(sim, op, source, op->source_reg);
+
+			u16 result = Arithmetic(sim, mnemonic, a, b, op->wide);
+			if (mnemonic != CMP)
+			{
+				WriteMicroOperand(sim, op, dest, op->dest_reg, result);
+			}
+		} break;
+
+		case INC:
+		case DEC:
+		{
+			u16 a = ReadMicroOperand(sim, op, dest, op->dest_reg);
+			WriteMicroOperand(sim, op, dest, op->dest_reg, IncDec(sim, mnemonic, a, op->wide));
+		} break;
+
+		case XCHG:
+		{
+			u16 a = ReadMicroOperand(sim, op, dest,   op->dest_reg);
+			u16 b = ReadMicroOperand(sim, op, source, op->source_reg);
+			WriteMicroOperand(sim, op, dest,   op->dest_reg,   b);
+			WriteMicroOperand(sim, op, source, op->source_reg, a);
+		} break;
+
+		case PUSH:
+		{
+			Push(sim, ReadMicroOperand(sim, op, dest, op->dest_reg));
+		} break;
+
+		case POP:
+		{
+			WriteMicroOperand(sim, op, dest, op->dest_reg, Pop(sim));
+		} break;
+
+		case CALL:
+		{
+			u16 target = ReadMicroOperand(sim, op, dest, op->dest_reg);
+			Push(sim, next_ip);
+			next_ip = target;
+		} break;
+
+		case JMP:
+		{
+			next_ip = ReadMicroOperand(sim, op, dest, op->dest_reg);
+		} break;
+
+		case JO:
+		case JNO:
+		case JB:
+		case JAE:
+		case JE:
+		case JNE:
+		case JBE:
+		case JA:
+		case JS:
+		case JNS:
+		case JP:
+		case JPO:
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		{
+			if (ConditionHolds(sim, mnemonic))
+			{
+				next_ip = op->jump_ip;
+			}
+		} break;
+
+		case LOOP:
+		case LOOPE:
+		case LOOPNE:
+		{
+			u16 cx = --sim->regs.words[Slot_CX];
+
+			bool taken = (cx != 0);
+			if (mnemonic == LOOPE)
+			{
+				taken &= FlagSet(sim, CPUFlag_ZF);
+			}
+			else if (mnemonic == LOOPNE)
+			{
+				taken &= !FlagSet(sim, CPUFlag_ZF);
+			}
+
+			if (taken)
+			{
+				next_ip = op->jump_ip;
+			}
+		} break;
+
+		case JCXZ:
+		{
+			if (!sim->regs.words[Slot_CX])
+			{
+				next_ip = op->jump_ip;
+			}
+		} break;
+
+		// The accumulator is the dest of both, the port an Imm or DX
+		case IN:
+		case OUT:
+		{
+			u16 port = (source == OperandClass_Imm) ? op->imm : sim->regs.words[Slot_DX];
+
+			if (mnemonic == IN)
+			{
+				WriteMicroOperand(sim, op, dest, op->dest_reg, PortIn(sim, port, op->wide));
+			}
+			else
+			{
+				PortOut(sim, port, op->wide, ReadMicroOperand(sim, op, dest, op->dest_reg));
+			}
+		} break;
+	}
+
+	return next_ip;
+}
+
+force_inline s32 SignExtend(u16 value, bool wide)
+{
+	return wide ? (s32)(s16)value : (s32)(s8)(u8)value;
+}
+
+// Fusion_Jump. The flags are still recorded, they just aren't what decides
+// the jump when the operands can.
+force_inline u16 ExecuteFusedJump(Simulator *sim, MicroOp *op, Mnemonic mnemonic, Mnemonic branch, OperandClass dest, OperandClass source)
+{
+	bool wide = op->wide;
+
+	u16 a = ReadMicroOperand(sim, op, dest, op->dest_reg);
+	u16 b = 1;
+
+	u16 result = 0;
+	if (mnemonic == INC || mnemonic == DEC)
+	{
+		result = IncDec(sim, mnemonic, a, wide);
+	}
+	else
+	{
+		b      = ReadMicroOperand(sim, op, source, op->source_reg);
+		result = Arithmetic(sim, mnemonic, a, b, wide);
+	}
+
+	if (mnemonic != CMP)
+	{
+		WriteMicroOperand(sim, op, dest, op->dest_reg, result);
+	}
+
+	bool compares = (mnemonic == CMP || mnemonic == SUB);
+	u16  sign     = wide ? 0x8000 : 0x80;
+
+	bool taken = false;
+	switch (branch)
+	{
+		case JE:  { taken = (result == 0);      } break;
+		case JNE: { taken = (result != 0);      } break;
+		case JS:  { taken = !!(result & sign);  } break;
+		case JNS: { taken =  !(result & sign);  } break;
+
+		case JB:  { taken = compares ? a <  b : ConditionHolds(sim, branch); } break;
+		case JAE: { taken = compares ? a >= b : ConditionHolds(sim, branch); } break;
+		case JBE: { taken = compares ? a <= b : ConditionHolds(sim, branch); } break;
+		case JA:  { taken = compares ? a >  b : ConditionHolds(sim, branch); } break;
+
+		case JL:  { taken = compares ? SignExtend(a, wide) <  SignExtend(b, wide) : ConditionHolds(sim, branch); } break;
+		case JGE: { taken = compares ? SignExtend(a, wide) >= SignExtend(b, wide) : ConditionHolds(sim, branch); } break;
+		case JLE: { taken = compares ? SignExtend(a, wide) <= SignExtend(b, wide) : ConditionHolds(sim, branch); } break;
+		case JG:  { taken = compares ? SignExtend(a, wide) >  SignExtend(b, wide) : ConditionHolds(sim, branch); } break;
+
+		default:
+		{
+			taken = ConditionHolds(sim, branch);
+		} break;
+	}
+
+	return taken ? op->jump_ip : op->next_ip;
+}
+
+// Fusion_MovImm
+force_inline u16 ExecuteFusedMovImm(Simulator *sim, MicroOp *op, Mnemonic mnemonic, OperandClass dest)
+{
+	WriteMicroOperand(sim, op, OperandClass_Reg, op->fused_reg, op->imm);
+	return ExecuteMicroOpAs(sim, op, mnemonic, dest, OperandClass_Imm);
+}
+
+function u16 ExecuteMicroOp(Simulator *sim, MicroOp *op)
+{
+	u16 result = 0;
+
+	switch (op->fusion)
+	{
+		case Fusion_Jump:
+		{
+			result = ExecuteFusedJump(sim, op, op->mnemonic, op->branch, op->dest, op->source);
+		} break;
+
+		case Fusion_MovImm:
+		{
+			result = ExecuteFusedMovImm(sim, op, op->mnemonic, op->dest);
+		} break;
+
+		default:
+		{
+			result = ExecuteMicroOpAs(sim, op, op->mnemonic, op->dest, op->source);
+		} break;
+	}
+
+	return result;
+}
+
+//
+// Threaded handlers, one per mnemonic for each of the operand shapes that come
+// up. Anything else goes through ExecuteMicroOp.
+//
+
+#define MICRO_SHAPES(_, name) \
+	_(name, None, None)       \
+	_(name, Reg,  None)       \
+	_(name, Mem,  None)       \
+	_(name, Reg,  Reg)        \
+	_(name, Reg,  Mem)        \
+	_(name, Reg,  Imm)        \
+	_(name, Mem,  Reg)        \
+	_(name, Mem,  Imm)        \
+
+#define MicroHandlerName(name, dest, source) Micro_##name##_##dest##_##source
+
+#define MicroHandlerDefinition(name, dest, source)                                      \
+	function u16 MicroHandlerName(name, dest, source)(Simulator *sim, MicroOp *op)     \
+	{                                                                                   \
+		return ExecuteMicroOpAs(sim, op, name, OperandClass_##dest, OperandClass_##source); \
+	}
+
+#define MicroHandlers(name) MICRO_SHAPES(MicroHandlerDefinition, name)
+
+MNEMONICS(MicroHandlers)
+
+#define MicroHandlerEntry(name, dest, source) \
+	[name][MakeOperandShape(OperandClass_##dest, OperandClass_##source)] = MicroHandlerName(name, dest, source),
+
+#define MicroHandlerEntries(name) MICRO_SHAPES(MicroHandlerEntry, name)
+
+global MicroHandler *micro_handlers[Mnemonic_Count][OperandShape_Count] =
+{
+	MNEMONICS(MicroHandlerEntries)
+};
+
+//
+// Fused handlers. Fusion_Jump ones are specialized on the first instruction,
+// its operand shape and the jump, Fusion_MovImm ones on the op the mov goes
+// into and where its result goes.
+//
+
+#define FUSED_JUMPS(_, name, dest, source) \
+	_(name, dest, source, JO)              \
+	_(name, dest, source, JNO)             \
+	_(name, dest, source, JB)              \
+	_(name, dest, source, JAE)             \
+	_(name, dest, source, JE)              \
+	_(name, dest, source, JNE)             \
+	_(name, dest, source, JBE)             \
+	_(name, dest, source, JA)              \
+	_(name, dest, source, JS)              \
+	_(name, dest, source, JNS)             \
+	_(name, dest, source, JP)              \
+	_(name, dest, source, JPO)             \
+	_(name, dest, source, JL)              \
+	_(name, dest, source, JGE)             \
+	_(name, dest, source, JLE)             \
+	_(name, dest, source, JG)              \
+
+#define FUSED_JUMP_SHAPES(_)         \
+	FUSED_JUMPS(_, CMP, Reg, Reg)    \
+	FUSED_JUMPS(_, CMP, Reg, Mem)    \
+	FUSED_JUMPS(_, CMP, Reg, Imm)    \
+	FUSED_JUMPS(_, CMP, Mem, Reg)    \
+	FUSED_JUMPS(_, CMP, Mem, Imm)    \
+	FUSED_JUMPS(_, SUB, Reg, Reg)    \
+	FUSED_JUMPS(_, SUB, Reg, Mem)    \
+	FUSED_JUMPS(_, SUB, Reg, Imm)    \
+	FUSED_JUMPS(_, SUB, Mem, Reg)    \
+	FUSED_JUMPS(_, SUB, Mem, Imm)    \
+	_(INC, Reg, None, JE)            \
+	_(INC, Reg, None, JNE)           \
+	_(INC, Reg, None, JS)            \
+	_(INC, Reg, None, JNS)           \
+	_(DEC, Reg, None, JE)            \
+	_(DEC, Reg, None, JNE)           \
+	_(DEC, Reg, None, JS)            \
+	_(DEC, Reg, None, JNS)           \
+	_(INC, Mem, None, JE)            \
+	_(INC, Mem, None, JNE)           \
+	_(DEC, Mem, None, JE)            \
+	_(DEC, Mem, None, JNE)           \
+
+#define FusedJumpName(name, dest, source, branch) Fused_##name##_##dest##_##source##_##branch
+
+#define FusedJumpDefinition(name, dest, source, branch)                                                \
+	function u16 FusedJumpName(name, dest, source, branch)(Simulator *sim, MicroOp *op)               \
+	{                                                                                                 \
+		return ExecuteFusedJump(sim, op, name, branch, OperandClass_##dest, OperandClass_##source);  \
+	}
+
+FUSED_JUMP_SHAPES(FusedJumpDefinition)
+
+#define FusedJumpEntry(name, dest, source, branch) \
+	{ name, MakeOperandShape(OperandClass_##dest, OperandClass_##source), branch, FusedJumpName(name, dest, source, branch) },
+
+typedef struct FusedJumpHandler
+{
+	Mnemonic      mnemonic;
+	OperandShape  shape;
+	Mnemonic      branch;
+	MicroHandler *handler;
+} FusedJumpHandler;
+
+global FusedJumpHandler fused_jump_handlers[] =
+{
+	FUSED_JUMP_SHAPES(FusedJumpEntry)
+};
+
+#define FUSED_MOV_IMM(_) \
+	_(ADD, Reg)          \
+	_(OR,  Reg)          \
+	_(ADC, Reg)          \
+	_(SBB, Reg)          \
+	_(AND, Reg)          \
+	_(SUB, Reg)          \
+	_(XOR, Reg)          \
+	_(CMP, Reg)          \
+	_(ADD, Mem)          \
+	_(OR,  Mem)          \
+	_(ADC, Mem)          \
+	_(SBB, Mem)          \
+	_(AND, Mem)          \
+	_(SUB, Mem)          \
+	_(XOR, Mem)          \
+	_(CMP, Mem)          \
+
+#define FusedMovImmName(name, dest) FusedMovImm_##name##_##dest
+
+#define FusedMovImmDefinition(name, dest)                                      \
+	function u16 FusedMovImmName(name, dest)(Simulator *sim, MicroOp *op)     \
+	{                                                                         \
+		return ExecuteFusedMovImm(sim, op, name, OperandClass_##dest);       \
+	}
+
+FUSED_MOV_IMM(FusedMovImmDefinition)
+
+#define FusedMovImmEntry(name, dest) [name][OperandClass_##dest] = FusedMovImmName(name, dest),
+
+global MicroHandler *fused_mov_imm_handlers[Mnemonic_Count][OperandClass_Count] =
+{
+	FUSED_MOV_IMM(FusedMovImmEntry)
+};
+
+function MicroHandler *FusedHandler(MicroOp *op)
+{
+	MicroHandler *result = NULL;
+
+	if (op->fusion == Fusion_Jump)
+	{
+		OperandShape shape = MakeOperandShape(op->dest, op->source);
+		for (u32 index = 0; index < ArrayCount(fused_jump_handlers); index++)
+		{
+			FusedJumpHandler *entry = &fused_jump_handlers[index];
+			if (entry->mnemonic == op->mnemonic && entry->shape == shape && entry->branch == op->branch)
+			{
+				result = entry->handler;
+				break;
+			}
+		}
+	}
+	else if (op->fusion == Fusion_MovImm)
+	{
+		result = fused_mov_imm_handlers[op->mnemonic][op->dest];
+	}
+
+	return result ? result : ExecuteMicroOp;
+}
+
+//
+// Translation
+//
+
+function u8 SlotOfRegister(Register reg)
+{
+	return reg ? (u8)(register_byte_offsets[reg] / 2) : Slot_Zero;
+}
+
+function OperandClass ResolveMicroOperand(MicroOp *op, Operand *operand, u8 *reg)
+{
+	OperandClass result = OperandClass_None;
+
+	switch (operand->kind)
+	{
+		case Operand_Reg:
+		case Operand_SegReg:
+		{
+			*reg   = register_byte_offsets[operand->reg];
+			result = OperandClass_Reg;
+		} break;
+
+		case Operand_Mem:
+		{
+			op->ea_base    = SlotOfRegister(operand->mem.reg1);
+			op->ea_index   = SlotOfRegister(operand->mem.reg2);
+			op->ea_disp    = operand->mem.disp;
+			op->ea_segment = SlotOfRegister(SegmentOfAddress(&operand->mem));
+			result = OperandClass_Mem;
+		} break;
+	}
+
+	return result;
+}
+
+function bool EndsBlock(Mnemonic mnemonic)
+{
+	bool result = false;
+
+	switch (mnemonic)
+	{
+		case CALL:
+		case JMP:
+		case JO:
+		case JNO:
+		case JB:
+		case JAE:
+		case JE:
+		case JNE:
+		case JBE:
+		case JA:
+		case JS:
+		case JNS:
+		case JP:
+		case JPO:
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		case LOOPNE:
+		case LOOPE:
+		case LOOP:
+		case JCXZ:
+		{
+			result = true;
+		} break;
+	}
+
+	return result;
+}
+
+// Returns false for anything the block executor doesn't know, which then ends
+// the block before it
+function bool TranslateInstruction(Instruction *inst, MicroOp *op)
+{
+	switch (inst->mnemonic)
+	{
+		case MOV:
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		case CMP:
+		case INC:
+		case DEC:
+		case XCHG:
+		case PUSH:
+		case POP:
+		case CALL:
+		case JMP:
+		case JO:
+		case JNO:
+		case JB:
+		case JAE:
+		case JE:
+		case JNE:
+		case JBE:
+		case JA:
+		case JS:
+		case JNS:
+		case JP:
+		case JPO:
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		case LOOPNE:
+		case LOOPE:
+		case LOOP:
+		case JCXZ:
+		case IN:
+		case OUT:
+		{
+		} break;
+
+		default:
+		{
+			return false;
+		} break;
+	}
+
+	// Loading a segment register goes through the interpreter, which keeps
+	// Simulator.segment_bases up to date, or stops on it for CS
+	if ((inst->op1.kind == Operand_SegReg && (inst->mnemonic == MOV || inst->mnemonic == POP)) ||
+		(inst->flags & InstructionFlag_Far))
+	{
+		return false;
+	}
+
+	ZeroStruct(op);
+
+	op->mnemonic = inst->mnemonic;
+	op->wide     = InstructionIsWide(inst);
+	op->ea_base  = Slot_Zero;
+	op->ea_index = Slot_Zero;
+	op->next_ip  = (u16)(inst->source_byte_offset + inst->source_byte_count);
+
+	op->dest   = ResolveMicroOperand(op, &inst->op1, &op->dest_reg);
+	op->source = ResolveMicroOperand(op, &inst->op2, &op->source_reg);
+
+	if (inst->flags & InstructionFlag_DataLO)
+	{
+		// The Decode_JumpIpInc8 mnemonics, where the data is a displacement
+		if (op->mnemonic >= JO && op->mnemonic <= JCXZ)
+		{
+			op->jump_ip = (u16)(op->next_ip + inst->data);
+		}
+		else if (op->source == OperandClass_None)
+		{
+			op->source = OperandClass_Imm;
+			op->imm    = op->wide ? (u16)inst->data : inst->data_lo;
+		}
+	}
+
+	op->handler = micro_handlers[op->mnemonic][MakeOperandShape(op->dest, op->source)];
+	if (!op->handler)
+	{
+		op->handler = ExecuteMicroOp;
+	}
+
+	return true;
+}
+
+function bool IsImmedGroup(Mnemonic mnemonic)
+{
+	return mnemonic == ADD || mnemonic == OR  || mnemonic == ADC || mnemonic == SBB ||
+		   mnemonic == AND || mnemonic == SUB || mnemonic == XOR || mnemonic == CMP;
+}
+
+// Fills in fused if first and second make one of the pairs in MicroFusion
+// that pairs lets through
+function bool FuseMicroOps(MicroOp *first, MicroOp *second, MicroOp *fused, u32 pairs)
+{
+	bool result = false;
+
+	if (second->mnemonic >= JO && second->mnemonic <= JG)
+	{
+		bool compares = (pairs & FusePairs_Compare) && (first->mnemonic == CMP || first->mnemonic == SUB);
+		bool counts   = (pairs & FusePairs_Count) && (first->mnemonic == INC || first->mnemonic == DEC) &&
+						(second->mnemonic == JE || second->mnemonic == JNE ||
+						 second->mnemonic == JS || second->mnemonic == JNS);
+
+		if (compares || counts)
+		{
+			*fused = *first;
+			fused->fusion  = Fusion_Jump;
+			fused->branch  = second->mnemonic;
+			fused->next_ip = second->next_ip;
+			fused->jump_ip = second->jump_ip;
+			result = true;
+		}
+	}
+	else if ((pairs & FusePairs_MovImm) && first->mnemonic == MOV &&
+			 first->dest == OperandClass_Reg && first->source == OperandClass_Imm &&
+			 IsImmedGroup(second->mnemonic) &&
+			 second->source == OperandClass_Reg && second->source_reg == first->dest_reg &&
+			 second->wide == first->wide)
+	{
+		*fused = *second;
+		fused->fusion    = Fusion_MovImm;
+		fused->source    = OperandClass_Imm;
+		fused->imm       = first->imm;
+		fused->fused_reg = first->dest_reg;
+		result = true;
+	}
+
+	if (result)
+	{
+		fused->handler = FusedHandler(fused);
+	}
+
+	return result;
+}
+
+//
+// Loops
+//
+
+// One pass through a loop body as an affine map, mod 2^16: m[row][column] is
+// how many times the register of column at the top of the body goes into the
+// register of row at the bottom. The last column is the constant 1, so it
+// holds what gets added on top.
+typedef struct LoopMap
+{
+	u32 column_count;
+	u8  slots[Slot_Count];
+	u16 m[Slot_Count + 1][Slot_Count + 1];
+} LoopMap;
+
+// Below this many instructions skipped per multiply-add the power takes,
+// running the iterations is about as quick
+#define LOOP_SKIP_COST 16
+
+// Applies op to rows, each register written as a sum of the registers at
+// the top of the body plus a constant in the last column. Returns false for
+// anything that isn't such a sum.
+function bool ApplyLinearOp(u16 rows[Slot_Count][Slot_Count + 1], MicroOp *op)
+{
+	if (op->mnemonic == CMP)
+	{
+		return true;
+	}
+
+	if (!op->wide || op->dest != OperandClass_Reg)
+	{
+		return false;
+	}
+
+	u16 *dest = rows[op->dest_reg / 2];
+
+	u16 source[Slot_Count + 1] = { 0 };
+	if (op->source == OperandClass_Reg)
+	{
+		memcpy(source, rows[op->source_reg / 2], sizeof(source));
+	}
+	else if (op->source == OperandClass_Imm)
+	{
+		source[Slot_Count] = op->imm;
+	}
+
+	switch (op->mnemonic)
+	{
+		case MOV:
+		{
+			memcpy(dest, source, sizeof(source));
+		} break;
+
+		case ADD:
+		case SUB:
+		{
+			for (u32 column = 0; column <= Slot_Count; column++)
+			{
+				dest[column] = (u16)(op->mnemonic == ADD ? dest[column] + source[column] : dest[column] - source[column]);
+			}
+		} break;
+
+		case INC:
+		case DEC:
+		{
+			dest[Slot_Count] = (u16)(op->mnemonic == INC ? dest[Slot_Count] + 1 : dest[Slot_Count] - 1);
+		} break;
+
+		case XCHG:
+		{
+			if (op->source != OperandClass_Reg)
+			{
+				return false;
+			}
+			memcpy(rows[op->source_reg / 2], dest, sizeof(source));
+			memcpy(dest, source, sizeof(source));
+		} break;
+
+		case XOR:
+		{
+			// Only the xor of a register with itself, which is zero
+			if (op->source != OperandClass_Reg || op->source_reg != op->dest_reg)
+			{
+				return false;
+			}
+			memset(dest, 0, sizeof(source));
+		} break;
+
+		default:
+		{
+			return false;
+		} break;
+	}
+
+	return true;
+}
+
+// Sets the LoopForm of block from its ops, and for LoopForm_Closed the
+// counter and the map of one iteration
+function LoopForm AnalyzeLoop(Block *block, MicroOp *ops, LoopMap *map)
+{
+	block->loop = LoopForm_None;
+
+	MicroOp *last = &ops[block->op_count - 1];
+	if (last->mnemonic < JO || last->mnemonic > JCXZ || last->jump_ip != block->start_ip)
+	{
+		return block->loop;
+	}
+
+	u32 body_count = block->op_count - 1;
+	for (u32 index = 0; index < body_count; index++)
+	{
+		MicroOp *op = &ops[index];
+		if (op->dest == OperandClass_Mem || op->source == OperandClass_Mem ||
+			op->mnemonic == PUSH || op->mnemonic == POP || op->mnemonic == IN || op->mnemonic == OUT)
+		{
+			return block->loop;
+		}
+	}
+
+	block->loop = LoopForm_Strided;
+
+	u16 rows[Slot_Count][Slot_Count + 1] = { 0 };
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		rows[slot][slot] = 1;
+	}
+
+	for (u32 index = 0; index < body_count; index++)
+	{
+		if (!ApplyLinearOp(rows, &ops[index]))
+		{
+			return block->loop;
+		}
+	}
+
+	// The register the jump ends up testing, and the value that stops it
+	u8  counter = Slot_CX;
+	u16 limit   = 0;
+	if (last->mnemonic == LOOP)
+	{
+		rows[Slot_CX][Slot_Count] = (u16)(rows[Slot_CX][Slot_Count] - 1);
+	}
+	else if (last->mnemonic == JNE && body_count)
+	{
+		MicroOp *test = &ops[body_count - 1];
+		if (!test->wide || test->dest != OperandClass_Reg)
+		{
+			return block->loop;
+		}
+
+		counter = (u8)(test->dest_reg / 2);
+		if (test->mnemonic == CMP && test->source == OperandClass_Imm)
+		{
+			limit = test->imm;
+		}
+		else if (test->mnemonic != ADD && test->mnemonic != SUB && test->mnemonic != INC && test->mnemonic != DEC)
+		{
+			return block->loop;
+		}
+	}
+	else
+	{
+		return block->loop;
+	}
+
+	// The counter has to step by one, and nothing else can go into it
+	u16 *counter_row = rows[counter];
+	for (u32 column = 0; column < Slot_Count; column++)
+	{
+		if (counter_row[column] != (column == counter))
+		{
+			return block->loop;
+		}
+	}
+
+	u16 step = counter_row[Slot_Count];
+	if (step != 1 && step != 0xFFFF)
+	{
+		return block->loop;
+	}
+
+	// Columns for the registers that change or go into a change, the rest
+	// stay as they are
+	bool used[Slot_Count] = { 0 };
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		for (u32 column = 0; column <= Slot_Count; column++)
+		{
+			if (rows[slot][column] != (column == slot))
+			{
+				used[slot] = true;
+				if (column < Slot_Count)
+				{
+					used[column] = true;
+				}
+			}
+		}
+	}
+
+	ZeroStruct(map);
+
+	u32 count = 0;
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		if (used[slot])
+		{
+			map->slots[count++] = (u8)slot;
+		}
+	}
+	map->column_count = count + 1;
+
+	for (u32 row = 0; row < count; row++)
+	{
+		for (u32 column = 0; column < count; column++)
+		{
+			map->m[row][column] = rows[map->slots[row]][map->slots[column]];
+		}
+		map->m[row][count] = rows[map->slots[row]][Slot_Count];
+	}
+	map->m[count][count] = 1;
+
+	block->loop         = LoopForm_Closed;
+	block->loop_counter = counter;
+	block->loop_columns = (u8)map->column_count;
+	block->loop_limit   = limit;
+	block->loop_step    = step;
+
+	return block->loop;
+}
+
+function void MultiplyLoopMaps(LoopMap *result, LoopMap *a, LoopMap *b)
+{
+	u32 count = a->column_count;
+	for (u32 row = 0; row < count; row++)
+	{
+		for (u32 column = 0; column < count; column++)
+		{
+			// Only the low 16 bits matter, so the sum can wrap
+			u32 sum = 0;
+			for (u32 index = 0; index < count; index++)
+			{
+				sum += (u32)a->m[row][index]*b->m[index][column];
+			}
+			result->m[row][column] = (u16)sum;
+		}
+	}
+}
+
+// Skips every iteration of a LoopForm_Closed block before the last, or before
+// the last of max_iterations. Returns how many it skipped, 0 when it's quicker to run them.
+function u64 SkipLoopIterations(Simulator *sim, BlockCache *cache, Block *block, u64 max_iterations)
+{
+	// The counter reaches the limit on iteration (limit - counter)*step,
+	// counting from 1
+	u16 counter = sim->regs.words[block->loop_counter];
+	u64 skip    = (u16)((u32)(u16)(block->loop_limit - counter)*block->loop_step - 1);
+	if (skip >= max_iterations)
+	{
+		// The instruction limit lands first. Still leave one iteration to
+		// run for real, or the flags would be the ones from before the skip.
+		skip = max_iterations ? max_iterations - 1 : 0;
+	}
+
+	u64 columns = block->loop_columns;
+	if (skip*block->op_count < LOOP_SKIP_COST*columns*columns*columns)
+	{
+		return 0;
+	}
+
+	LoopMap map;
+	AnalyzeLoop(block, &cache->ops[block->first_op], &map);
+
+	// map to the power of skip, by repeated squaring
+	LoopMap power   = map;
+	LoopMap product = map;
+	for (u32 row = 0; row < map.column_count; row++)
+	{
+		for (u32 column = 0; column < map.column_count; column++)
+		{
+			power.m[row][column] = (u16)(row == column);
+		}
+	}
+
+	for (u64 left = skip; left; left >>= 1)
+	{
+		if (left & 1)
+		{
+			MultiplyLoopMaps(&product, &power, &map);
+			power = product;
+		}
+		if (left > 1)
+		{
+			MultiplyLoopMaps(&product, &map, &map);
+			map = product;
+		}
+	}
+
+	u32 count = power.column_count - 1;
+
+	u16 before[Slot_Count + 1];
+	for (u32 column = 0; column < count; column++)
+	{
+		before[column] = sim->regs.words[power.slots[column]];
+	}
+	before[count] = 1;
+
+	for (u32 row = 0; row < count; row++)
+	{
+		u32 sum = 0;
+		for (u32 column = 0; column <= count; column++)
+		{
+			sum += (u32)power.m[row][column]*before[column];
+		}
+		sim->regs.words[power.slots[row]] = (u16)sum;
+	}
+
+	sim->instruction_count         += skip*block->op_count;
+	cache->loop_iterations_skipped += skip;
+
+	return skip;
+}
+
+function Block *TranslateBlock(Simulator *sim, BlockCache *cache, u16 ip)
+{
+	// Room for the ops and as many again for the fused version
+	if (cache->block_count == cache->block_capacity ||
+		cache->op_count + 2*BLOCK_MAX_OPS > cache->op_capacity)
+	{
+		FlushBlockCache(cache);
+	}
+
+	Block *block = &cache->blocks[cache->block_count];
+	ZeroStruct(block);
+	block->start_ip = ip;
+	block->first_op = cache->op_count;
+
+	Decoder *decoder = &sim->decoder;
+	decoder->at = decoder->base + ip;
+
+	u32 at = ip;
+	while (at < sim->code_end && block->op_count < BLOCK_MAX_OPS)
+	{
+		Instruction inst;
+		if (!DecodeNextInstruction(decoder, &inst))
+		{
+			// Leave it to the interpreter to report when it gets there
+			decoder->error = false;
+			break;
+		}
+
+		if (at + inst.source_byte_count - ip > BLOCK_MAX_BYTES)
+		{
+			break;
+		}
+
+		MicroOp *op = &cache->ops[block->first_op + block->op_count];
+		if (!TranslateInstruction(&inst, op))
+		{
+			break;
+		}
+
+		if (op->dest == OperandClass_Mem || (op->source == OperandClass_Mem && op->mnemonic == XCHG) ||
+			op->mnemonic == PUSH || op->mnemonic == CALL)
+		{
+			block->writes_memory = true;
+		}
+
+		block->op_count += 1;
+		at += inst.source_byte_count;
+
+		if (EndsBlock(inst.mnemonic))
+		{
+			break;
+		}
+	}
+
+	if (!block->op_count)
+	{
+		return NULL;
+	}
+
+	block->end_ip = (u16)at;
+	MarkCodePages(sim, ip, at - ip);
+
+	LoopMap map;
+	AnalyzeLoop(block, &cache->ops[block->first_op], &map);
+
+	cache->op_count += block->op_count;
+
+	block->first_exec = block->first_op;
+	block->exec_count = block->op_count;
+
+	if (cache->fuse)
+	{
+		MicroOp *ops  = &cache->ops[block->first_op];
+		MicroOp *exec = &cache->ops[cache->op_count];
+
+		u32 exec_count = 0;
+		for (u32 index = 0; index < block->op_count; index++)
+		{
+			MicroOp *op = &ops[index];
+			if (index + 1 < block->op_count && FuseMicroOps(op, op + 1, &exec[exec_count], cache->fuse))
+			{
+				index += 1;
+			}
+			else
+			{
+				exec[exec_count] = *op;
+			}
+			exec_count += 1;
+		}
+
+		if (exec_count < block->op_count)
+		{
+			block->first_exec = cache->op_count;
+			block->exec_count = exec_count;
+			cache->op_count  += exec_count;
+		}
+	}
+
+	cache->block_count += 1;
+	cache->map[ip]      = block;
+
+	cache->blocks_translated += 1;
+
+	return block;
+}
+
+//
+// Running blocks
+//
+
+function Block *NextBlock(Simulator *sim, BlockCache *cache, Block *previous)
+{
+	u16 ip = sim->ip;
+
+	if (previous)
+	{
+		for (u32 i = 0; i < ArrayCount(previous->next); i++)
+		{
+			Block *next = previous->next[i];
+			if (next && next->start_ip == ip && !next->stale)
+			{
+				cache->chain_hits += 1;
+				return next;
+			}
+		}
+	}
+
+	u32 generation = cache->generation;
+
+	Block *block = cache->map[ip];
+	if (!block)
+	{
+		block = TranslateBlock(sim, cache, ip);
+	}
+
+	// Chain it to the block we came from, unless translating just threw that
+	// one away
+	if (block && previous && generation == cache->generation)
+	{
+		if (!previous->next[0])
+		{
+			previous->next[0] = block;
+		}
+		else
+		{
+			previous->next[1] = block;
+		}
+	}
+
+	return block;
+}
+
+// Fused ops count for the two instructions they stand in for
+function u32 InstructionsInOps(MicroOp *first, MicroOp *end)
+{
+	u32 result = 0;
+	for (MicroOp *op = first; op < end; op++)
+	{
+		result += (op->fusion == Fusion_None) ? 1 : 2;
+	}
+	return result;
+}
+
+function u64 RunBlocks(Simulator *sim, u64 max_instructions)
+{
+	BlockCache *cache = sim->blocks;
+	if (!cache)
+	{
+		return RunSimulator(sim, max_instructions);
+	}
+
+	u64 start = sim->instruction_count;
+
+	Block *block = NULL;
+	while (!sim->error && sim->ip < sim->code_end)
+	{
+		u64 executed = sim->instruction_count - start;
+		if (max_instructions && executed >= max_instructions)
+		{
+			break;
+		}
+
+		Block *next = NextBlock(sim, cache, block);
+
+		if (next && next->loop == LoopForm_Closed && cache->loops)
+		{
+			u64 max_iterations = ~0ull;
+			if (max_instructions)
+			{
+				max_iterations = (max_instructions - executed) / next->op_count;
+			}
+
+			// Back round to the limit check, and then the last iteration
+			if (SkipLoopIterations(sim, cache, next, max_iterations))
+			{
+				block = next;
+				continue;
+			}
+		}
+
+		if (!next || (max_instructions && executed + next->op_count > max_instructions))
+		{
+			// Nothing translatable here, or the instruction limit ends up in
+			// the middle of the block
+			Instruction scratch;
+			Instruction *inst = FetchInstruction(sim, &scratch);
+			if (!inst)
+			{
+				break;
+			}
+
+			ExecuteInstruction(sim, inst);
+			block = NULL;
+			continue;
+		}
+
+		if (cache->jit && !next->native && ++next->executions == JIT_HOT_THRESHOLD)
+		{
+			CompileBlock(cache->jit, cache, next);
+		}
+
+		if (next->native && !sim->segments_wrap)
+		{
+			if (next->native_reads_flags)
+			{
+				WriteFlags(sim, ReadFlags(sim, 0xFFFF));
+			}
+
+			u64 max_iterations = ~0ull;
+			if (max_instructions)
+			{
+				max_iterations = (max_instructions - executed) / next->op_count;
+			}
+
+			u64 result = next->native(sim, max_iterations);
+
+			sim->instruction_count += result >> 1;
+			cache->blocks_executed += 1;
+
+			if (result & 1)
+			{
+				// Stopped at an instruction the native code leaves to the
+				// interpreter
+				Instruction scratch;
+				Instruction *inst = FetchInstruction(sim, &scratch);
+				if (!inst)
+				{
+					break;
+				}
+
+				ExecuteInstruction(sim, inst);
+				block = NULL;
+			}
+			else
+			{
+				block = next;
+			}
+
+			continue;
+		}
+
+		MicroOp *op  = &cache->ops[next->first_exec];
+		MicroOp *end = op + next->exec_count;
+
+		u64 iterations = 1;
+
+		u16 ip = sim->ip;
+		if (next->writes_memory)
+		{
+			// A write can make the block stale halfway through, and then the
+			// rest of it may not be what's in memory anymore
+			MicroOp *first = op;
+			for (; op < end && !next->stale; op++)
+			{
+				ip = (cache->dispatch == MicroDispatch_Threaded) ? op->handler(sim, op) : ExecuteMicroOp(sim, op);
+			}
+
+			if (next->stale)
+			{
+				sim->ip                 = ip;
+				sim->instruction_count += InstructionsInOps(first, op);
+				cache->blocks_executed += 1;
+
+				block = NULL;
+				continue;
+			}
+		}
+		else if (next->loop && cache->loops)
+		{
+			// Only registers change, so nothing can come between one
+			// iteration and the next
+			u64 max_iterations = ~0ull;
+			if (max_instructions)
+			{
+				max_iterations = (max_instructions - executed) / next->op_count;
+			}
+
+			MicroOp *first = op;
+			for (;;)
+			{
+				for (op = first; op < end; op++)
+				{
+					ip = (cache->dispatch == MicroDispatch_Threaded) ? op->handler(sim, op) : ExecuteMicroOp(sim, op);
+				}
+
+				if (ip != next->start_ip || iterations == max_iterations)
+				{
+					break;
+				}
+				iterations += 1;
+			}
+		}
+		else if (cache->dispatch == MicroDispatch_Threaded)
+		{
+			for (; op < end; op++)
+			{
+				ip = op->handler(sim, op);
+			}
+		}
+		else
+		{
+			for (; op < end; op++)
+			{
+				ip = ExecuteMicroOp(sim, op);
+			}
+		}
+
+		sim->ip                 = ip;
+		sim->instruction_count += iterations*next->op_count;
+		cache->blocks_executed += iterations;
+
+		block = next;
+	}
+
+	return sim->instruction_count - start;
+}
@@ -0,0 +1,201 @@
+// Basic block translation. Runs of decoded instructions, ending in a jump or
+// loop, are translated once into compact arrays of micro-ops with everything
+// the decoder left implicit resolved up front: register operands become
+// offsets into the register file, effective addresses become a pair of
+// register slots plus a displacement and the segment they go through,
+// immediates are truncated to the operand width and jump targets are
+// absolute. Blocks remember their successors, so going from one block to the
+// next is usually a pointer compare instead of a lookup.
+
+typedef struct MicroOp MicroOp;
+
+// Common instruction pairs that get executed as one micro-op
+typedef u8 MicroFusion;
+enum MicroFusion
+{
+	Fusion_None,
+
+	// cmp or sub followed by any conditional jump, inc or dec followed by
+	// je, jne, js or jns. The jump tests its condition on the operands or the
+	// result directly, instead of going through the flags.
+	Fusion_Jump,
+
+	// mov reg, imm followed by an op of the immed group that takes that
+	// register as its source, which then becomes the immediate
+	Fusion_MovImm,
+};
+
+// Which of the pairs above BlockCache.fuse lets through, so each kind can be
+// turned off and measured on its own
+typedef enum FusePairs
+{
+	FusePairs_Compare = 0x1, // cmp or sub, then a conditional jump
+	FusePairs_Count   = 0x2, // inc or dec, then je, jne, js or jns
+	FusePairs_MovImm  = 0x4, // mov reg, imm, then an immed group op taking it
+
+	FusePairs_All = FusePairs_Compare | FusePairs_Count | FusePairs_MovImm,
+} FusePairs;
+
+// Executes one micro-op and returns the IP execution continues at
+typedef u16 MicroHandler(Simulator *sim, MicroOp *op);
+
+typedef struct MicroOp
+{
+	// Specialized for the mnemonic and operand classes below
+	MicroHandler *handler;
+
+	Mnemonic     mnemonic;
+	u8           wide;
+	OperandClass dest;
+	OperandClass source;
+
+	// Byte offsets into Simulator.regs for Reg operands
+	u8 dest_reg;
+	u8 source_reg;
+
+	// For the one Mem operand an instruction can have. Register slots, with
+	// Slot_Zero standing in for a missing base or index, and the slot of the
+	// segment it goes through.
+	u8  ea_base;
+	u8  ea_index;
+	s16 ea_disp;
+	u8  ea_segment;
+
+	u16 imm;
+
+	// Where execution continues if this doesn't jump, and where it goes if it
+	// does
+	u16 next_ip;
+	u16 jump_ip;
+
+	// Set when the op stands in for a pair of instructions
+	MicroFusion fusion;
+	Mnemonic    branch;    // The jump of Fusion_Jump
+	u8          fused_reg; // The register Fusion_MovImm's mov writes op->imm to
+} MicroOp;
+
+#define BLOCK_MAX_OPS 64
+
+// Bounds how far before a write the start of a block it overlaps can be
+#define BLOCK_MAX_BYTES 512
+
+typedef enum MicroDispatch
+{
+	// Call each micro-op's handler
+	MicroDispatch_Threaded,
+	// One switch on the mnemonic, which then looks at the operand classes
+	MicroDispatch_Switch,
+
+	MicroDispatch_Count,
+} MicroDispatch;
+
+// Blocks that end in a jump back to their own start and only touch
+// registers. Every iteration is the same ops on different values, so the
+// block lookup between them can go, and when the body is nothing but sums
+// of registers and constants, so can most of the iterations.
+typedef u8 LoopForm;
+enum LoopForm
+{
+	LoopForm_None,
+
+	// Run round and round straight from the ops, for as long as the jump
+	// goes back to the start
+	LoopForm_Strided,
+
+	// Counted by a register that steps by one up or down to a limit, with a
+	// body that maps the registers to sums of multiples of themselves plus
+	// constants. All but the last iteration are skipped by raising that map
+	// to the power of how many there are, then the last runs for real and
+	// leaves the flags exactly as it would have.
+	LoopForm_Closed,
+};
+
+// Native code for a block, see jit.h
+typedef u64 NativeBlockProc(Simulator *sim, u64 max_iterations);
+
+typedef struct Block
+{
+	u16 start_ip;
+	u16 end_ip;
+
+	u32 first_op;
+	u32 op_count;
+
+	// What actually gets executed, the ops with fused pairs merged. Same as
+	// the ops if nothing was fused.
+	u32 first_exec;
+	u32 exec_count;
+
+	// Counts up to the point the JIT takes the block on
+	u32              executions;
+	NativeBlockProc *native;
+	bool             native_reads_flags;
+
+	// The last two blocks this one was seen to continue into. A conditional
+	// branch fills both, everything else at most one.
+	struct Block *next[2];
+
+	// Has an op that writes to memory, and so could write over its own code
+	bool writes_memory;
+
+	// Its code was written to. It's out of the map and never runs again, but
+	// can still be in the next pointers of other blocks.
+	bool stale;
+
+	// For LoopForm_Closed, the loop goes round again while the counter
+	// register, stepped by loop_step (1 or 0xFFFF), isn't loop_limit
+	// afterwards. loop_columns is the size of its map.
+	LoopForm loop;
+	u8       loop_counter;
+	u8       loop_columns;
+	u16      loop_limit;
+	u16      loop_step;
+} Block;
+
+typedef struct BlockCache
+{
+	MicroDispatch dispatch;
+
+	// FusePairs to fuse when translating, 0 for none
+	u32 fuse;
+
+	// Run loops as their LoopForm says, rather than a block at a time
+	bool loops;
+
+	// Optional, see jit.h
+	struct Jit *jit;
+
+	// Indexed by the IP a block starts at
+	Block **map;
+
+	u32    block_count;
+	u32    block_capacity;
+	Block *blocks;
+
+	u32      op_count;
+	u32      op_capacity;
+	MicroOp *ops;
+
+	// Bumped every time the cache runs full and is thrown away, so a block
+	// pointer from before can be recognized as stale
+	u32 generation;
+
+	u64 blocks_executed;
+	u64 blocks_translated;
+	u64 blocks_invalidated;
+	u64 chain_hits;
+	u64 loop_iterations_skipped;
+} BlockCache;
+
+function bool EnableBlockCache(Simulator *sim);
+function void DisableBlockCache(Simulator *sim);
+function void FlushBlockCache(BlockCache *cache);
+
+// Makes every block with code in the range of addresses stale, see
+// InvalidateCode
+function void InvalidateBlocks(BlockCache *cache, u32 address, u32 count);
+
+// Same contract as RunSimulator, but executes through translated blocks.
+// Anything the translator doesn't handle is executed by the interpreter one
+// instruction at a time.
+function u64 RunBlocks(Simulator *sim, u64 max_instructions);
@@ -0,0 +1,166 @@
+force_inline bool BitIsSet(u64 *bits, u32 index)
+{
+	return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+force_inline void SetBit(u64 *bits, u32 index)
+{
+	bits[index / 64] |= 1ull << (index % 64);
+}
+
+function void AddBreakpoint(Breakpoints *breaks, u16 ip)
+{
+	if (!BitIsSet(breaks->ip_bits, ip))
+	{
+		SetBit(breaks->ip_bits, ip);
+		breaks->breakpoint_count++;
+	}
+}
+
+function bool AddWatchpoint(Breakpoints *breaks, u32 address, u32 count)
+{
+	if (breaks->watchpoint_count >= MAX_WATCHPOINTS || !count || address + count > SIM_MEMORY_SIZE)
+	{
+		return false;
+	}
+
+	Watchpoint *watch = &breaks->watchpoints[breaks->watchpoint_count++];
+	watch->start = address;
+	watch->end   = address + count;
+
+	for (u32 page = watch->start >> WATCH_PAGE_SHIFT; page <= (watch->end - 1) >> WATCH_PAGE_SHIFT; page++)
+	{
+		SetBit(breaks->watch_page_bits, page);
+	}
+
+	return true;
+}
+
+function bool BreakpointsArmed(Breakpoints *breaks)
+{
+	return breaks->breakpoint_count || breaks->watchpoint_count;
+}
+
+// The page bitmap rules out almost every write, the ranges only get looked
+// at for writes to a watched page
+function bool WillHitWatchpoint(Breakpoints *breaks, Simulator *sim, Instruction *inst)
+{
+	MemoryWrite writes[MAX_MEMORY_WRITES];
+	u32 write_count = MemoryWritesOf(sim, inst, writes);
+
+	for (u32 write_index = 0; write_index < write_count; write_index++)
+	{
+		MemoryWrite *write = &writes[write_index];
+
+		u32 byte_count = write->wide ? 2 : 1;
+		for (u32 byte = 0; byte < byte_count; byte++)
+		{
+			u32 address = LinearAddress(write->segment_base, (u16)(write->offset + byte));
+			if (!BitIsSet(breaks->watch_page_bits, address >> WATCH_PAGE_SHIFT))
+			{
+				continue;
+			}
+
+			for (u32 index = 0; index < breaks->watchpoint_count; index++)
+			{
+				Watchpoint *watch = &breaks->watchpoints[index];
+				if (address >= watch->start && address < watch->end)
+				{
+					breaks->address          = address;
+					breaks->watchpoint_index = index;
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+function u64 RunInstrumented(Simulator *sim, Breakpoints *breaks, u64 max_instructions)
+{
+	u64 start = sim->instruction_count;
+
+	bool watching = (breaks->watchpoint_count != 0);
+
+	Instruction scratch;
+	while (!max_instructions || sim->instruction_count - start < max_instructions)
+	{
+		Instruction *inst = FetchInstruction(sim, &scratch);
+		if (!inst)
+		{
+			break;
+		}
+
+		u16 ip = sim->ip;
+		if (BitIsSet(breaks->ip_bits, ip) && !breaks->resuming)
+		{
+			breaks->reason   = Break_Breakpoint;
+			breaks->ip       = ip;
+			breaks->resuming = true;
+			break;
+		}
+		breaks->resuming = false;
+
+		bool watch_hit = watching && WillHitWatchpoint(breaks, sim, inst);
+
+		ExecuteInstruction(sim, inst);
+
+		if (watch_hit && !sim->error)
+		{
+			breaks->reason = Break_Watchpoint;
+			breaks->ip     = ip;
+			break;
+		}
+	}
+
+	return sim->instruction_count - start;
+}
+
+function u64 RunWithBreakpoints(Simulator *sim, Breakpoints *breaks, u64 max_instructions)
+{
+	breaks->reason = Break_None;
+
+	u64 result;
+	if (BreakpointsArmed(breaks))
+	{
+		result = RunInstrumented(sim, breaks, max_instructions);
+	}
+	else
+	{
+		result = RunBlocks(sim, max_instructions);
+	}
+
+	return result;
+}
+
+function void PrintBreak(FILE *out, Breakpoints *breaks, Simulator *sim)
+{
+	u8 output_bytes[256];
+	Buffer output =
+	{
+		.capacity = sizeof(output_bytes),
+		.bytes    = output_bytes,
+	};
+
+	String address_space =
+	{
+		.count = Kilobytes(64),
+		.bytes = sim->memory,
+	};
+
+	String text = DisassembleAt(address_space, breaks->ip, output);
+
+	if (breaks->reason == Break_Watchpoint)
+	{
+		Watchpoint *watch = &breaks->watchpoints[breaks->watchpoint_index];
+		fprintf(out, "Watchpoint %u (0x%05x..0x%05x) written at 0x%05x by %04x  %.*s",
+				breaks->watchpoint_index, watch->start, watch->end - 1, breaks->address, breaks->ip, StringExpand(text));
+	}
+	else
+	{
+		fprintf(out, "Breakpoint at %04x  %.*s", breaks->ip, StringExpand(text));
+	}
+
+	PrintRegisterLine(out, sim);
+}
@@ -0,0 +1,61 @@
+// Breakpoints on IP and watchpoints on ranges of memory being written. Checks
+// go through bitmaps, a bit per address for breakpoints and a bit per
+// WATCH_PAGE_SIZE bytes for watchpoints, so an instruction that doesn't hit
+// anything costs a couple of bit tests. They still need a loop that looks at
+// every instruction, which the block executor doesn't have, so
+// RunWithBreakpoints only uses that loop while something is armed and runs
+// everything else through RunBlocks at full speed.
+
+#define WATCH_PAGE_SHIFT 8
+#define WATCH_PAGE_SIZE  (1 << WATCH_PAGE_SHIFT)
+#define WATCH_PAGE_COUNT (SIM_MEMORY_SIZE >> WATCH_PAGE_SHIFT)
+
+#define MAX_WATCHPOINTS 16
+
+typedef enum BreakReason
+{
+	Break_None,
+	Break_Breakpoint, // before the instruction at ip ran
+	Break_Watchpoint, // after the instruction at ip wrote to address
+} BreakReason;
+
+typedef struct Watchpoint
+{
+	// Linear addresses, end exclusive
+	u32 start;
+	u32 end;
+} Watchpoint;
+
+typedef struct Breakpoints
+{
+	u64 ip_bits[Kilobytes(64) / 64];
+	u64 watch_page_bits[WATCH_PAGE_COUNT / 64];
+
+	u32        breakpoint_count;
+	u32        watchpoint_count;
+	Watchpoint watchpoints[MAX_WATCHPOINTS];
+
+	// Why the last run stopped
+	BreakReason reason;
+	u16         ip;
+	u32         address;
+	u32         watchpoint_index;
+
+	// Stopped at a breakpoint, which the next run should execute rather than
+	// stop at again
+	bool resuming;
+} Breakpoints;
+
+function void AddBreakpoint(Breakpoints *breaks, u16 ip);
+
+// Returns false when there's no room for another
+function bool AddWatchpoint(Breakpoints *breaks, u32 address, u32 count);
+
+function bool BreakpointsArmed(Breakpoints *breaks);
+
+// Runs like RunBlocks until a breakpoint or watchpoint is hit as well, then
+// breaks->reason says which. Returns the number of instructions executed.
+function u64 RunWithBreakpoints(Simulator *sim, Breakpoints *breaks, u64 max_instructions);
+
+// One line on what was hit, and one with the registers
+function void PrintBreak(FILE *out, Breakpoints *breaks, Simulator *sim);
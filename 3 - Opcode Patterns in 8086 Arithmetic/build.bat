@@ -7,3 +7,27 @@ echo -----------------------------------------------------
 echo[
 
 cl.exe /nologo /Zi /W4 /WX /wd4201 /D_CRT_SECURE_NO_WARNINGS sim8086.c
+
+echo[
+echo -----------------------------------------------------
+echo Building Instruction Stream Generator
+echo -----------------------------------------------------
+echo[
+
+cl.exe /nologo /Zi /W4 /WX /wd4201 /D_CRT_SECURE_NO_WARNINGS gen8086.c
+
+echo[
+echo -----------------------------------------------------
+echo Building Decoder Benchmark
+echo -----------------------------------------------------
+echo[
+
+cl.exe /nologo /O2 /Zi /W4 /WX /wd4201 /D_CRT_SECURE_NO_WARNINGS decoder_bench.c decoder_bench_part1.c decoder_bench_part2.c
+
+echo[
+echo -----------------------------------------------------
+echo Building Simulator Benchmark
+echo -----------------------------------------------------
+echo[
+
+cl.exe /nologo /O2 /Zi /W4 /WX /wd4201 /D_CRT_SECURE_NO_WARNINGS sim_bench.c
@@ -1,6 +1,33 @@
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#include <intrin.h>
+#else
+#define _GNU_SOURCE
+#include <x86intrin.h>
+#include <cpuid.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+#endif
+
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
@@ -52,6 +79,51 @@ function String StringFromCString(const char *c_string)
 	return result;
 }
 
+function bool StringsAreEqual(String a, String b)
+{
+	if (a.count != b.count)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < a.count; i++)
+	{
+		if (a.bytes[i] != b.bytes[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+function u8 ToLowerASCII(u8 c)
+{
+	if (c >= 'A' && c <= 'Z')
+	{
+		c = (u8)(c + ('a' - 'A'));
+	}
+	return c;
+}
+
+function bool StringsAreEqualNoCase(String a, String b)
+{
+	if (a.count != b.count)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < a.count; i++)
+	{
+		if (ToLowerASCII(a.bytes[i]) != ToLowerASCII(b.bytes[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 #define StringExpand(string) (int)((string).count), (char *)(string).bytes
 #define StringLit(string) (String){ sizeof(string) - 1, (const u8 *)string }
 #define StringLitConst(string) { sizeof(string) - 1, (const u8 *)string }
@@ -63,4 +135,114 @@ function String StringFromCString(const char *c_string)
 #define ArrayCount(a) (sizeof(a) / sizeof((a)[0]))
 #define ZeroStruct(a) memset(a, 0, sizeof(*(a)))
 
+#define Kilobytes(x) ((u64)(x) << 10)
+#define Megabytes(x) ((u64)(x) << 20)
+#define Gigabytes(x) ((u64)(x) << 30)
+
+// align has to be a power of two
+#define AlignPow2(x, align) (((x) + (align) - 1) & ~((u64)(align) - 1))
+
+#define Glue_(a, b) a##b
+#define Glue(a, b) Glue_(a, b)
+
+#if defined(_MSC_VER)
 #define thread_local __declspec(thread)
+#define force_inline static __forceinline
+#else
+#define thread_local __thread
+#define force_inline static inline __attribute__((always_inline))
+#endif
+
+// For functions using AVX2 intrinsics. MSVC takes them anywhere, gcc and clang
+// only in functions marked for it. Don't call any unless HostHasAVX2.
+#if defined(_MSC_VER)
+#define target_avx2
+#else
+#define target_avx2 __attribute__((target("avx2")))
+#endif
+
+// Decimal with an optional k, m or g suffix, or hexadecimal after 0x
+function u64 ParseU64(String string, bool *ok)
+{
+	u64 result = 0;
+
+	*ok = (string.count > 0);
+
+	if (string.count > 2 && string.bytes[0] == '0' && ToLowerASCII(string.bytes[1]) == 'x')
+	{
+		for (size_t i = 2; i < string.count; i++)
+		{
+			u8 c = ToLowerASCII(string.bytes[i]);
+			if (c >= '0' && c <= '9')
+			{
+				result = 16*result + (c - '0');
+			}
+			else if (c >= 'a' && c <= 'f')
+			{
+				result = 16*result + (c - 'a' + 10);
+			}
+			else
+			{
+				*ok = false;
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	size_t i = 0;
+	for (; i < string.count; i++)
+	{
+		u8 c = string.bytes[i];
+		if (c < '0' || c > '9')
+		{
+			break;
+		}
+		result = 10*result + (c - '0');
+	}
+
+	if (i + 1 == string.count)
+	{
+		switch (ToLowerASCII(string.bytes[i]))
+		{
+			case 'k': { result = Kilobytes(result); } break;
+			case 'm': { result = Megabytes(result); } break;
+			case 'g': { result = Gigabytes(result); } break;
+			default:  { *ok = false; } break;
+		}
+	}
+	else if (i != string.count)
+	{
+		*ok = false;
+	}
+
+	return result;
+}
+
+// Splits string at the first occurrence of separator. The part before goes in
+// head, the rest in string. Returns false when string was empty.
+function bool SplitString(String *string, u8 separator, String *head)
+{
+	head->count = 0;
+	head->bytes = string->bytes;
+
+	if (!string->count)
+	{
+		return false;
+	}
+
+	size_t i = 0;
+	while (i < string->count && string->bytes[i] != separator)
+	{
+		i++;
+	}
+
+	head->count = i;
+
+	size_t skip = Min(i + 1, string->count);
+	string->bytes += skip;
+	string->count -= skip;
+
+	return true;
+}
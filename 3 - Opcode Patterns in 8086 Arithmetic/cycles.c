@@ -0,0 +1,308 @@
+#define Shape(first, second) MakeOperandShape(OperandClass_##first, OperandClass_##second)
+
+#define ALU_CYCLES                 \
+	{                              \
+		[Shape(Reg, Reg)] = 3,     \
+		[Shape(Reg, Mem)] = 9,     \
+		[Shape(Mem, Reg)] = 16,    \
+		[Shape(Reg, Imm)] = 4,     \
+		[Shape(Mem, Imm)] = 17,    \
+	}
+
+// Clocks without the effective address calculation. Jumps are under their
+// Imm shape (the displacement) with the count for when they're taken.
+global u8 base_cycles[Mnemonic_Count][OperandShape_Count] =
+{
+	[MOV] =
+	{
+		[Shape(Reg, Reg)] = 2,
+		[Shape(Reg, Mem)] = 8,
+		[Shape(Mem, Reg)] = 9,
+		[Shape(Reg, Imm)] = 4,
+		[Shape(Mem, Imm)] = 10,
+	},
+
+	[ADD] = ALU_CYCLES,
+	[OR]  = ALU_CYCLES,
+	[ADC] = ALU_CYCLES,
+	[SBB] = ALU_CYCLES,
+	[AND] = ALU_CYCLES,
+	[SUB] = ALU_CYCLES,
+	[XOR] = ALU_CYCLES,
+
+	[CMP] =
+	{
+		[Shape(Reg, Reg)] = 3,
+		[Shape(Reg, Mem)] = 9,
+		[Shape(Mem, Reg)] = 9,
+		[Shape(Reg, Imm)] = 4,
+		[Shape(Mem, Imm)] = 10,
+	},
+
+	[INC]  = { [Shape(Reg, None)] = 2,  [Shape(Mem, None)] = 15 },
+	[DEC]  = { [Shape(Reg, None)] = 2,  [Shape(Mem, None)] = 15 },
+	[PUSH] = { [Shape(Reg, None)] = 11, [Shape(Mem, None)] = 16 },
+	[POP]  = { [Shape(Reg, None)] = 8,  [Shape(Mem, None)] = 17 },
+	[CALL] = { [Shape(Reg, None)] = 16, [Shape(Mem, None)] = 21 },
+	[JMP]  = { [Shape(Reg, None)] = 11, [Shape(Mem, None)] = 18 },
+
+	[XCHG] =
+	{
+		[Shape(Reg, Reg)] = 4,
+		[Shape(Reg, Mem)] = 17,
+		[Shape(Mem, Reg)] = 17,
+	},
+
+	[JO]  = { [Shape(Imm, None)] = 16 },
+	[JNO] = { [Shape(Imm, None)] = 16 },
+	[JB]  = { [Shape(Imm, None)] = 16 },
+	[JAE] = { [Shape(Imm, None)] = 16 },
+	[JE]  = { [Shape(Imm, None)] = 16 },
+	[JNE] = { [Shape(Imm, None)] = 16 },
+	[JBE] = { [Shape(Imm, None)] = 16 },
+	[JA]  = { [Shape(Imm, None)] = 16 },
+	[JS]  = { [Shape(Imm, None)] = 16 },
+	[JNS] = { [Shape(Imm, None)] = 16 },
+	[JP]  = { [Shape(Imm, None)] = 16 },
+	[JPO] = { [Shape(Imm, None)] = 16 },
+	[JL]  = { [Shape(Imm, None)] = 16 },
+	[JGE] = { [Shape(Imm, None)] = 16 },
+	[JLE] = { [Shape(Imm, None)] = 16 },
+	[JG]  = { [Shape(Imm, None)] = 16 },
+
+	[LOOPNE] = { [Shape(Imm, None)] = 19 },
+	[LOOPE]  = { [Shape(Imm, None)] = 18 },
+	[LOOP]   = { [Shape(Imm, None)] = 17 },
+	[JCXZ]   = { [Shape(Imm, None)] = 18 },
+
+	// The port is the Imm, or dx
+	[IN]  = { [Shape(Reg, Imm)] = 10, [Shape(Reg, Reg)] = 8 },
+	[OUT] = { [Shape(Reg, Imm)] = 10, [Shape(Reg, Reg)] = 8 },
+};
+
+#undef ALU_CYCLES
+#undef Shape
+
+// Conditional jumps and loops when they fall through
+global u8 not_taken_cycles[Mnemonic_Count] =
+{
+	[JO]  = 4, [JNO] = 4, [JB]  = 4, [JAE] = 4,
+	[JE]  = 4, [JNE] = 4, [JBE] = 4, [JA]  = 4,
+	[JS]  = 4, [JNS] = 4, [JP]  = 4, [JPO] = 4,
+	[JL]  = 4, [JGE] = 4, [JLE] = 4, [JG]  = 4,
+
+	[LOOPNE] = 5,
+	[LOOPE]  = 6,
+	[LOOP]   = 5,
+	[JCXZ]   = 6,
+};
+
+// Effective address calculation by mod and r/m, in eac_register_table order.
+// Mod 00 with r/m 110 is the direct address.
+global u8 ea_cycles[3][ArrayCount(eac_register_table)] =
+{
+	{  7,  8,  8,  7, 5, 5, 6, 5 },
+	{ 11, 12, 12, 11, 9, 9, 9, 9 },
+	{ 11, 12, 12, 11, 9, 9, 9, 9 },
+};
+
+function u32 EffectiveAddressCycles(EffectiveAddress *ea)
+{
+	// The decoder keeps the registers and the displacement, not the mod and
+	// r/m they came from, so go back from one to the other
+	u32 mod = 0;
+	u32 r_m = 6;
+
+	if (ea->reg1)
+	{
+		for (u32 index = 0; index < ArrayCount(eac_register_table); index++)
+		{
+			if (eac_register_table[index].reg1 == ea->reg1 &&
+				eac_register_table[index].reg2 == ea->reg2)
+			{
+				r_m = index;
+				break;
+			}
+		}
+
+		// [bp] is only encodable with a displacement
+		if (ea->disp || r_m == 6)
+		{
+			mod = (ea->disp >= -128 && ea->disp <= 127) ? 1 : 2;
+		}
+	}
+
+	u32 result = ea_cycles[mod][r_m];
+
+	if (ea->segment)
+	{
+		result += 2;
+	}
+
+	return result;
+}
+
+// Whether the jump or loop will jump, from the state before it executes
+function bool JumpWillBeTaken(Simulator *sim, Mnemonic mnemonic)
+{
+	bool result = false;
+
+	u16 cx = sim->regs.words[Slot_CX];
+
+	switch (mnemonic)
+	{
+		case LOOP:   { result = (cx != 1);                               } break;
+		case LOOPE:  { result = (cx != 1) &&  FlagSet(sim, CPUFlag_ZF); } break;
+		case LOOPNE: { result = (cx != 1) && !FlagSet(sim, CPUFlag_ZF); } break;
+		case JCXZ:   { result = (cx == 0);                               } break;
+
+		default:
+		{
+			result = ConditionHolds(sim, mnemonic);
+		} break;
+	}
+
+	return result;
+}
+
+// How many times an instruction reads or writes its memory operand
+function u32 MemoryOperandTransfers(Mnemonic mnemonic, bool destination)
+{
+	u32 result = 1;
+
+	switch (mnemonic)
+	{
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		{
+			// Read, modify, write back
+			result = destination ? 2 : 1;
+		} break;
+
+		case INC:
+		case DEC:
+		case XCHG:
+		{
+			result = 2;
+		} break;
+	}
+
+	return result;
+}
+
+function CycleEstimate EstimateCycles(Simulator *sim, Instruction *inst, CycleModel model)
+{
+	CycleEstimate result = { 0 };
+
+	Mnemonic     mnemonic = inst->mnemonic;
+	OperandShape shape    = ShapeOfInstruction(inst);
+	DecodeKind   kind     = DecodeKindOfInstruction(&sim->decoder, inst);
+
+	result.base = base_cycles[mnemonic][shape];
+	if (!result.base)
+	{
+		return result;
+	}
+
+	if (kind == Decode_JumpIpInc8)
+	{
+		if (!JumpWillBeTaken(sim, mnemonic))
+		{
+			result.base = not_taken_cycles[mnemonic];
+		}
+		return result;
+	}
+
+	// The forms with cheaper encodings of their own
+	if (kind == Decode_MemToAccum || kind == Decode_AccumToMem)
+	{
+		result.base = 10;
+	}
+	else if (kind == Decode_RegAccum)
+	{
+		result.base = 3; // xchg ax, reg
+	}
+	else if (mnemonic == PUSH && inst->op1.kind == Operand_SegReg)
+	{
+		result.base = 10;
+	}
+	else if ((mnemonic == INC || mnemonic == DEC) && inst->op1.kind == Operand_Reg && inst->op1.reg < AX)
+	{
+		result.base = 3;
+	}
+
+	bool wide = InstructionIsWide(inst);
+
+	// Word transfers, and how many of them went to odd addresses
+	u32 words     = 0;
+	u32 odd_words = 0;
+
+	Operand *operands[] = { &inst->op1, &inst->op2 };
+	for (u32 index = 0; index < ArrayCount(operands); index++)
+	{
+		Operand *operand = operands[index];
+		if (operand->kind == Operand_Mem)
+		{
+			if (kind != Decode_MemToAccum && kind != Decode_AccumToMem)
+			{
+				result.ea = EffectiveAddressCycles(&operand->mem);
+			}
+
+			if (wide)
+			{
+				u32 transfers = MemoryOperandTransfers(mnemonic, index == 0);
+				words += transfers;
+
+				if (EffectiveAddressOf(sim, &operand->mem) & 1)
+				{
+					odd_words += transfers;
+				}
+			}
+		}
+	}
+
+	if (mnemonic == PUSH || mnemonic == POP || mnemonic == CALL)
+	{
+		// The stack slot, at sp - 2 or sp, which is odd when sp is
+		words += 1;
+		if (sim->regs.words[Slot_SP] & 1)
+		{
+			odd_words += 1;
+		}
+	}
+
+	result.transfer_penalty = 4*(model == CycleModel_8088 ? words : odd_words);
+
+	return result;
+}
+
+function u32 TotalCycles(CycleEstimate *estimate)
+{
+	return estimate->base + estimate->ea + estimate->transfer_penalty;
+}
+
+function void PrintCycleEstimate(FILE *out, CycleEstimate *estimate, u64 running_total)
+{
+	u32 total = TotalCycles(estimate);
+
+	fprintf(out, "Clocks: +%u = %llu", total, (unsigned long long)running_total);
+
+	if (estimate->ea || estimate->transfer_penalty)
+	{
+		fprintf(out, " (%u", estimate->base);
+		if (estimate->ea)
+		{
+			fprintf(out, " + %uea", estimate->ea);
+		}
+		if (estimate->transfer_penalty)
+		{
+			fprintf(out, " + %up", estimate->transfer_penalty);
+		}
+		fprintf(out, ")");
+	}
+}
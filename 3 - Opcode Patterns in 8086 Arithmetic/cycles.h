@@ -0,0 +1,30 @@
+// Clock count estimates from the timing tables in the 8086 family user's
+// manual: a base count per mnemonic and operand shape, plus the effective
+// address calculation, plus a penalty for word transfers the bus has to split
+// in two. The prefetch queue and wait states aren't modelled, so real code
+// tends to come out slower than the estimate, the 8088 most of all, where
+// instruction fetches compete with data for the 8-bit bus.
+
+typedef enum CycleModel
+{
+	// Word transfers to odd addresses take two bus cycles
+	CycleModel_8086,
+	// All word transfers take two bus cycles
+	CycleModel_8088,
+} CycleModel;
+
+typedef struct CycleEstimate
+{
+	u32 base;
+	u32 ea;
+	u32 transfer_penalty;
+} CycleEstimate;
+
+// Call right before executing the instruction: the addresses it touches and
+// whether it jumps are worked out from the current registers and flags. The
+// estimate is all zero for instructions the tables don't cover.
+function CycleEstimate EstimateCycles(Simulator *sim, Instruction *inst, CycleModel model);
+function u32 TotalCycles(CycleEstimate *estimate);
+
+// e.g. "Clocks: +17 = 42 (8 + 5ea + 4p)"
+function void PrintCycleEstimate(FILE *out, CycleEstimate *estimate, u64 running_total);
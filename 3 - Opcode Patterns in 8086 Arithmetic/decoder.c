@@ -50,6 +50,22 @@ function void InitializeDecoder(Decoder *decoder, String source)
 	}
 }
 
+function u8 *OpcodeOfInstruction(Decoder *decoder, Instruction *inst)
+{
+	u8 *at = decoder->base + inst->source_byte_offset;
+	while (decode_params[*at].kind == Decode_SegmentPrefix)
+	{
+		at++;
+	}
+	return at;
+}
+
+function DecodeKind DecodeKindOfInstruction(Decoder *decoder, Instruction *inst)
+{
+	u8 b1 = *OpcodeOfInstruction(decoder, inst);
+	return decode_params[b1].kind;
+}
+
 function void DecoderError(Decoder *decoder, String message)
 {
 	if (!decoder->error)
@@ -214,6 +230,22 @@ function bool DecodeNextInstruction(Decoder *decoder, Instruction *inst)
 	inst->source_byte_offset = (u32)(decoder->at - decoder->base);
 
 	u8 b1 = DecoderReadU8(decoder);
+
+	// An override applies to the memory operand of the instruction after it
+	Register segment     = Reg_None;
+	u32      prefix_count = 0;
+	while (decode_params[b1].kind == Decode_SegmentPrefix && !decoder->error)
+	{
+		if (++prefix_count > INSTRUCTION_MAX_PREFIXES)
+		{
+			DecoderError(decoder, StringLit("Too many prefixes"));
+			break;
+		}
+
+		segment = (Register)(ES + ((b1 >> 3) & 0x3));
+		b1      = DecoderReadU8(decoder);
+	}
+
 	inst->mnemonic = instruction_kinds[b1];
 
 	DecodeParams *params = &decode_params[b1];
@@ -264,6 +296,28 @@ function bool DecodeNextInstruction(Decoder *decoder, Instruction *inst)
 			}
 		} break;
 
+		case Decode_RegMemToFromSegReg:
+		{
+			u8 d = (b1 >> 1) & 0x1;
+
+			u8 b2 = DecoderReadU8(decoder);
+
+			u8 mod = (b2 >> 6) & 0x3;
+			u8 sr  = (b2 >> 3) & 0x3;
+			u8 r_m = (b2 >> 0) & 0x7;
+
+			if (d)
+			{
+				inst->op1 = DecodeSegmentRegister(sr);
+				inst->op2 = DecodeEffectiveAddress(decoder, mod, 1, r_m);
+			}
+			else
+			{
+				inst->op1 = DecodeEffectiveAddress(decoder, mod, 1, r_m);
+				inst->op2 = DecodeSegmentRegister(sr);
+			}
+		} break;
+
 		case Decode_ImmToRegMem:
 		{
 			u8 s = 0;
@@ -360,6 +414,10 @@ function bool DecodeNextInstruction(Decoder *decoder, Instruction *inst)
 			{
 				u8 op = (b2 >> 3) & 0x7;
 				inst->mnemonic = grp2_table[op];
+				if (op == 3 || op == 5)
+				{
+					inst->flags |= InstructionFlag_Far;
+				}
 			}
 
 			u8 mod = (b2 >> 6) & 0x3;
@@ -388,6 +446,18 @@ function bool DecodeNextInstruction(Decoder *decoder, Instruction *inst)
 		} break;
 	}
 
+	if (segment)
+	{
+		if (inst->op1.kind == Operand_Mem)
+		{
+			inst->op1.mem.segment = segment;
+		}
+		else if (inst->op2.kind == Operand_Mem)
+		{
+			inst->op2.mem.segment = segment;
+		}
+	}
+
 	u32 source_byte_end = (u32)(decoder->at - decoder->base);
 	inst->source_byte_count = source_byte_end - inst->source_byte_offset;
 
@@ -35,6 +35,33 @@ enum DecodeKind
 	Decode_JumpIpInc8,
 	Decode_IOFixedPort,
 	Decode_IOVariablePort,
+	Decode_RegMemToFromSegReg,
+
+	// Not an instruction, but a prefix to the one that follows
+	Decode_SegmentPrefix,
+
+	Decode_Count,
+};
+
+global String decode_kind_names[Decode_Count] =
+{
+	[Decode_INVALID]            = StringLitConst("INVALID"),
+	[Decode_Single]             = StringLitConst("Single"),
+	[Decode_Reg]                = StringLitConst("Reg"),
+	[Decode_RegAccum]           = StringLitConst("RegAccum"),
+	[Decode_SegReg]             = StringLitConst("SegReg"),
+	[Decode_RegMem]             = StringLitConst("RegMem"),
+	[Decode_RegMemToFromReg]    = StringLitConst("RegMemToFromReg"),
+	[Decode_ImmToRegMem]        = StringLitConst("ImmToRegMem"),
+	[Decode_ImmToReg]           = StringLitConst("ImmToReg"),
+	[Decode_ImmToAccum]         = StringLitConst("ImmToAccum"),
+	[Decode_MemToAccum]         = StringLitConst("MemToAccum"),
+	[Decode_AccumToMem]         = StringLitConst("AccumToMem"),
+	[Decode_JumpIpInc8]         = StringLitConst("JumpIpInc8"),
+	[Decode_IOFixedPort]        = StringLitConst("IOFixedPort"),
+	[Decode_IOVariablePort]     = StringLitConst("IOVariablePort"),
+	[Decode_RegMemToFromSegReg] = StringLitConst("RegMemToFromSegReg"),
+	[Decode_SegmentPrefix]      = StringLitConst("SegmentPrefix"),
 };
 
 global Mnemonic immed_table[] =
@@ -79,6 +106,12 @@ typedef struct DecodeParams
 	Flags flags;
 } DecodeParams;
 
+// Which decoder path an already decoded instruction went through
+function DecodeKind DecodeKindOfInstruction(Decoder *decoder, Instruction *inst);
+
+// The first byte of an already decoded instruction after any prefixes
+function u8 *OpcodeOfInstruction(Decoder *decoder, Instruction *inst);
+
 typedef struct Pattern
 {
 	u8 b1, b1_mask;
@@ -94,6 +127,7 @@ global Pattern patterns[] =
 	{ .b1 = 0b10110000, .b1_mask = 0b11110000, .mnemonic = MOV,            .decoder = Decode_ImmToReg                             },
 	{ .b1 = 0b10100000, .b1_mask = 0b11111110, .mnemonic = MOV,            .decoder = Decode_MemToAccum                           },
 	{ .b1 = 0b10100010, .b1_mask = 0b11111110, .mnemonic = MOV,            .decoder = Decode_AccumToMem                           },
+	{ .b1 = 0b10001100, .b1_mask = 0b11111101, .mnemonic = MOV,            .decoder = Decode_RegMemToFromSegReg                   },
 
 	{ .b1 = 0b00000000, .b1_mask = 0b11000100, .mnemonic = Mnemonic_Immed, .decoder = Decode_RegMemToFromReg,                     },
 	{ .b1 = 0b10000000, .b1_mask = 0b11111100, .mnemonic = Mnemonic_Immed, .decoder = Decode_ImmToRegMem,      .decode_flags = S  },
@@ -122,6 +156,8 @@ global Pattern patterns[] =
 	{ .b1 = 0b11100011, .b1_mask = 0b11111111, .mnemonic = JCXZ,           .decoder = Decode_JumpIpInc8                           },
 
 	{ .b1 = 0b11111111, .b1_mask = 0b11111111, .mnemonic = Mnemonic_Grp2,  .decoder = Decode_RegMem                               },
+	{ .b1 = 0b01000000, .b1_mask = 0b11111000, .mnemonic = INC,            .decoder = Decode_Reg                                  },
+	{ .b1 = 0b01001000, .b1_mask = 0b11111000, .mnemonic = DEC,            .decoder = Decode_Reg                                  },
 	{ .b1 = 0b01010000, .b1_mask = 0b11111000, .mnemonic = PUSH,           .decoder = Decode_Reg                                  },
 	{ .b1 = 0b00000110, .b1_mask = 0b11100111, .mnemonic = PUSH,           .decoder = Decode_SegReg                               },
 
@@ -136,4 +172,6 @@ global Pattern patterns[] =
 	{ .b1 = 0b11101100, .b1_mask = 0b11111110, .mnemonic = IN,             .decoder = Decode_IOVariablePort,                      },
 	{ .b1 = 0b11100110, .b1_mask = 0b11111110, .mnemonic = OUT,            .decoder = Decode_IOFixedPort,                         },
 	{ .b1 = 0b11101110, .b1_mask = 0b11111110, .mnemonic = OUT,            .decoder = Decode_IOVariablePort,                      },
+
+	{ .b1 = 0b00100110, .b1_mask = 0b11100111, .mnemonic = Mnemonic_None,  .decoder = Decode_SegmentPrefix,                       },
 };
@@ -0,0 +1,474 @@
+#include "common.h"
+#include "platform.h"
+#include "random.h"
+#include "instruction.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "generator.h"
+#include "repetition_tester.h"
+#include "decoder_bench.h"
+
+//
+//
+//
+
+#include "platform.c"
+#include "decoder.c"
+#include "disassembler.c"
+#include "generator.c"
+#include "repetition_tester.c"
+
+//
+// Head-to-head benchmark of the three decoder designs in this repository:
+//
+//     part 1: a switch on the top 6 bits of the opcode, register to register mov only
+//     part 2: opcode_lookup, a 256 entry table of opcodes, every form of mov
+//     part 3: patterns[] expanded into decode_params, separate decode and disassembly
+//
+// Parts 1 and 2 decode and print in one go, so they are compared against
+// part 3's decode + disassemble. Part 3's decode alone is listed as well.
+//
+
+global u8  g_print_buffer[1 << 16];
+global u64 g_print_at;
+global u64 g_print_line_count;
+
+int BenchPrintf(const char *format, ...)
+{
+	if (g_print_at + 256 > sizeof(g_print_buffer))
+	{
+		g_print_at = 0;
+	}
+
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf((char *)g_print_buffer + g_print_at, sizeof(g_print_buffer) - g_print_at, format, args);
+	va_end(args);
+
+	if (written > 0)
+	{
+		u8 *at  = g_print_buffer + g_print_at;
+		u8 *end = at + Min((u64)written, sizeof(g_print_buffer) - g_print_at);
+		while (at < end)
+		{
+			g_print_line_count += (*at++ == '\n');
+		}
+
+		g_print_at = end - g_print_buffer;
+	}
+
+	return written;
+}
+
+void ResetBenchPrintf(void)
+{
+	g_print_at         = 0;
+	g_print_line_count = 0;
+}
+
+uint64_t BenchPrintfLineCount(void)
+{
+	return g_print_line_count;
+}
+
+//
+//
+//
+
+typedef enum DecoderGeneration
+{
+	Generation_Part1,
+	Generation_Part2,
+	Generation_Part3Decode,
+	Generation_Part3Disassemble,
+
+	Generation_Count,
+} DecoderGeneration;
+
+global String generation_names[Generation_Count] =
+{
+	[Generation_Part1]            = StringLitConst("part 1, single opcode switch"),
+	[Generation_Part2]            = StringLitConst("part 2, opcode_lookup"),
+	[Generation_Part3Decode]      = StringLitConst("part 3, patterns[] decode only"),
+	[Generation_Part3Disassemble] = StringLitConst("part 3, patterns[] + disassemble"),
+};
+
+typedef struct Workload
+{
+	String name;
+	String bytes;
+
+	// According to part 3's decoder, which understands all of the inputs
+	u64 instruction_count;
+
+	bool supported[Generation_Count];
+} Workload;
+
+global u8 g_disasm_output[1 << 16];
+
+// Returns the number of instructions that were decoded
+function u64 RunGeneration(DecoderGeneration generation, String bytes)
+{
+	u64 result = 0;
+
+	switch (generation)
+	{
+		case Generation_Part1:
+		{
+			ResetBenchPrintf();
+			BenchDisassemblePart1(bytes.bytes, bytes.count);
+			result = BenchPrintfLineCount();
+		} break;
+
+		case Generation_Part2:
+		{
+			ResetBenchPrintf();
+			BenchDisassemblePart2(bytes.bytes, bytes.count);
+
+			// Part 2 prints a two line header before the instructions
+			result = BenchPrintfLineCount() - Min(BenchPrintfLineCount(), 2);
+		} break;
+
+		case Generation_Part3Decode:
+		{
+			Decoder *decoder = &(Decoder){ 0 };
+			InitializeDecoder(decoder, bytes);
+
+			Instruction inst;
+			while (DecodeNextInstruction(decoder, &inst))
+			{
+				result++;
+			}
+		} break;
+
+		case Generation_Part3Disassemble:
+		{
+			Decoder *decoder = &(Decoder){ 0 };
+			InitializeDecoder(decoder, bytes);
+
+			Buffer output =
+			{
+				.capacity = sizeof(g_disasm_output),
+				.bytes    = g_disasm_output,
+			};
+
+			Disassembler *disasm = &(Disassembler){ 0 };
+			DisassemblerParams disasm_params =
+			{
+				.input  = bytes,
+				.output = output,
+			};
+			InitializeDisassembler(disasm, &disasm_params);
+
+			Instruction inst;
+			while (DecodeNextInstruction(decoder, &inst))
+			{
+				if (DisasmWriteLeft(disasm) < 128)
+				{
+					DisassemblerResetOutput(disasm, output);
+				}
+
+				DisassembleInstruction(disasm, &inst);
+				result++;
+			}
+		} break;
+
+		default: break;
+	}
+
+	return result;
+}
+
+function String RepeatToSize(String unit, u64 size)
+{
+	String result = { 0 };
+
+	if (unit.count)
+	{
+		u64 copies = Max(size / unit.count, 1);
+
+		u8 *bytes = malloc(copies*unit.count);
+		if (bytes)
+		{
+			for (u64 copy = 0; copy < copies; copy++)
+			{
+				memcpy(bytes + copy*unit.count, unit.bytes, unit.count);
+			}
+
+			result.count = copies*unit.count;
+			result.bytes = bytes;
+		}
+	}
+
+	return result;
+}
+
+function String ConcatenateFiles(u32 file_count, const char **file_names)
+{
+	String result = { 0 };
+
+	String files[8];
+	u64 total = 0;
+
+	for (u32 file_index = 0; file_index < file_count && file_index < ArrayCount(files); file_index++)
+	{
+		files[file_index] = MapEntireFile(file_names[file_index]);
+		if (!files[file_index].count)
+		{
+			fprintf(stderr, "Couldn't read %s, skipping the workloads that need it (run from the part 3 directory)\n", file_names[file_index]);
+			file_count = file_index;
+			break;
+		}
+		total += files[file_index].count;
+	}
+
+	u8 *bytes = total ? malloc(total) : NULL;
+	if (bytes)
+	{
+		u64 at = 0;
+		for (u32 file_index = 0; file_index < file_count; file_index++)
+		{
+			memcpy(bytes + at, files[file_index].bytes, files[file_index].count);
+			at += files[file_index].count;
+		}
+
+		result.count = total;
+		result.bytes = bytes;
+	}
+
+	for (u32 file_index = 0; file_index < file_count; file_index++)
+	{
+		UnmapEntireFile(files[file_index]);
+	}
+
+	return result;
+}
+
+function String GenerateWorkload(u64 size, u64 seed, const char *mix_string, u32 *mod_weights)
+{
+	String result = { 0 };
+
+	u32      mix_count = 0;
+	MixEntry mix[16];
+	if (!ParseMix(StringFromCString(mix_string), &mix_count, mix, ArrayCount(mix)))
+	{
+		return result;
+	}
+
+	Generator *gen = malloc(sizeof(Generator));
+	u8 *bytes = malloc(size);
+	if (gen && bytes)
+	{
+		InitializeGenerator(gen, seed, mix_count, mix, mod_weights);
+		result.count = GenerateStream(gen, bytes, size, NULL);
+		result.bytes = bytes;
+	}
+
+	free(gen);
+
+	return result;
+}
+
+function void AddWorkload(u32 *workload_count, Workload *workloads, String name, String bytes, bool part1, bool part2)
+{
+	if (!bytes.count)
+	{
+		return;
+	}
+
+	Workload *workload = &workloads[(*workload_count)++];
+	ZeroStruct(workload);
+
+	workload->name  = name;
+	workload->bytes = bytes;
+
+	workload->supported[Generation_Part1]            = part1;
+	workload->supported[Generation_Part2]            = part2;
+	workload->supported[Generation_Part3Decode]      = true;
+	workload->supported[Generation_Part3Disassemble] = true;
+}
+
+function void PrintUsage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [-seconds N] [-bytes N] [-csv file] [extra 8086 binaries...]\n", program);
+	fprintf(stderr, "  -seconds N   give up on finding a faster run after N seconds without one (default 2)\n");
+	fprintf(stderr, "  -bytes N     size of the synthetic workloads, accepts k/m/g suffixes (default 4m)\n");
+	fprintf(stderr, "  -csv file    append the results to file as comma separated values\n");
+}
+
+int main(int argument_count, char **arguments)
+{
+	u64    seconds  = 2;
+	u64    size     = Megabytes(4);
+	String csv_name = { 0 };
+
+	u32      workload_count = 0;
+	Workload workloads[32];
+
+	for (int argument_index = 1; argument_index < argument_count; argument_index++)
+	{
+		String argument = StringFromCString(arguments[argument_index]);
+
+		bool has_value = (argument_index + 1 < argument_count);
+		String value = { 0 };
+		if (has_value)
+		{
+			value = StringFromCString(arguments[argument_index + 1]);
+		}
+
+		bool ok = true;
+
+		if (StringsAreEqual(argument, StringLit("-seconds")) && has_value)
+		{
+			seconds = ParseU64(value, &ok);
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-bytes")) && has_value)
+		{
+			size = ParseU64(value, &ok);
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-csv")) && has_value)
+		{
+			csv_name = value;
+			argument_index++;
+		}
+		else if (argument.count && argument.bytes[0] != '-' && workload_count < ArrayCount(workloads))
+		{
+			// Nobody knows what's in there, let validation sort out which
+			// decoders can handle it
+			String bytes = MapEntireFile((const char *)argument.bytes);
+			if (!bytes.count)
+			{
+				fprintf(stderr, "Couldn't read '%.*s'\n", StringExpand(argument));
+				return 1;
+			}
+			AddWorkload(&workload_count, workloads, argument, bytes, true, true);
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "Bad argument '%.*s'\n", StringExpand(argument));
+			PrintUsage(arguments[0]);
+			return 1;
+		}
+	}
+
+	//
+	// The MOV-only subset the three decoders share: the register to register
+	// movs of listings 37 and 38 are all part 1 understands, part 2 handles
+	// every mov in listing 39 as well. The bundled listings are tiny, so they
+	// get repeated up to the size of the synthetic workloads.
+	//
+
+	const char *listings_37_38[] =
+	{
+		"listings/listing_0037_single_register_mov",
+		"listings/listing_0038_many_register_mov",
+	};
+
+	const char *listings_39[] =
+	{
+		"listings/listing_0039_more_movs",
+	};
+
+	String unit_37_38 = ConcatenateFiles(ArrayCount(listings_37_38), listings_37_38);
+	String unit_39    = ConcatenateFiles(ArrayCount(listings_39), listings_39);
+
+	u32 reg_to_reg_only[] = { 0, 0, 0, 1 };
+
+	AddWorkload(&workload_count, workloads, StringLit("listings 0037+0038, repeated"), RepeatToSize(unit_37_38, size), true, true);
+	AddWorkload(&workload_count, workloads, StringLit("listing 0039, repeated"), RepeatToSize(unit_39, size), false, true);
+	AddWorkload(&workload_count, workloads, StringLit("synthetic reg/reg mov"), GenerateWorkload(size, 1, "mov:RegMemToFromReg=1", reg_to_reg_only), true, true);
+	AddWorkload(&workload_count, workloads, StringLit("synthetic listing 0039 style mov"), GenerateWorkload(size, 1, "mov:RegMemToFromReg=3,mov:ImmToReg=1", NULL), false, true);
+
+	FILE *csv = NULL;
+	if (csv_name.count)
+	{
+		csv = fopen((const char *)csv_name.bytes, "ab");
+		if (!csv)
+		{
+			fprintf(stderr, "Couldn't open '%.*s' for writing\n", StringExpand(csv_name));
+			return 1;
+		}
+	}
+
+	u64 cpu_timer_freq = EstimateCPUTimerFreq();
+	printf("CPU timer frequency: %llu\n", (unsigned long long)cpu_timer_freq);
+
+	for (u32 workload_index = 0; workload_index < workload_count; workload_index++)
+	{
+		Workload *workload = &workloads[workload_index];
+
+		workload->instruction_count = RunGeneration(Generation_Part3Decode, workload->bytes);
+
+		printf("\n%.*s: %llu bytes, %llu instructions\n", StringExpand(workload->name),
+			   (unsigned long long)workload->bytes.count, (unsigned long long)workload->instruction_count);
+
+		for (u32 generation = 0; generation < Generation_Count; generation++)
+		{
+			if (!workload->supported[generation])
+			{
+				continue;
+			}
+
+			printf("  %-34.*s", StringExpand(generation_names[generation]));
+			fflush(stdout);
+
+			// Don't benchmark a decoder on input it doesn't understand, it would
+			// just stop early and look very fast
+			u64 decoded = RunGeneration(generation, workload->bytes);
+			if (decoded != workload->instruction_count)
+			{
+				printf("can't decode this (stopped after %llu instructions)\n", (unsigned long long)decoded);
+				continue;
+			}
+
+			RepetitionTester *tester = &(RepetitionTester){ 0 };
+			NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+			while (IsTesting(tester))
+			{
+				BeginTime(tester);
+				RunGeneration(generation, workload->bytes);
+				EndTime(tester);
+			}
+
+			u64    min_time = tester->results.min_time;
+			double seconds_taken = SecondsFromCPUTime(min_time, cpu_timer_freq);
+
+			double bytes_per_second        = (double)workload->bytes.count / seconds_taken;
+			double instructions_per_second = (double)workload->instruction_count / seconds_taken;
+			double cycles_per_instruction  = (double)min_time / (double)workload->instruction_count;
+
+			printf("%9.3fms %9.2f MB/s %9.2f M inst/s %7.2f cycles/inst\n",
+				   1000.0*seconds_taken,
+				   bytes_per_second / 1000000.0,
+				   instructions_per_second / 1000000.0,
+				   cycles_per_instruction);
+
+			if (csv)
+			{
+				fprintf(csv, "%.*s,%.*s,%llu,%llu,%f,%f,%f,%f\n",
+						StringExpand(workload->name),
+						StringExpand(generation_names[generation]),
+						(unsigned long long)workload->bytes.count,
+						(unsigned long long)workload->instruction_count,
+						seconds_taken,
+						bytes_per_second,
+						instructions_per_second,
+						cycles_per_instruction);
+			}
+		}
+	}
+
+	if (csv)
+	{
+		fclose(csv);
+	}
+
+	return 0;
+}
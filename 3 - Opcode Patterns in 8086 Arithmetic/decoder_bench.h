@@ -0,0 +1,17 @@
+// Interface between decoder_bench.c and the translation units wrapping the
+// decoders from parts 1 and 2. Those can't share a translation unit with part 3
+// (or with each other) since their common.h files define the same things, so
+// this header sticks to standard types.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The old decoders print as they go. Their printf is redirected here, which
+// formats into a scratch buffer and counts lines, so the benchmark measures
+// decoding and formatting without the cost of the console.
+int      BenchPrintf(const char *format, ...);
+void     ResetBenchPrintf(void);
+uint64_t BenchPrintfLineCount(void);
+
+void BenchDisassemblePart1(const uint8_t *bytes, size_t count);
+void BenchDisassemblePart2(const uint8_t *bytes, size_t count);
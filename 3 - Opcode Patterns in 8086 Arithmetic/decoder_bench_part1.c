@@ -0,0 +1,18 @@
+#include "decoder_bench.h"
+
+#include "../1 - Instruction Decoding on the 8086/common.h"
+#include "../1 - Instruction Decoding on the 8086/disassembler.h"
+
+#define printf BenchPrintf
+#include "../1 - Instruction Decoding on the 8086/disassembler.c"
+
+void BenchDisassemblePart1(const uint8_t *bytes, size_t count)
+{
+	String source =
+	{
+		.count = count,
+		.bytes = bytes,
+	};
+
+	Disassemble(source);
+}
@@ -0,0 +1,23 @@
+#include "decoder_bench.h"
+
+#include "../2 - Decoding Multiple Instructions and Suffixes/common.h"
+#include "../2 - Decoding Multiple Instructions and Suffixes/disassembler.h"
+
+#if !defined(_MSC_VER)
+#undef  thread_local
+#define thread_local __thread
+#endif
+
+#define printf BenchPrintf
+#include "../2 - Decoding Multiple Instructions and Suffixes/disassembler.c"
+
+void BenchDisassemblePart2(const uint8_t *bytes, size_t count)
+{
+	String source =
+	{
+		.count = count,
+		.bytes = bytes,
+	};
+
+	Disassemble(StringLit("bench"), source);
+}
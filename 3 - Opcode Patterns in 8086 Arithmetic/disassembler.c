@@ -195,7 +195,7 @@ function void DisasmWrite(Disassembler *disasm, const char *fmt, ...)
 			{
 				case 'c':
 				{
-					DisasmWriteC(disasm, va_arg(args, char));
+					DisasmWriteC(disasm, (char)va_arg(args, int)); // chars are promoted to int through varargs
 				} break;
 
 				case 's':
@@ -263,6 +263,11 @@ function void DisassembleOperand(Disassembler *disasm, Operand *operand)
 		{
 			EffectiveAddress *ea = &operand->mem;
 
+			if (ea->segment)
+			{
+				DisasmWrite(disasm, "%s:", register_names[ea->segment]);
+			}
+
 			DisasmWriteC(disasm, '[');
 
 			if (ea->reg1)
@@ -274,7 +279,8 @@ function void DisassembleOperand(Disassembler *disasm, Operand *operand)
 				}
 			}
 
-			if (ea->disp)
+			// A direct address of 0 still needs its 0
+			if (ea->disp || !ea->reg1)
 			{
 				if (ea->reg1)
 				{
@@ -367,8 +373,16 @@ function void DisassembleInstruction(Disassembler *disasm, Instruction *inst)
 
 		case PUSH:
 		case POP:
+		case INC:
+		case DEC:
+		case CALL:
+		case JMP:
 		{
-			if (inst->op1.kind == Operand_Mem)
+			if (inst->flags & InstructionFlag_Far)
+			{
+				DisasmWrite(disasm, "far ");
+			}
+			else if (inst->op1.kind == Operand_Mem)
 			{
 				DisasmWrite(disasm, "word ");
 			}
@@ -448,3 +462,29 @@ function String DisassemblerResult(Disassembler *disasm)
 	};
 	return result;
 }
+
+function String DisassembleAt(String input, u32 offset, Buffer output)
+{
+	Decoder *decoder = &(Decoder){ 0 };
+	InitializeDecoder(decoder, input);
+	decoder->at = decoder->base + offset;
+
+	String result = StringLit("(doesn't decode)\n");
+
+	Instruction inst;
+	if (DecodeNextInstruction(decoder, &inst))
+	{
+		Disassembler *disasm = &(Disassembler){ 0 };
+		DisassemblerParams disasm_params =
+		{
+			.input  = input,
+			.output = output,
+		};
+		InitializeDisassembler(disasm, &disasm_params);
+		DisassembleInstruction(disasm, &inst);
+
+		result = DisassemblerResult(disasm);
+	}
+
+	return result;
+}
@@ -32,3 +32,8 @@ function void InitializeDisassembler(Disassembler *disasm, DisassemblerParams *p
 function void DisassembleInstruction(Disassembler *disasm, Instruction *inst);
 function void DisassemblerResetOutput(Disassembler *disasm, Buffer output);
 function String DisassemblerResult(Disassembler *disasm);
+
+// Decodes the one instruction at offset into input and disassembles it into
+// output. Returns the text, newline included, or a note that it doesn't
+// decode.
+function String DisassembleAt(String input, u32 offset, Buffer output);
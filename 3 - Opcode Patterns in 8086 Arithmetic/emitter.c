@@ -0,0 +1,352 @@
+function Emitter MakeEmitter(u8 *buffer, u32 capacity)
+{
+	Emitter result =
+	{
+		.base     = buffer,
+		.capacity = capacity,
+	};
+	return result;
+}
+
+function String EmittedCode(Emitter *e)
+{
+	String result =
+	{
+		.count = e->at,
+		.bytes = e->base,
+	};
+	return result;
+}
+
+function void EmitU8(Emitter *e, u8 value)
+{
+	if (e->at < e->capacity)
+	{
+		e->base[e->at++] = value;
+	}
+	else
+	{
+		e->error = true;
+	}
+}
+
+function void EmitU16(Emitter *e, u16 value)
+{
+	EmitU8(e, (u8)value);
+	EmitU8(e, (u8)(value >> 8));
+}
+
+function u8 RegisterCode(Register reg)
+{
+	return (u8)(reg >= AX ? reg - AX : reg - AL);
+}
+
+function u8 RegisterW(Register reg)
+{
+	return reg >= AX ? 1 : 0;
+}
+
+function bool FitsInS8(s32 value)
+{
+	return value >= -128 && value <= 127;
+}
+
+// Position of op in the immed group, which is also what goes in the reg field
+// of 80-83 and bits 3-5 of the two operand forms
+function u8 ImmedIndex(Emitter *e, Mnemonic op)
+{
+	for (u8 index = 0; index < ArrayCount(immed_table); index++)
+	{
+		if (immed_table[index] == op)
+		{
+			return index;
+		}
+	}
+
+	e->error = true;
+	return 0;
+}
+
+function void EmitModRMRegister(Emitter *e, u8 reg_field, Register reg)
+{
+	EmitU8(e, (u8)(0xC0 | (reg_field << 3) | RegisterCode(reg)));
+}
+
+// Goes in front of the opcode of an instruction with a memory operand
+function void EmitSegmentPrefix(Emitter *e, EffectiveAddress ea)
+{
+	if (ea.segment)
+	{
+		if (ea.segment < ES)
+		{
+			e->error = true;
+		}
+
+		EmitU8(e, (u8)(0x26 | ((ea.segment - ES) << 3)));
+	}
+}
+
+function void EmitModRMMemory(Emitter *e, u8 reg_field, EffectiveAddress ea)
+{
+	if (!ea.reg1)
+	{
+		// Direct address
+		EmitU8(e, (u8)(0x06 | (reg_field << 3)));
+		EmitU16(e, (u16)ea.disp);
+		return;
+	}
+
+	u8 r_m = 0;
+	bool found = false;
+	for (u8 index = 0; index < ArrayCount(eac_register_table); index++)
+	{
+		if (eac_register_table[index].reg1 == ea.reg1 &&
+			eac_register_table[index].reg2 == ea.reg2)
+		{
+			r_m   = index;
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+	{
+		e->error = true;
+	}
+
+	// [bp] has no mod 00 encoding, that's where the direct address went
+	u8 mod = 2;
+	if (ea.disp == 0 && r_m != 6)
+	{
+		mod = 0;
+	}
+	else if (FitsInS8(ea.disp))
+	{
+		mod = 1;
+	}
+
+	EmitU8(e, (u8)((mod << 6) | (reg_field << 3) | r_m));
+
+	if (mod == 1)
+	{
+		EmitU8(e, (u8)ea.disp);
+	}
+	else if (mod == 2)
+	{
+		EmitU16(e, (u16)ea.disp);
+	}
+}
+
+function u8 TwoOperandOpcode(Emitter *e, Mnemonic op)
+{
+	return op == MOV ? 0x88 : (u8)(ImmedIndex(e, op) << 3);
+}
+
+function void EmitMovRegImm(Emitter *e, Register reg, u16 imm)
+{
+	u8 w = RegisterW(reg);
+	EmitU8(e, (u8)(0xB0 | (w << 3) | RegisterCode(reg)));
+
+	if (w)
+	{
+		EmitU16(e, imm);
+	}
+	else
+	{
+		EmitU8(e, (u8)imm);
+	}
+}
+
+function void EmitOpRegReg(Emitter *e, Mnemonic op, Register dest, Register source)
+{
+	// d = 0, so the destination goes in r/m
+	EmitU8(e, (u8)(TwoOperandOpcode(e, op) | RegisterW(dest)));
+	EmitModRMRegister(e, RegisterCode(source), dest);
+}
+
+function void EmitOpRegMem(Emitter *e, Mnemonic op, Register dest, EffectiveAddress source)
+{
+	EmitSegmentPrefix(e, source);
+	EmitU8(e, (u8)(TwoOperandOpcode(e, op) | 0x2 | RegisterW(dest)));
+	EmitModRMMemory(e, RegisterCode(dest), source);
+}
+
+function void EmitOpMemReg(Emitter *e, Mnemonic op, EffectiveAddress dest, Register source)
+{
+	EmitSegmentPrefix(e, dest);
+	EmitU8(e, (u8)(TwoOperandOpcode(e, op) | RegisterW(source)));
+	EmitModRMMemory(e, RegisterCode(source), dest);
+}
+
+function void EmitImmediate(Emitter *e, bool sixteen_bits, u16 imm)
+{
+	if (sixteen_bits)
+	{
+		EmitU16(e, imm);
+	}
+	else
+	{
+		EmitU8(e, (u8)imm);
+	}
+}
+
+function void EmitOpRegImm(Emitter *e, Mnemonic op, Register dest, u16 imm)
+{
+	if (op == MOV)
+	{
+		EmitMovRegImm(e, dest, imm);
+		return;
+	}
+
+	u8 w = RegisterW(dest);
+	bool sign_extend = w && FitsInS8((s16)imm);
+
+	EmitU8(e, (u8)(0x80 | (sign_extend << 1) | w));
+	EmitModRMRegister(e, ImmedIndex(e, op), dest);
+	EmitImmediate(e, w && !sign_extend, imm);
+}
+
+function void EmitOpMemImm(Emitter *e, Mnemonic op, EffectiveAddress dest, u16 imm, bool wide)
+{
+	u8 w = wide ? 1 : 0;
+
+	EmitSegmentPrefix(e, dest);
+
+	if (op == MOV)
+	{
+		EmitU8(e, (u8)(0xC6 | w));
+		EmitModRMMemory(e, 0, dest);
+		EmitImmediate(e, wide, imm);
+		return;
+	}
+
+	bool sign_extend = wide && FitsInS8((s16)imm);
+
+	EmitU8(e, (u8)(0x80 | (sign_extend << 1) | w));
+	EmitModRMMemory(e, ImmedIndex(e, op), dest);
+	EmitImmediate(e, wide && !sign_extend, imm);
+}
+
+function void EmitMovSegReg(Emitter *e, Register segment, Register source)
+{
+	if (segment < ES || source < AX || source >= ES)
+	{
+		e->error = true;
+	}
+
+	EmitU8(e, 0x8E);
+	EmitModRMRegister(e, (u8)(segment - ES), source);
+}
+
+function void EmitIncDec(Emitter *e, Mnemonic op, Register reg)
+{
+	if (reg < AX)
+	{
+		e->error = true;
+	}
+
+	EmitU8(e, (u8)((op == INC ? 0x40 : 0x48) | RegisterCode(reg)));
+}
+
+function void EmitPush(Emitter *e, Register reg)
+{
+	EmitU8(e, (u8)(0x50 | RegisterCode(reg)));
+}
+
+function void EmitPop(Emitter *e, Register reg)
+{
+	EmitU8(e, (u8)(0x58 | RegisterCode(reg)));
+}
+
+// e4-e7 take the port as an immediate, ec-ef from DX. The low bit is W.
+function void EmitPortAccess(Emitter *e, u8 opcode, Register accumulator)
+{
+	if (accumulator != AL && accumulator != AX)
+	{
+		e->error = true;
+	}
+
+	EmitU8(e, (u8)(opcode | RegisterW(accumulator)));
+}
+
+function void EmitInImm(Emitter *e, Register accumulator, u8 port)
+{
+	EmitPortAccess(e, 0xE4, accumulator);
+	EmitU8(e, port);
+}
+
+function void EmitInDX(Emitter *e, Register accumulator)
+{
+	EmitPortAccess(e, 0xEC, accumulator);
+}
+
+function void EmitOutImm(Emitter *e, u8 port, Register accumulator)
+{
+	EmitPortAccess(e, 0xE6, accumulator);
+	EmitU8(e, port);
+}
+
+function void EmitOutDX(Emitter *e, Register accumulator)
+{
+	EmitPortAccess(e, 0xEE, accumulator);
+}
+
+function u8 JumpOpcode(Emitter *e, Mnemonic op)
+{
+	u8 result = 0;
+
+	if (op >= JO && op <= JG)
+	{
+		result = (u8)(0x70 + (op - JO));
+	}
+	else if (op >= LOOPNE && op <= JCXZ)
+	{
+		result = (u8)(0xE0 + (op - LOOPNE));
+	}
+	else
+	{
+		e->error = true;
+	}
+
+	return result;
+}
+
+function u32 EmitLabel(Emitter *e)
+{
+	return e->at;
+}
+
+function void EmitJump(Emitter *e, Mnemonic op, u32 label)
+{
+	EmitU8(e, JumpOpcode(e, op));
+
+	s32 displacement = (s32)label - (s32)(e->at + 1);
+	if (!FitsInS8(displacement))
+	{
+		e->error = true;
+	}
+
+	EmitU8(e, (u8)displacement);
+}
+
+function u32 EmitJumpForward(Emitter *e, Mnemonic op)
+{
+	EmitU8(e, JumpOpcode(e, op));
+
+	u32 fixup = e->at;
+	EmitU8(e, 0);
+
+	return fixup;
+}
+
+function void PatchJump(Emitter *e, u32 fixup)
+{
+	s32 displacement = (s32)e->at - (s32)(fixup + 1);
+	if (!FitsInS8(displacement) || fixup >= e->capacity)
+	{
+		e->error = true;
+		return;
+	}
+
+	e->base[fixup] = (u8)displacement;
+}
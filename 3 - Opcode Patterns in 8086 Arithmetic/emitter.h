@@ -0,0 +1,47 @@
+// A tiny 8086 assembler for building test programs in code, covering the
+// handful of forms the simulator's workloads need. Everything is emitted with
+// the same encodings nasm would pick.
+
+typedef struct Emitter
+{
+	u8 *base;
+	u32 at;
+	u32 capacity;
+
+	// Set when the buffer overflows or a jump doesn't fit in 8 bits
+	bool error;
+} Emitter;
+
+function Emitter MakeEmitter(u8 *buffer, u32 capacity);
+function String  EmittedCode(Emitter *e);
+
+function void EmitMovRegImm(Emitter *e, Register reg, u16 imm);
+function void EmitOpRegReg(Emitter *e, Mnemonic op, Register dest, Register source);
+function void EmitOpRegImm(Emitter *e, Mnemonic op, Register dest, u16 imm);
+function void EmitOpRegMem(Emitter *e, Mnemonic op, Register dest, EffectiveAddress source);
+function void EmitOpMemReg(Emitter *e, Mnemonic op, EffectiveAddress dest, Register source);
+function void EmitOpMemImm(Emitter *e, Mnemonic op, EffectiveAddress dest, u16 imm, bool wide);
+function void EmitMovSegReg(Emitter *e, Register segment, Register source);
+function void EmitIncDec(Emitter *e, Mnemonic op, Register reg);
+function void EmitPush(Emitter *e, Register reg);
+function void EmitPop(Emitter *e, Register reg);
+
+// accumulator is AL or AX, the port a fixed byte or whatever is in DX
+function void EmitInImm(Emitter *e, Register accumulator, u8 port);
+function void EmitInDX(Emitter *e, Register accumulator);
+function void EmitOutImm(Emitter *e, u8 port, Register accumulator);
+function void EmitOutDX(Emitter *e, Register accumulator);
+
+// Jumps are all 8-bit relative. Backward jumps take a label (an offset from
+// EmitLabel), forward jumps return a fixup that gets resolved by PatchJump
+// once the target has been emitted.
+function u32  EmitLabel(Emitter *e);
+function void EmitJump(Emitter *e, Mnemonic op, u32 label);
+function u32  EmitJumpForward(Emitter *e, Mnemonic op);
+function void PatchJump(Emitter *e, u32 fixup);
+
+// e.g. Mem(BX, SI, 4) for [bx + si + 4], Mem(Reg_None, Reg_None, 1000) for [1000]
+#define Mem(r1, r2, displacement) (EffectiveAddress){ .reg1 = (r1), .reg2 = (r2), .disp = (s16)(displacement) }
+
+// e.g. SegMem(ES, DI, Reg_None, 0) for es:[di]
+#define SegMem(seg, r1, r2, displacement) (EffectiveAddress){ .reg1 = (r1), .reg2 = (r2), .disp = (s16)(displacement), .segment = (seg) }
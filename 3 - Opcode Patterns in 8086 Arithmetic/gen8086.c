@@ -0,0 +1,255 @@
+#include "common.h"
+#include "random.h"
+#include "instruction.h"
+#include "decoder.h"
+#include "disassembler.h"
+#include "generator.h"
+
+//
+//
+//
+
+#include "decoder.c"
+#include "disassembler.c"
+#include "generator.c"
+
+//
+//
+//
+
+function bool WriteEntireFile(const char *file_name, void *data, size_t size)
+{
+	FILE *f = fopen(file_name, "wb");
+	if (!f)
+	{
+		return false;
+	}
+
+	bool result = (fwrite(data, 1, size, f) == size);
+	fclose(f);
+
+	return result;
+}
+
+global u8 g_output[1 << 16];
+
+function bool WriteCompanionAsm(const char *file_name, String code, u64 seed)
+{
+	FILE *f = fopen(file_name, "wb");
+	if (!f)
+	{
+		return false;
+	}
+
+	fprintf(f, "; generated by gen8086, seed %llu\n", (unsigned long long)seed);
+	fprintf(f, "bits 16\n");
+
+	Buffer output =
+	{
+		.capacity = sizeof(g_output),
+		.bytes    = g_output,
+	};
+
+	Decoder *decoder = &(Decoder){ 0 };
+	InitializeDecoder(decoder, code);
+
+	Disassembler *disasm = &(Disassembler){ 0 };
+	DisassemblerParams disasm_params =
+	{
+		.input  = code,
+		.output = output,
+	};
+	InitializeDisassembler(disasm, &disasm_params);
+
+	Instruction inst;
+	while (DecodeNextInstruction(decoder, &inst))
+	{
+		// Fill up the output buffer before flushing it, one fwrite per line is
+		// needlessly slow for multi-megabyte listings
+		if (DisasmWriteLeft(disasm) < 128)
+		{
+			String result = DisassemblerResult(disasm);
+			fwrite(result.bytes, 1, result.count, f);
+			DisassemblerResetOutput(disasm, output);
+		}
+
+		DisassembleInstruction(disasm, &inst);
+	}
+
+	String result = DisassemblerResult(disasm);
+	fwrite(result.bytes, 1, result.count, f);
+
+	bool ok = !ferror(f) && !decoder->error && !disasm->error;
+	fclose(f);
+
+	return ok;
+}
+
+function void PrintUsage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [options] [output file]\n", program);
+	fprintf(stderr, "  -bytes N                   approximate size of the stream, accepts k/m/g suffixes (default 1m)\n");
+	fprintf(stderr, "  -seed N                    random seed (default 1)\n");
+	fprintf(stderr, "  -mix name[:kind]=weight,.. relative weights per mnemonic, optionally restricted to one\n");
+	fprintf(stderr, "                             decode kind (e.g. mov:RegMemToFromReg=1). Unlisted mnemonics are\n");
+	fprintf(stderr, "                             not generated. Defaults to a mix resembling compiled code.\n");
+	fprintf(stderr, "  -mod w0,w1,w2,w3           relative weights of the ModRM mod values (default 25,20,15,40)\n");
+	fprintf(stderr, "  -asm file                  also write a disassembly of the stream that nasm can assemble\n");
+}
+
+int main(int argument_count, char **arguments)
+{
+	String output_name = { 0 };
+	String asm_name    = { 0 };
+
+	u64 byte_count = Megabytes(1);
+	u64 seed       = 1;
+
+	u32      mix_count = 0;
+	MixEntry mix[64];
+
+	bool mod_weights_given = false;
+	u32  mod_weights[4];
+
+	for (int argument_index = 1; argument_index < argument_count; argument_index++)
+	{
+		String argument = StringFromCString(arguments[argument_index]);
+
+		bool has_value = (argument_index + 1 < argument_count);
+		String value = { 0 };
+		if (has_value)
+		{
+			value = StringFromCString(arguments[argument_index + 1]);
+		}
+
+		bool ok = true;
+
+		if (StringsAreEqual(argument, StringLit("-bytes")) && has_value)
+		{
+			byte_count = ParseU64(value, &ok);
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-seed")) && has_value)
+		{
+			seed = ParseU64(value, &ok);
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-mix")) && has_value)
+		{
+			ok = ParseMix(value, &mix_count, mix, ArrayCount(mix));
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-mod")) && has_value)
+		{
+			ok = ParseModWeights(value, mod_weights);
+			mod_weights_given = true;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-asm")) && has_value)
+		{
+			asm_name = value;
+			argument_index++;
+		}
+		else if (!output_name.count && argument.count && argument.bytes[0] != '-')
+		{
+			output_name = argument;
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "Bad argument '%.*s'\n", StringExpand(argument));
+			PrintUsage(arguments[0]);
+			return 1;
+		}
+	}
+
+	if (!output_name.count)
+	{
+		PrintUsage(arguments[0]);
+		return 1;
+	}
+
+	Generator *gen = &(Generator){ 0 };
+	InitializeGenerator(gen, seed, mix_count, mix, mod_weights_given ? mod_weights : NULL);
+
+	u8 *code = malloc(byte_count);
+	if (!code)
+	{
+		fprintf(stderr, "Failed to allocate %llu bytes\n", (unsigned long long)byte_count);
+		return 1;
+	}
+
+	u64 instruction_count = 0;
+	u64 at = GenerateStream(gen, code, byte_count, &instruction_count);
+
+	if (!instruction_count && byte_count >= 6)
+	{
+		fprintf(stderr, "-mix does not select any instruction the generator can emit\n");
+		return 1;
+	}
+
+	String stream =
+	{
+		.count = at,
+		.bytes = code,
+	};
+
+	// Make sure everything we emitted decodes again
+	Decoder *decoder = &(Decoder){ 0 };
+	InitializeDecoder(decoder, stream);
+
+	u64 decoded_count = 0;
+	Instruction inst;
+	while (DecodeNextInstruction(decoder, &inst))
+	{
+		decoded_count++;
+	}
+
+	if (decoder->error || decoded_count != instruction_count)
+	{
+		fprintf(stderr, "Internal error: the generated stream does not decode (%llu of %llu instructions decoded)\n",
+				(unsigned long long)decoded_count, (unsigned long long)instruction_count);
+		return 1;
+	}
+
+	if (!WriteEntireFile((const char *)output_name.bytes, code, at))
+	{
+		fprintf(stderr, "Failed to write '%.*s'\n", StringExpand(output_name));
+		return 1;
+	}
+
+	if (asm_name.count && !WriteCompanionAsm((const char *)asm_name.bytes, stream, seed))
+	{
+		fprintf(stderr, "Failed to write '%.*s'\n", StringExpand(asm_name));
+		return 1;
+	}
+
+	u32 patterns_covered = 0;
+	u32 patterns_enabled = 0;
+	for (u32 pattern_index = 0; pattern_index < ArrayCount(patterns); pattern_index++)
+	{
+		bool enabled = false;
+		bool covered = false;
+		for (u32 target_index = 0; target_index < gen->target_count; target_index++)
+		{
+			GenTarget *target = &gen->targets[target_index];
+			if (target->pattern == &patterns[pattern_index])
+			{
+				enabled |= (target->weight > 0);
+				covered |= (target->emitted > 0);
+			}
+		}
+		patterns_enabled += enabled;
+		patterns_covered += covered;
+	}
+
+	fprintf(stderr, "Wrote %llu instructions (%llu bytes) to %.*s, seed %llu, %u of %u enabled patterns covered\n",
+			(unsigned long long)instruction_count, (unsigned long long)at, StringExpand(output_name), (unsigned long long)seed,
+			patterns_covered, patterns_enabled);
+
+	return 0;
+}
@@ -0,0 +1,507 @@
+// A rough approximation of the instruction mix of ordinary compiled 16-bit
+// code: lots of movs, pushes and pops, compares followed by conditional
+// jumps, a little bit of everything else. Everything in patterns[] gets a
+// non-zero weight so the default mix covers the whole table.
+global u32 default_mix[Mnemonic_Count] =
+{
+	[MOV]    = 300,
+	[ADD]    = 60,
+	[OR]     = 20,
+	[ADC]    = 5,
+	[SBB]    = 5,
+	[AND]    = 20,
+	[SUB]    = 40,
+	[XOR]    = 30,
+	[CMP]    = 60,
+
+	[INC]    = 25,
+	[DEC]    = 25,
+	[CALL]   = 20,
+	[JMP]    = 15,
+	[PUSH]   = 60,
+	[POP]    = 60,
+
+	[JO]     = 1,
+	[JNO]    = 1,
+	[JB]     = 8,
+	[JAE]    = 8,
+	[JE]     = 30,
+	[JNE]    = 30,
+	[JBE]    = 5,
+	[JA]     = 5,
+	[JS]     = 2,
+	[JNS]    = 2,
+	[JP]     = 1,
+	[JPO]    = 1,
+	[JL]     = 8,
+	[JGE]    = 8,
+	[JLE]    = 5,
+	[JG]     = 5,
+
+	[LOOPNE] = 1,
+	[LOOPE]  = 1,
+	[LOOP]   = 5,
+	[JCXZ]   = 2,
+	[XCHG]   = 8,
+
+	[IN]     = 2,
+	[OUT]    = 2,
+};
+
+function bool PatternSelectsOpInFirstByte(Pattern *pattern)
+{
+	return (pattern->mnemonic == Mnemonic_Immed &&
+			(pattern->decoder == Decode_RegMemToFromReg ||
+			 pattern->decoder == Decode_ImmToAccum));
+}
+
+function void AddTarget(Generator *gen, Pattern *pattern, Mnemonic mnemonic, u8 op)
+{
+	GenTarget *target = &gen->targets[gen->target_count];
+	ZeroStruct(target);
+
+	target->pattern  = pattern;
+	target->mnemonic = mnemonic;
+	target->op       = op;
+
+	for (u32 b = 0; b < 256; b++)
+	{
+		u8 b1 = (u8)b;
+
+		// Later patterns overwrite earlier ones in the decoder table, so only
+		// keep the bytes that actually decode through this pattern.
+		if ((b1 & pattern->b1_mask) != pattern->b1 ||
+			instruction_kinds[b1]   != pattern->mnemonic ||
+			decode_params[b1].kind  != pattern->decoder ||
+			decode_params[b1].flags != pattern->decode_flags)
+		{
+			continue;
+		}
+
+		if (PatternSelectsOpInFirstByte(pattern) && ((b1 >> 3) & 0x7) != op)
+		{
+			continue;
+		}
+
+		// pop cs does not exist
+		if (pattern->decoder == Decode_SegReg && mnemonic == POP && b1 == 0x0F)
+		{
+			continue;
+		}
+
+		target->b1_candidates[target->b1_count++] = b1;
+	}
+
+	if (target->b1_count)
+	{
+		gen->target_count++;
+	}
+}
+
+function void InitializeGeneratorTargets(Generator *gen)
+{
+	for (u32 pattern_index = 0; pattern_index < ArrayCount(patterns); pattern_index++)
+	{
+		Pattern *pattern = &patterns[pattern_index];
+
+		if (pattern->decoder == Decode_SegmentPrefix)
+		{
+			// Not an instruction of its own
+			continue;
+		}
+
+		if (pattern->mnemonic == Mnemonic_Immed)
+		{
+			for (u8 op = 0; op < ArrayCount(immed_table); op++)
+			{
+				AddTarget(gen, pattern, immed_table[op], op);
+			}
+		}
+		else if (pattern->mnemonic == Mnemonic_Grp2)
+		{
+			// Skip the far call/jmp forms (3, 5) which need a memory operand
+			// and an explicit "far" to assemble, and the unused 7
+			u8 ops[] = { 0, 1, 2, 4, 6 };
+			for (u32 i = 0; i < ArrayCount(ops); i++)
+			{
+				AddTarget(gen, pattern, grp2_table[ops[i]], ops[i]);
+			}
+		}
+		else
+		{
+			AddTarget(gen, pattern, pattern->mnemonic, 0);
+		}
+	}
+}
+
+// Mnemonic weights are split evenly between the targets they apply to, so a
+// mnemonic with many encodings doesn't get picked more often than its weight
+// says.
+function void ApplyMix(Generator *gen, u32 mix_count, MixEntry *mix)
+{
+	for (u32 target_index = 0; target_index < gen->target_count; target_index++)
+	{
+		GenTarget *target = &gen->targets[target_index];
+
+		target->mix_entry = mix_count;
+
+		if (mix_count)
+		{
+			target->weight = 0;
+			for (u32 mix_index = 0; mix_index < mix_count; mix_index++)
+			{
+				MixEntry *entry = &mix[mix_index];
+				if (entry->mnemonic == target->mnemonic &&
+					(entry->kind == Decode_INVALID || entry->kind == target->pattern->decoder))
+				{
+					target->weight    = entry->weight;
+					target->mix_entry = mix_index;
+				}
+			}
+		}
+		else
+		{
+			target->weight = default_mix[target->mnemonic];
+		}
+	}
+
+	for (u32 target_index = 0; target_index < gen->target_count; target_index++)
+	{
+		GenTarget *target = &gen->targets[target_index];
+
+		u32 sharing = 0;
+		for (u32 other_index = 0; other_index < gen->target_count; other_index++)
+		{
+			GenTarget *other = &gen->targets[other_index];
+			if (other->mnemonic == target->mnemonic && other->mix_entry == target->mix_entry)
+			{
+				sharing++;
+			}
+		}
+
+		gen->target_weights[target_index] = (u32)(((u64)target->weight*1000) / Max(sharing, 1));
+	}
+}
+
+function u8 *EmitU8(u8 *at, u8 value)
+{
+	*at++ = value;
+	return at;
+}
+
+function u8 *EmitU16(u8 *at, u16 value)
+{
+	*at++ = (u8)(value >> 0);
+	*at++ = (u8)(value >> 8);
+	return at;
+}
+
+// Most immediates and displacements in real code are small
+function u16 RandomImmediate(Generator *gen, u8 w)
+{
+	u16 result = (u16)RandomU32(&gen->series);
+
+	if (RandomChoice(&gen->series, 4) != 0)
+	{
+		result &= 0x7F;
+		if (RandomChoice(&gen->series, 4) == 0)
+		{
+			result = (u16)-(s16)result;
+		}
+	}
+
+	if (!w)
+	{
+		result &= 0xFF;
+	}
+
+	return result;
+}
+
+function u8 *EmitModRM(Generator *gen, u8 *at, u8 reg)
+{
+	u8 mod = (u8)RandomWeighted(&gen->series, 4, gen->mod_weights);
+	u8 r_m = (u8)RandomChoice(&gen->series, 8);
+
+	at = EmitU8(at, (u8)((mod << 6)|((reg & 0x7) << 3)|r_m));
+
+	if (mod == 0x0 && r_m == 0x6)
+	{
+		at = EmitU16(at, (u16)RandomU32(&gen->series));
+	}
+	else if (mod == 0x1)
+	{
+		at = EmitU8(at, (u8)RandomImmediate(gen, 0));
+	}
+	else if (mod == 0x2)
+	{
+		at = EmitU16(at, (u16)RandomU32(&gen->series));
+	}
+
+	return at;
+}
+
+// Returns the number of bytes written to out, which needs room for at least
+// 6 bytes (the longest instruction the decoder knows about).
+function u32 EmitInstruction(Generator *gen, GenTarget *target, u8 *out)
+{
+	u8 *at = out;
+
+	u8 b1 = target->b1_candidates[RandomChoice(&gen->series, target->b1_count)];
+	at = EmitU8(at, b1);
+
+	Pattern *pattern = target->pattern;
+	switch (pattern->decoder)
+	{
+		case Decode_RegMemToFromReg:
+		{
+			at = EmitModRM(gen, at, (u8)RandomChoice(&gen->series, 8));
+		} break;
+
+		case Decode_RegMemToFromSegReg:
+		{
+			// Anything but mov cs, which nasm won't assemble
+			u8 d  = (b1 >> 1) & 0x1;
+			u8 sr = (u8)RandomChoice(&gen->series, d ? 3 : 4);
+			if (d && sr >= 1)
+			{
+				sr += 1;
+			}
+
+			at = EmitModRM(gen, at, sr);
+		} break;
+
+		case Decode_ImmToRegMem:
+		{
+			u8 w = (b1 >> 0) & 0x1;
+			u8 s = 0;
+			if (pattern->decode_flags & S)
+			{
+				s = (b1 >> 1) & 0x1;
+			}
+
+			at = EmitModRM(gen, at, target->op);
+
+			if (s)
+			{
+				at = EmitU8(at, (u8)RandomImmediate(gen, 0));
+			}
+			else if (w)
+			{
+				at = EmitU16(at, RandomImmediate(gen, 1));
+			}
+			else
+			{
+				at = EmitU8(at, (u8)RandomImmediate(gen, 0));
+			}
+		} break;
+
+		case Decode_ImmToReg:
+		{
+			u8 w = (b1 >> 3) & 0x1;
+			if (w)
+			{
+				at = EmitU16(at, RandomImmediate(gen, 1));
+			}
+			else
+			{
+				at = EmitU8(at, (u8)RandomImmediate(gen, 0));
+			}
+		} break;
+
+		case Decode_ImmToAccum:
+		{
+			u8 w = (b1 >> 0) & 0x1;
+			if (w)
+			{
+				at = EmitU16(at, RandomImmediate(gen, 1));
+			}
+			else
+			{
+				at = EmitU8(at, (u8)RandomImmediate(gen, 0));
+			}
+		} break;
+
+		case Decode_MemToAccum:
+		case Decode_AccumToMem:
+		{
+			at = EmitU16(at, (u16)RandomU32(&gen->series));
+		} break;
+
+		case Decode_JumpIpInc8:
+		{
+			at = EmitU8(at, (u8)RandomImmediate(gen, 0));
+		} break;
+
+		case Decode_RegMem:
+		{
+			at = EmitModRM(gen, at, target->op);
+		} break;
+
+		case Decode_IOFixedPort:
+		{
+			at = EmitU8(at, (u8)RandomU32(&gen->series));
+		} break;
+
+		case Decode_Single:
+		case Decode_Reg:
+		case Decode_RegAccum:
+		case Decode_SegReg:
+		case Decode_IOVariablePort:
+		{
+			/* everything is in the first byte */
+		} break;
+
+		default:
+		{
+			/* not a decoder the generator knows about, emit nothing */
+			at = out;
+		} break;
+	}
+
+	return (u32)(at - out);
+}
+
+function void InitializeGenerator(Generator *gen, u64 seed, u32 mix_count, MixEntry *mix, u32 *mod_weights)
+{
+	ZeroStruct(gen);
+
+	if (mod_weights)
+	{
+		memcpy(gen->mod_weights, mod_weights, sizeof(gen->mod_weights));
+	}
+	else
+	{
+		gen->mod_weights[0] = 25;
+		gen->mod_weights[1] = 20;
+		gen->mod_weights[2] = 15;
+		gen->mod_weights[3] = 40;
+	}
+
+	InitializeDecoderTable();
+	InitializeGeneratorTargets(gen);
+	ApplyMix(gen, mix_count, mix);
+
+	gen->series = SeedRandom(seed);
+}
+
+function u64 GenerateStream(Generator *gen, u8 *dest, u64 capacity, u64 *instruction_count)
+{
+	u64 at    = 0;
+	u64 count = 0;
+
+	// Stop once the longest possible instruction might not fit, so the stream
+	// always ends on an instruction boundary.
+	while (at + 6 <= capacity)
+	{
+		u32 target_index = RandomWeighted(&gen->series, gen->target_count, gen->target_weights);
+		if (target_index == gen->target_count)
+		{
+			// Nothing has a non-zero weight
+			break;
+		}
+
+		GenTarget *target = &gen->targets[target_index];
+
+		u32 length = EmitInstruction(gen, target, dest + at);
+		if (length)
+		{
+			at += length;
+			target->emitted++;
+			count++;
+		}
+	}
+
+	if (instruction_count)
+	{
+		*instruction_count = count;
+	}
+
+	return at;
+}
+
+function bool ParseMix(String string, u32 *mix_count, MixEntry *mix, u32 mix_capacity)
+{
+	String entry_string;
+	while (SplitString(&string, ',', &entry_string))
+	{
+		if (*mix_count >= mix_capacity)
+		{
+			fprintf(stderr, "Too many -mix entries\n");
+			return false;
+		}
+
+		String name;
+		SplitString(&entry_string, '=', &name);
+
+		String mnemonic_name;
+		SplitString(&name, ':', &mnemonic_name);
+
+		MixEntry *entry = &mix[*mix_count];
+		ZeroStruct(entry);
+
+		for (u32 mnemonic = 0; mnemonic < Mnemonic_Count; mnemonic++)
+		{
+			if (StringsAreEqualNoCase(mnemonic_name, mnemonic_names[mnemonic]))
+			{
+				entry->mnemonic = (Mnemonic)mnemonic;
+			}
+		}
+
+		if (!entry->mnemonic)
+		{
+			fprintf(stderr, "Unknown mnemonic '%.*s' in -mix\n", StringExpand(mnemonic_name));
+			return false;
+		}
+
+		if (name.count)
+		{
+			for (u32 kind = 0; kind < Decode_Count; kind++)
+			{
+				if (StringsAreEqualNoCase(name, decode_kind_names[kind]))
+				{
+					entry->kind = (DecodeKind)kind;
+				}
+			}
+
+			if (!entry->kind)
+			{
+				fprintf(stderr, "Unknown decode kind '%.*s' in -mix\n", StringExpand(name));
+				return false;
+			}
+		}
+
+		bool ok;
+		entry->weight = (u32)ParseU64(entry_string, &ok);
+		if (!ok)
+		{
+			fprintf(stderr, "Expected a weight for '%.*s' in -mix\n", StringExpand(mnemonic_name));
+			return false;
+		}
+
+		*mix_count += 1;
+	}
+
+	return true;
+}
+
+function bool ParseModWeights(String string, u32 *mod_weights)
+{
+	for (u32 mod = 0; mod < 4; mod++)
+	{
+		String weight_string;
+		if (!SplitString(&string, ',', &weight_string))
+		{
+			return false;
+		}
+
+		bool ok;
+		mod_weights[mod] = (u32)ParseU64(weight_string, &ok);
+		if (!ok)
+		{
+			return false;
+		}
+	}
+
+	return !string.count && (mod_weights[0] + mod_weights[1] + mod_weights[2] + mod_weights[3]) > 0;
+}
@@ -0,0 +1,50 @@
+// Generates large, valid 8086 instruction streams out of the same patterns[]
+// table the decoder uses, so throughput benchmarks have something bigger than
+// the course listings to chew on.
+
+// One thing the generator can emit: a pattern, plus the mnemonic it should
+// decode to for the patterns that select their mnemonic with an opcode
+// extension (immed_table, grp2_table).
+typedef struct GenTarget
+{
+	Pattern *pattern;
+	Mnemonic mnemonic;
+	u8       op;
+
+	u32 weight;
+	u32 mix_entry; // which -mix entry the weight came from
+	u64 emitted;
+
+	// Every first byte that decodes through this pattern to this mnemonic
+	u32 b1_count;
+	u8  b1_candidates[256];
+} GenTarget;
+
+typedef struct MixEntry
+{
+	Mnemonic   mnemonic;
+	DecodeKind kind; // Decode_INVALID matches any kind
+	u32        weight;
+} MixEntry;
+
+typedef struct Generator
+{
+	RandomSeries series;
+
+	u32 mod_weights[4]; // relative weights of ModRM mod 00, 01, 10, 11
+
+	u32       target_count;
+	GenTarget targets[256];
+	u32       target_weights[256];
+} Generator;
+
+function void InitializeGenerator(Generator *gen, u64 seed, u32 mix_count, MixEntry *mix, u32 *mod_weights);
+
+// Fills dest with up to capacity bytes of instructions, always ending on an
+// instruction boundary. Returns the number of bytes written, and the number of
+// instructions through instruction_count if it is not null.
+function u64 GenerateStream(Generator *gen, u8 *dest, u64 capacity, u64 *instruction_count);
+
+// name[:kind]=weight,... and w0,w1,w2,w3 as taken by gen8086 on the command line
+function bool ParseMix(String string, u32 *mix_count, MixEntry *mix, u32 mix_capacity);
+function bool ParseModWeights(String string, u32 *mod_weights);
@@ -0,0 +1,173 @@
+#define HOTSPOT_TOP_BLOCK_COUNT 16
+
+typedef struct HotBlock
+{
+	u16 start;
+	u16 end;
+	u32 instruction_count;
+	u64 executions;
+	u64 cycles;
+} HotBlock;
+
+function bool AllocateHotSpots(HotSpots *spots)
+{
+	ZeroStruct(spots);
+	spots->counters = AllocatePages(HOTSPOT_COUNTER_COUNT*sizeof(HotSpotCounter));
+	return spots->counters != NULL;
+}
+
+function void FreeHotSpots(HotSpots *spots)
+{
+	if (spots->counters)
+	{
+		FreePages(spots->counters, HOTSPOT_COUNTER_COUNT*sizeof(HotSpotCounter));
+	}
+	ZeroStruct(spots);
+}
+
+function double HotSpotPercent(u64 part, u64 total)
+{
+	return total ? 100.0*(double)part / (double)total : 0.0;
+}
+
+// Keeps the most expensive blocks, most expensive first
+function void InsertHotBlock(HotBlock *top, u32 *top_count, HotBlock *block)
+{
+	if (!block->instruction_count)
+	{
+		return;
+	}
+
+	u32 at = *top_count;
+	if (at < HOTSPOT_TOP_BLOCK_COUNT)
+	{
+		*top_count += 1;
+	}
+	else if (top[at - 1].cycles >= block->cycles)
+	{
+		return;
+	}
+	else
+	{
+		at -= 1;
+	}
+
+	while (at > 0 && top[at - 1].cycles < block->cycles)
+	{
+		top[at] = top[at - 1];
+		at--;
+	}
+	top[at] = *block;
+}
+
+function void PrintHotSpots(FILE *out, HotSpots *spots, Simulator *sim)
+{
+	u64 total_executions = 0;
+	u64 total_cycles     = 0;
+	for (u32 ip = 0; ip < HOTSPOT_COUNTER_COUNT; ip++)
+	{
+		total_executions += spots->counters[ip].executions;
+		total_cycles     += spots->counters[ip].cycles;
+	}
+
+	u8 output_bytes[256];
+	Buffer output =
+	{
+		.capacity = sizeof(output_bytes),
+		.bytes    = output_bytes,
+	};
+
+	Decoder *decoder = &(Decoder){ 0 };
+	String address_space =
+	{
+		.count = Kilobytes(64),
+		.bytes = sim->memory,
+	};
+	InitializeDecoder(decoder, address_space);
+
+	Disassembler *disasm = &(Disassembler){ 0 };
+	DisassemblerParams disasm_params =
+	{
+		.input  = address_space,
+		.output = output,
+	};
+	InitializeDisassembler(disasm, &disasm_params);
+
+	fprintf(out, "\nHot spots: %llu instructions, %llu estimated clocks\n",
+			(unsigned long long)total_executions, (unsigned long long)total_cycles);
+	fprintf(out, "\n  %12s %7s %14s %7s\n", "executed", "%", "clocks", "%");
+
+	HotBlock top[HOTSPOT_TOP_BLOCK_COUNT];
+	u32      top_count = 0;
+
+	// Blocks are pieced back together from the counts: one ends at a jump,
+	// at a gap in the code that ran, or where the execution count changes,
+	// which is where something jumped into the middle of it
+	HotBlock block   = { 0 };
+	u32      next_ip = 0;
+	bool     ended   = true;
+
+	for (u32 ip = 0; ip < HOTSPOT_COUNTER_COUNT; ip++)
+	{
+		HotSpotCounter *counter = &spots->counters[ip];
+		if (!counter->executions)
+		{
+			continue;
+		}
+
+		decoder->at    = decoder->base + ip;
+		decoder->error = false;
+
+		Instruction inst;
+		if (!DecodeNextInstruction(decoder, &inst))
+		{
+			// Overwritten by something that doesn't decode
+			fprintf(out, "  %12llu %6.2f%% %14llu %6.2f%%   %04x  ; %.*s\n",
+					(unsigned long long)counter->executions, HotSpotPercent(counter->executions, total_executions),
+					(unsigned long long)counter->cycles, HotSpotPercent(counter->cycles, total_cycles),
+					ip, StringExpand(decoder->error_message));
+			ended = true;
+			continue;
+		}
+
+		if (ip != next_ip && ip)
+		{
+			fprintf(out, "\n");
+		}
+
+		if (ended || ip != next_ip || counter->executions != block.executions)
+		{
+			InsertHotBlock(top, &top_count, &block);
+
+			block = (HotBlock){ .start = (u16)ip, .executions = counter->executions };
+		}
+
+		block.end                = (u16)ip;
+		block.instruction_count += 1;
+		block.cycles            += counter->cycles;
+
+		next_ip = ip + inst.source_byte_count;
+		ended   = EndsBlock(inst.mnemonic);
+
+		DisassemblerResetOutput(disasm, output);
+		DisassembleInstruction(disasm, &inst);
+
+		String text = DisassemblerResult(disasm);
+		fprintf(out, "  %12llu %6.2f%% %14llu %6.2f%%   %04x  %.*s",
+				(unsigned long long)counter->executions, HotSpotPercent(counter->executions, total_executions),
+				(unsigned long long)counter->cycles, HotSpotPercent(counter->cycles, total_cycles),
+				ip, StringExpand(text));
+	}
+
+	InsertHotBlock(top, &top_count, &block);
+
+	fprintf(out, "\nMost expensive blocks:\n");
+	fprintf(out, "\n  %-11s %6s %12s %14s %7s\n", "block", "insts", "executed", "clocks", "%");
+	for (u32 index = 0; index < top_count; index++)
+	{
+		HotBlock *hot = &top[index];
+		fprintf(out, "  %04x..%04x  %6u %12llu %14llu %6.2f%%\n",
+				hot->start, hot->end, hot->instruction_count, (unsigned long long)hot->executions,
+				(unsigned long long)hot->cycles, HotSpotPercent(hot->cycles, total_cycles));
+	}
+}
@@ -0,0 +1,34 @@
+// Guest hot spots: how many times each instruction in the simulated program
+// ran, and how many estimated clocks it spent, so the loops worth looking at
+// stand out. The counters are a flat array indexed by the linear address of
+// the instruction, which is its IP since code runs with CS at 0, so counting
+// a step is one increment and one add to the same 16 bytes.
+
+#define HOTSPOT_COUNTER_COUNT Kilobytes(64)
+
+typedef struct HotSpotCounter
+{
+	u64 executions;
+	u64 cycles;
+} HotSpotCounter;
+
+typedef struct HotSpots
+{
+	HotSpotCounter *counters;
+} HotSpots;
+
+function bool AllocateHotSpots(HotSpots *spots);
+function void FreeHotSpots(HotSpots *spots);
+
+// Call for every instruction executed, with its address and clocks
+force_inline void CountHotSpot(HotSpots *spots, u16 ip, u32 cycles)
+{
+	HotSpotCounter *counter = &spots->counters[ip];
+	counter->executions += 1;
+	counter->cycles     += cycles;
+}
+
+// The disassembly of everything that ran, annotated with its counts, and
+// then the basic blocks that cost the most. Instructions are decoded from
+// memory as it is now, so code the program wrote over shows its final form.
+function void PrintHotSpots(FILE *out, HotSpots *spots, Simulator *sim);
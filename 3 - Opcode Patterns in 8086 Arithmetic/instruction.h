@@ -87,6 +87,10 @@ enum Flags
 
 	InstructionFlag_DataLO = 1 << 5,
 	InstructionFlag_DataHI = 1 << 6,
+
+	// call or jmp through a segment:offset pointer in memory (FF /3, FF /5),
+	// which loads CS as well as IP
+	InstructionFlag_Far = 1 << 7,
 };
 
 typedef u8 Register;
@@ -131,6 +135,9 @@ typedef struct EffectiveAddress
 	Register reg1;
 	Register reg2;
 	s16 disp;
+
+	// Set by a segment override prefix, Reg_None for the default segment
+	Register segment;
 } EffectiveAddress;
 
 typedef struct RegisterPair
@@ -150,6 +157,18 @@ global RegisterPair eac_register_table[] =
 	{ BX },
 };
 
+// The segment an effective address goes through: the override if there is
+// one, otherwise SS for anything based on BP and DS for everything else
+function Register SegmentOfAddress(EffectiveAddress *ea)
+{
+	Register result = ea->segment;
+	if (!result)
+	{
+		result = (ea->reg1 == BP) ? SS : DS;
+	}
+	return result;
+}
+
 typedef u8 OperandKind;
 enum OperandKind
 {
@@ -169,6 +188,43 @@ typedef struct Operand
 	};
 } Operand;
 
+// Operand shapes, as in mov reg, mem or add mem, imm. Built from the class of
+// the first operand and the class of the second, where immediate data counts
+// as the second operand if there isn't one.
+typedef u8 OperandClass;
+enum OperandClass
+{
+	OperandClass_None,
+	OperandClass_Reg,
+	OperandClass_Mem,
+	OperandClass_Imm,
+
+	OperandClass_Count,
+};
+
+typedef u8 OperandShape;
+enum OperandShape
+{
+	OperandShape_Count = OperandClass_Count*OperandClass_Count,
+};
+
+#define MakeOperandShape(first, second) (OperandShape)((first)*OperandClass_Count + (second))
+
+global String operand_class_names[OperandClass_Count] =
+{
+	[OperandClass_None] = StringLitConst("-"),
+	[OperandClass_Reg]  = StringLitConst("reg"),
+	[OperandClass_Mem]  = StringLitConst("mem"),
+	[OperandClass_Imm]  = StringLitConst("imm"),
+};
+
+// Opcode, mod r/m, displacement and immediate come to at most 6 bytes. The
+// 8086 takes any number of prefixes in front, but the decoder stops at
+// enough to make INSTRUCTION_MAX_BYTES, so anything holding on to decoded
+// instructions knows how far back one can start and still cover an address.
+#define INSTRUCTION_MAX_BYTES    15
+#define INSTRUCTION_MAX_PREFIXES (INSTRUCTION_MAX_BYTES - 6)
+
 typedef struct Instruction
 {
 	Mnemonic mnemonic;
@@ -212,3 +268,44 @@ function void InstSetDataX(Instruction *inst, u8 w, s16 data)
 		InstSetData8(inst, (u8)data);
 	}
 }
+
+function OperandClass ClassOfOperand(Operand *operand)
+{
+	OperandClass result = OperandClass_None;
+
+	switch (operand->kind)
+	{
+		case Operand_Reg:
+		case Operand_SegReg:
+		{
+			result = OperandClass_Reg;
+		} break;
+
+		case Operand_Mem:
+		{
+			result = OperandClass_Mem;
+		} break;
+	}
+
+	return result;
+}
+
+function OperandShape ShapeOfInstruction(Instruction *inst)
+{
+	OperandClass first  = ClassOfOperand(&inst->op1);
+	OperandClass second = ClassOfOperand(&inst->op2);
+
+	if (inst->flags & InstructionFlag_DataLO)
+	{
+		if (first == OperandClass_None)
+		{
+			first = OperandClass_Imm;
+		}
+		else if (second == OperandClass_None)
+		{
+			second = OperandClass_Imm;
+		}
+	}
+
+	return MakeOperandShape(first, second);
+}
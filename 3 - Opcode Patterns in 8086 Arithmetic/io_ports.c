@@ -0,0 +1,270 @@
+function u16 OpenBusRead(void *context, u16 port, bool wide)
+{
+	(void)context;
+	(void)port;
+	return wide ? 0xFFFF : 0xFF;
+}
+
+function void OpenBusWrite(void *context, u16 port, bool wide, u16 value)
+{
+	(void)context;
+	(void)port;
+	(void)wide;
+	(void)value;
+}
+
+function bool EnablePorts(Simulator *sim)
+{
+	if (!sim->io_ports)
+	{
+		sim->io_ports = AllocatePages(IO_PORT_COUNT*sizeof(IOPort));
+		if (sim->io_ports)
+		{
+			for (u32 port = 0; port < IO_PORT_COUNT; port++)
+			{
+				DetachPort(sim, (u16)port);
+			}
+		}
+	}
+
+	return sim->io_ports != NULL;
+}
+
+function void DisablePorts(Simulator *sim)
+{
+	FreePages(sim->io_ports, IO_PORT_COUNT*sizeof(IOPort));
+	sim->io_ports = NULL;
+}
+
+function bool AttachPort(Simulator *sim, u16 port, IOPortRead *read, IOPortWrite *write, void *context)
+{
+	if (!EnablePorts(sim))
+	{
+		return false;
+	}
+
+	IOPort *entry = &sim->io_ports[port];
+	entry->read    = read  ? read  : OpenBusRead;
+	entry->write   = write ? write : OpenBusWrite;
+	entry->context = context;
+
+	return true;
+}
+
+function void DetachPort(Simulator *sim, u16 port)
+{
+	if (sim->io_ports)
+	{
+		IOPort *entry = &sim->io_ports[port];
+		entry->read    = OpenBusRead;
+		entry->write   = OpenBusWrite;
+		entry->context = NULL;
+	}
+}
+
+//
+// Output
+//
+
+function bool FlushPortOutput(PortOutput *output)
+{
+	if (output->used)
+	{
+		if (output->file && fwrite(output->bytes, 1, output->used, output->file) != output->used)
+		{
+			output->failed = true;
+		}
+		output->used = 0;
+	}
+
+	if (output->file && fflush(output->file) != 0)
+	{
+		output->failed = true;
+	}
+
+	return !output->failed;
+}
+
+force_inline void PutPortOutput(PortOutput *output, u16 value, bool wide)
+{
+	if (output->used + 2 > sizeof(output->bytes))
+	{
+		FlushPortOutput(output);
+	}
+
+	output->bytes[output->used++] = (u8)value;
+	if (wide)
+	{
+		output->bytes[output->used++] = (u8)(value >> 8);
+	}
+}
+
+//
+// Console
+//
+
+function u16 ConsoleRead(void *context, u16 port, bool wide)
+{
+	(void)port;
+	ConsoleDevice *console = context;
+
+	// Whatever was written so far should be on screen before waiting on input
+	FlushPortOutput(&console->out);
+
+	u16 result = wide ? 0xFFFF : 0xFF;
+	if (console->in)
+	{
+		int lo = fgetc(console->in);
+		if (lo != EOF)
+		{
+			result = (u16)((result & 0xFF00) | lo);
+		}
+
+		if (wide)
+		{
+			int hi = (lo != EOF) ? fgetc(console->in) : EOF;
+			if (hi != EOF)
+			{
+				result = (u16)((result & 0x00FF) | (hi << 8));
+			}
+		}
+	}
+
+	return result;
+}
+
+function void ConsoleWrite(void *context, u16 port, bool wide, u16 value)
+{
+	(void)port;
+	ConsoleDevice *console = context;
+	PutPortOutput(&console->out, value, wide);
+}
+
+function bool AttachConsole(Simulator *sim, ConsoleDevice *console, u16 port, FILE *in, FILE *out)
+{
+	ZeroStruct(console);
+	console->in       = in;
+	console->out.file = out;
+
+	return AttachPort(sim, port, ConsoleRead, ConsoleWrite, console);
+}
+
+//
+// Timer
+//
+
+function u32 TimerTicks(TimerDevice *timer)
+{
+	u64 elapsed = ReadOSTimer() - timer->start;
+
+	// Whole seconds and the rest separately, so the multiply can't overflow
+	u64 seconds = elapsed / timer->os_timer_freq;
+	u64 rest    = elapsed % timer->os_timer_freq;
+
+	return (u32)(seconds*TIMER_TICKS_PER_SECOND + rest*TIMER_TICKS_PER_SECOND / timer->os_timer_freq);
+}
+
+function u16 TimerRead(void *context, u16 port, bool wide)
+{
+	TimerDevice *timer = context;
+
+	u16 result = timer->latched_high;
+	if (port == TIMER_PORT)
+	{
+		u32 ticks = TimerTicks(timer);
+		timer->latched_high = (u16)(ticks >> 16);
+		result              = (u16)ticks;
+	}
+
+	return wide ? result : (u16)(result & 0xFF);
+}
+
+function void TimerWrite(void *context, u16 port, bool wide, u16 value)
+{
+	TimerDevice *timer = context;
+
+	if (port == TIMER_PORT)
+	{
+		u64 ticks = wide ? value : (value & 0xFF);
+		timer->start = ReadOSTimer() - ticks*timer->os_timer_freq / TIMER_TICKS_PER_SECOND;
+	}
+}
+
+function bool AttachTimer(Simulator *sim, TimerDevice *timer, u16 port)
+{
+	ZeroStruct(timer);
+	timer->os_timer_freq = GetOSTimerFreq();
+	timer->start         = ReadOSTimer();
+
+	return AttachPort(sim, port,            TimerRead, TimerWrite, timer) &&
+		   AttachPort(sim, (u16)(port + 1), TimerRead, TimerWrite, timer);
+}
+
+//
+// File device
+//
+
+function u16 FileDeviceReadData(void *context, u16 port, bool wide)
+{
+	(void)port;
+	FileDevice *device = context;
+
+	u16 result = 0xFFFF;
+	u32 count  = wide ? 2 : 1;
+
+	for (u32 index = 0; index < count; index++)
+	{
+		if (device->input_at < device->input.count)
+		{
+			u32 shift = 8*index;
+			result = (u16)((result & ~(0xFF << shift)) | (device->input.bytes[device->input_at++] << shift));
+		}
+	}
+
+	return wide ? result : (u16)(result & 0xFF);
+}
+
+function void FileDeviceWriteData(void *context, u16 port, bool wide, u16 value)
+{
+	(void)port;
+	FileDevice *device = context;
+	PutPortOutput(&device->output, value, wide);
+}
+
+function u16 FileDeviceReadStatus(void *context, u16 port, bool wide)
+{
+	(void)port;
+	(void)wide;
+	FileDevice *device = context;
+
+	FileStatus result = 0;
+	if (device->input_at < device->input.count)
+	{
+		result |= FileStatus_InputLeft;
+	}
+	if (!device->output.failed)
+	{
+		result |= FileStatus_OutputOK;
+	}
+
+	return result;
+}
+
+function void FileDeviceWriteStatus(void *context, u16 port, bool wide, u16 value)
+{
+	(void)port;
+	(void)wide;
+	(void)value;
+	FileDevice *device = context;
+	device->input_at = 0;
+}
+
+function bool AttachFileDevice(Simulator *sim, FileDevice *device, u16 port, String input, FILE *output)
+{
+	ZeroStruct(device);
+	device->input       = input;
+	device->output.file = output;
+
+	return AttachPort(sim, port,            FileDeviceReadData,   FileDeviceWriteData,   device) &&
+		   AttachPort(sim, (u16)(port + 1), FileDeviceReadStatus, FileDeviceWriteStatus, device);
+}
@@ -0,0 +1,102 @@
+// Port I/O behind IN and OUT. Every one of the 64k ports has an entry in a
+// flat table holding a read callback, a write callback and a context pointer
+// for the device behind it, so an access is an index into the table and one
+// indirect call. Ports nothing is attached to get callbacks that read all
+// ones and ignore writes, the way an empty bus would, so there's no check for
+// a missing device on the way either.
+//
+// A word access is a single call with wide set, to the device at the port it
+// names, rather than a byte to each of port and port + 1.
+//
+// Without a table (Simulator.io_ports left NULL) every port is empty.
+
+#define IO_PORT_COUNT Kilobytes(64)
+
+typedef u16  IOPortRead(void *context, u16 port, bool wide);
+typedef void IOPortWrite(void *context, u16 port, bool wide, u16 value);
+
+typedef struct IOPort
+{
+	IOPortRead  *read;
+	IOPortWrite *write;
+	void        *context;
+} IOPort;
+
+function bool EnablePorts(Simulator *sim);
+function void DisablePorts(Simulator *sim);
+
+// Either callback can be NULL for a port that's only read or only written.
+// Returns false if there's no table and one couldn't be allocated.
+function bool AttachPort(Simulator *sim, u16 port, IOPortRead *read, IOPortWrite *write, void *context);
+function void DetachPort(Simulator *sim, u16 port);
+
+//
+// Devices
+//
+
+// Bytes on their way out to a file, written a buffer at a time rather than
+// a call into stdio per OUT. Dropped if there's no file.
+typedef struct PortOutput
+{
+	FILE *file;
+	u32   used;
+	bool  failed;
+	u8    bytes[4096];
+} PortOutput;
+
+// Returns false if anything written so far failed to make it to the file
+function bool FlushPortOutput(PortOutput *output);
+
+// A console at one port. OUT writes the low byte to out, or both bytes for a
+// word, and IN reads the next byte from in, all ones once there's no more.
+#define CONSOLE_PORT 0xE9 // the debug console port of Bochs and QEMU
+
+typedef struct ConsoleDevice
+{
+	FILE      *in;
+	PortOutput out;
+} ConsoleDevice;
+
+function bool AttachConsole(Simulator *sim, ConsoleDevice *console, u16 port, FILE *in, FILE *out);
+
+// A free running count of ticks at the rate of the PC's timer, taken from
+// the host clock, 32 bits over two ports. Reading the low word at port
+// latches the high word for port + 1, so the halves read together belong
+// together. Writing port starts the count over from the value written.
+#define TIMER_PORT             0x40
+#define TIMER_TICKS_PER_SECOND 1193182
+
+typedef struct TimerDevice
+{
+	u64 os_timer_freq;
+	u64 start;
+	u16 latched_high;
+} TimerDevice;
+
+function bool AttachTimer(Simulator *sim, TimerDevice *timer, u16 port);
+function u32  TimerTicks(TimerDevice *timer);
+
+// A data port reading bytes out of input and writing them to output, with a
+// status port at port + 1. IN from the data port gives the next byte of input
+// (two for a word), all ones past the end. IN from the status port gives
+// FileStatus bits. OUT to the status port goes back to the start of input.
+#define FILE_DEVICE_PORT 0x300
+
+typedef u16 FileStatus;
+enum FileStatus
+{
+	FileStatus_InputLeft = 1 << 0,
+	FileStatus_OutputOK  = 1 << 1,
+};
+
+typedef struct FileDevice
+{
+	String     input;
+	u64        input_at;
+	PortOutput output;
+} FileDevice;
+
+// Either of input and output can be left empty, and without an output file
+// whatever is written is thrown away. The input has to stay around for as
+// long as the device is attached.
+function bool AttachFileDevice(Simulator *sim, FileDevice *device, u16 port, String input, FILE *output);
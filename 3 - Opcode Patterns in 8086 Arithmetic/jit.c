@@ -0,0 +1,812 @@
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// Generous upper bound on the code for one block, checked before compiling
+#define JIT_MAX_BLOCK_BYTES Kilobytes(16)
+
+#define SIM_OFFSET(field) ((u32)offsetof(Simulator, field))
+
+function bool EnableJit(Simulator *sim)
+{
+	BlockCache *cache = sim->blocks;
+	if (!JIT_SUPPORTED || !cache)
+	{
+		return false;
+	}
+
+	if (cache->jit)
+	{
+		return true;
+	}
+
+	Jit *jit = calloc(1, sizeof(Jit));
+	if (!jit)
+	{
+		return false;
+	}
+
+	jit->code = AllocatePages(JIT_CODE_SIZE);
+	if (!jit->code || !SetPagesExecutable(jit->code, JIT_CODE_SIZE, true))
+	{
+		FreePages(jit->code, JIT_CODE_SIZE);
+		free(jit);
+		return false;
+	}
+
+	// Anything translated so far was compiled without the JIT in mind
+	FlushBlockCache(cache);
+	cache->jit = jit;
+
+	return true;
+}
+
+function void DisableJit(Simulator *sim)
+{
+	BlockCache *cache = sim->blocks;
+	if (cache && cache->jit)
+	{
+		FreePages(cache->jit->code, JIT_CODE_SIZE);
+		free(cache->jit);
+		cache->jit = NULL;
+
+		// Blocks still point into the code that was just freed
+		FlushBlockCache(cache);
+	}
+}
+
+function void ResetJit(Jit *jit)
+{
+	jit->code_used = 0;
+}
+
+#if JIT_SUPPORTED
+
+//
+// Host register use:
+//
+//   r11  Simulator *
+//   r10  Simulator.memory
+//   r9   Instructions executed by the iterations before the current one
+//   r8   Iterations left
+//   rax  Guest address
+//   rcx  Scratch, and what jrcxz tests
+//   rdx  Operand values
+//
+// All of them are volatile in both the Windows and the System V calling
+// convention, so the native code never has to save anything.
+//
+
+typedef struct NativeCode
+{
+	u8 *base;
+	u64 at;
+	u64 capacity;
+	bool error;
+} NativeCode;
+
+function void Native8(NativeCode *nc, u8 value)
+{
+	if (nc->at < nc->capacity)
+	{
+		nc->base[nc->at++] = value;
+	}
+	else
+	{
+		nc->error = true;
+	}
+}
+
+function void Native16(NativeCode *nc, u16 value)
+{
+	Native8(nc, (u8)value);
+	Native8(nc, (u8)(value >> 8));
+}
+
+function void Native32(NativeCode *nc, u32 value)
+{
+	Native16(nc, (u16)value);
+	Native16(nc, (u16)(value >> 16));
+}
+
+// Where the native code hands back to the simulator
+typedef struct NativeExit
+{
+	// Offset of the rel32 that jumps to the exit
+	u64 fixup;
+
+	u16  ip;
+	u32  ops_done; // In the current iteration
+	bool side_exit;
+	bool write_flags;
+} NativeExit;
+
+typedef struct NativeCompile
+{
+	NativeCode code;
+
+	Block   *block;
+	MicroOp *ops;
+
+	// Whether the block looks at the flags it starts with, and the first op
+	// that changes the flags (op_count if none does)
+	bool reads_flags;
+	u32  first_flags_write;
+
+	// Jumps back to its own start, so any exit can come after a whole
+	// iteration
+	bool loops;
+
+	u32        exit_count;
+	NativeExit exits[4*BLOCK_MAX_OPS + 4];
+} NativeCompile;
+
+function bool ReadsFlags(Mnemonic mnemonic)
+{
+	return mnemonic == ADC || mnemonic == SBB ||
+		   mnemonic == INC || mnemonic == DEC ||
+		   (mnemonic >= JO && mnemonic <= JG) ||
+		   mnemonic == LOOPE || mnemonic == LOOPNE;
+}
+
+function bool WritesFlags(Mnemonic mnemonic)
+{
+	return mnemonic != MOV && !EndsBlock(mnemonic);
+}
+
+// Position in the immed group, which is also what x86-64 uses
+function u8 AluIndex(Mnemonic mnemonic)
+{
+	u8 result = 0;
+	for (u8 index = 0; index < ArrayCount(immed_table); index++)
+	{
+		if (immed_table[index] == mnemonic)
+		{
+			result = index;
+		}
+	}
+	return result;
+}
+
+function bool NativeSupports(MicroOp *op)
+{
+	bool result = false;
+
+	switch (op->mnemonic)
+	{
+		case MOV:
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		case CMP:
+		{
+			result = (op->dest == OperandClass_Reg || op->dest == OperandClass_Mem) &&
+					 op->source != OperandClass_None;
+		} break;
+
+		case INC:
+		case DEC:
+		{
+			result = (op->dest == OperandClass_Reg || op->dest == OperandClass_Mem);
+		} break;
+
+		case JO:
+		case JNO:
+		case JB:
+		case JAE:
+		case JE:
+		case JNE:
+		case JBE:
+		case JA:
+		case JS:
+		case JNS:
+		case JP:
+		case JPO:
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		case LOOPNE:
+		case LOOPE:
+		case LOOP:
+		case JCXZ:
+		{
+			result = true;
+		} break;
+	}
+
+	return result;
+}
+
+//
+// Exits
+//
+
+function NativeExit MakeExit(NativeCompile *c, u16 ip, u32 ops_done, bool side_exit)
+{
+	NativeExit result =
+	{
+		.ip          = ip,
+		.ops_done    = ops_done,
+		.side_exit   = side_exit,
+		.write_flags = c->reads_flags || c->first_flags_write < ops_done ||
+					   (c->loops && c->first_flags_write < c->block->op_count),
+	};
+	return result;
+}
+
+function void AddExit(NativeCompile *c, NativeExit exit)
+{
+	exit.fixup = c->code.at;
+	Native32(&c->code, 0);
+
+	if (c->exit_count < ArrayCount(c->exits))
+	{
+		c->exits[c->exit_count++] = exit;
+	}
+	else
+	{
+		c->code.error = true;
+	}
+}
+
+function void ExitAlways(NativeCompile *c, NativeExit exit)
+{
+	Native8(&c->code, 0xE9);
+	AddExit(c, exit);
+}
+
+// cc is the x86 condition code, which the 8086 jumps are in the order of
+function void ExitOnCondition(NativeCompile *c, u8 cc, NativeExit exit)
+{
+	Native8(&c->code, 0x0F);
+	Native8(&c->code, (u8)(0x80 | cc));
+	AddExit(c, exit);
+}
+
+// jrcxz only has a rel8 form, so it hops over a short jmp to a jmp rel32
+function void ExitIfRcxZero(NativeCompile *c, NativeExit exit)
+{
+	Native8(&c->code, 0xE3); Native8(&c->code, 0x02);
+	Native8(&c->code, 0xEB); Native8(&c->code, 0x05);
+	ExitAlways(c, exit);
+}
+
+function void ExitIfRcxNonZero(NativeCompile *c, NativeExit exit)
+{
+	Native8(&c->code, 0xE3); Native8(&c->code, 0x05);
+	ExitAlways(c, exit);
+}
+
+function void EmitExits(NativeCompile *c)
+{
+	NativeCode *nc = &c->code;
+
+	for (u32 index = 0; index < c->exit_count; index++)
+	{
+		NativeExit *exit = &c->exits[index];
+
+		u32 rel = (u32)(nc->at - (exit->fixup + 4));
+		if (exit->fixup + 4 <= nc->capacity)
+		{
+			memcpy(nc->base + exit->fixup, &rel, sizeof(rel));
+		}
+
+		// mov word [r11 + ip], imm16
+		Native8(nc, 0x66); Native8(nc, 0x41); Native8(nc, 0xC7); Native8(nc, 0x83);
+		Native32(nc, SIM_OFFSET(ip));
+		Native16(nc, exit->ip);
+
+		// lea rax, [r9*2 + 2*ops_done + side_exit]
+		Native8(nc, 0x4A); Native8(nc, 0x8D); Native8(nc, 0x04); Native8(nc, 0x4D);
+		Native32(nc, 2*exit->ops_done + (exit->side_exit ? 1 : 0));
+
+		if (exit->write_flags)
+		{
+			// pushfq, pop rcx, and ecx, CPUFLAGS_ARITHMETIC
+			Native8(nc, 0x9C);
+			Native8(nc, 0x59);
+			Native8(nc, 0x81); Native8(nc, 0xE1); Native32(nc, CPUFLAGS_ARITHMETIC);
+
+			// movzx edx, word [r11 + flags], and edx, ~CPUFLAGS_ARITHMETIC, or edx, ecx
+			Native8(nc, 0x41); Native8(nc, 0x0F); Native8(nc, 0xB7); Native8(nc, 0x93);
+			Native32(nc, SIM_OFFSET(flags));
+			Native8(nc, 0x81); Native8(nc, 0xE2); Native32(nc, 0xFFFF & ~CPUFLAGS_ARITHMETIC);
+			Native8(nc, 0x09); Native8(nc, 0xCA);
+
+			// mov [r11 + flags], dx
+			Native8(nc, 0x66); Native8(nc, 0x41); Native8(nc, 0x89); Native8(nc, 0x93);
+			Native32(nc, SIM_OFFSET(flags));
+
+			// mov byte [r11 + lazy_flags.kind], LazyFlags_None
+			Native8(nc, 0x41); Native8(nc, 0xC6); Native8(nc, 0x83);
+			Native32(nc, SIM_OFFSET(lazy_flags) + (u32)offsetof(LazyFlags, kind));
+			Native8(nc, LazyFlags_None);
+		}
+
+		// ret
+		Native8(nc, 0xC3);
+	}
+}
+
+//
+// Guest instructions
+//
+
+// Emits opcode with a memory operand that's either a register in the
+// simulator ([r11 + regs + reg]) or guest memory at rax ([r10 + rax])
+function void NativeOperandOp(NativeCode *nc, u8 opcode, bool wide, u8 reg_field, OperandClass operand, u8 reg)
+{
+	if (wide)
+	{
+		Native8(nc, 0x66);
+	}
+
+	Native8(nc, 0x41);
+	Native8(nc, (u8)(opcode | (wide ? 1 : 0)));
+
+	if (operand == OperandClass_Mem)
+	{
+		Native8(nc, (u8)((reg_field << 3) | 0x04));
+		Native8(nc, 0x02);
+	}
+	else
+	{
+		Native8(nc, (u8)(0x80 | (reg_field << 3) | 0x03));
+		Native32(nc, SIM_OFFSET(regs) + reg);
+	}
+}
+
+function void NativeImmediate(NativeCode *nc, bool wide, u16 imm)
+{
+	if (wide)
+	{
+		Native16(nc, imm);
+	}
+	else
+	{
+		Native8(nc, (u8)imm);
+	}
+}
+
+// movzx <reg>, word [r11 + regs + slot*2]
+function void NativeLoadSlot(NativeCode *nc, u8 reg_field, u8 slot)
+{
+	Native8(nc, 0x41); Native8(nc, 0x0F); Native8(nc, 0xB7);
+	Native8(nc, (u8)(0x80 | (reg_field << 3) | 0x03));
+	Native32(nc, SIM_OFFSET(regs) + 2*slot);
+}
+
+function u16 OpIP(NativeCompile *c, u32 op_index)
+{
+	return op_index ? c->ops[op_index - 1].next_ip : c->block->start_ip;
+}
+
+// Leaves the linear address in rax
+function void NativeGuestAddress(NativeCompile *c, MicroOp *op, u32 op_index)
+{
+	NativeCode *nc = &c->code;
+
+	u8 base  = op->ea_base;
+	u8 index = op->ea_index;
+	if (base == Slot_Zero)
+	{
+		base  = index;
+		index = Slot_Zero;
+	}
+
+	if (base == Slot_Zero)
+	{
+		// mov eax, imm32
+		Native8(nc, 0xB8);
+		Native32(nc, (u16)op->ea_disp);
+	}
+	else
+	{
+		NativeLoadSlot(nc, 0, base);
+
+		if (index != Slot_Zero)
+		{
+			// lea eax, [rax + rcx + disp32]
+			NativeLoadSlot(nc, 1, index);
+			Native8(nc, 0x8D); Native8(nc, 0x84); Native8(nc, 0x08);
+		}
+		else
+		{
+			// lea eax, [rax + disp32]
+			Native8(nc, 0x8D); Native8(nc, 0x80);
+		}
+		Native32(nc, (u32)(s32)op->ea_disp);
+
+		// movzx eax, ax
+		Native8(nc, 0x0F); Native8(nc, 0xB7); Native8(nc, 0xC0);
+	}
+
+	if (op->wide)
+	{
+		// A word at 0xFFFF wraps around to 0, leave that to the interpreter.
+		// lea ecx, [rax - 0xFFFF]
+		Native8(nc, 0x8D); Native8(nc, 0x88); Native32(nc, (u32)-0xFFFF);
+		ExitIfRcxZero(c, MakeExit(c, OpIP(c, op_index), op_index, true));
+	}
+
+	// Native code only runs while no segment reaches into the last 64k, so
+	// adding the base can't go past the end of memory.
+	// mov ecx, [r11 + segment_bases + slot*4], lea eax, [rax + rcx]
+	Native8(nc, 0x41); Native8(nc, 0x8B); Native8(nc, 0x8B);
+	Native32(nc, SIM_OFFSET(segment_bases) + 4*op->ea_segment);
+	Native8(nc, 0x8D); Native8(nc, 0x04); Native8(nc, 0x08);
+}
+
+// Sets Simulator.dirty_pages for the byte at rax + byte_offset. The flags
+// from the previous instruction may still be needed, so the page number,
+// the address shifted right by 8, is put together a byte at a time:
+// bswap moves bits 16..19 to bits 8..11 and bits 8..15 come from ch.
+function void NativeMarkDirty(NativeCode *nc, u8 byte_offset)
+{
+	// lea ecx, [rax + byte_offset], movzx edx, ch
+	Native8(nc, 0x8D); Native8(nc, 0x48); Native8(nc, byte_offset);
+	Native8(nc, 0x0F); Native8(nc, 0xB6); Native8(nc, 0xD5);
+
+	// bswap ecx, movzx ecx, cx, lea ecx, [rcx + rdx]
+	Native8(nc, 0x0F); Native8(nc, 0xC9);
+	Native8(nc, 0x0F); Native8(nc, 0xB7); Native8(nc, 0xC9);
+	Native8(nc, 0x8D); Native8(nc, 0x0C); Native8(nc, 0x11);
+
+	// mov byte [r11 + rcx + dirty_pages], 1
+	Native8(nc, 0x41); Native8(nc, 0xC6); Native8(nc, 0x84); Native8(nc, 0x0B);
+	Native32(nc, SIM_OFFSET(dirty_pages));
+	Native8(nc, 1);
+}
+
+// Leaves the instruction to the interpreter when the byte NativeMarkDirty
+// just marked the page of was decoded into a cache (Simulator.code_bytes), so
+// the write goes through InvalidateCode. Expects the page number still in
+// rcx. The bit test only happens on pages with code, and keeps the flags
+// from the previous instruction in al and ah around itself, since they may
+// still be needed. popfq would do too, but it's several times slower.
+function void NativeCheckCodeByte(NativeCompile *c, u32 op_index, u8 byte_offset)
+{
+	NativeCode *nc = &c->code;
+
+	// movzx ecx, byte [r11 + rcx + code_pages], jrcxz past the bit test
+	Native8(nc, 0x41); Native8(nc, 0x0F); Native8(nc, 0xB6); Native8(nc, 0x8C); Native8(nc, 0x0B);
+	Native32(nc, SIM_OFFSET(code_pages));
+	Native8(nc, 0xE3); Native8(nc, 0x00);
+	u64 skip_from = nc->at;
+
+	// lea ecx, [rax + byte_offset], push rax, lahf, seto al
+	Native8(nc, 0x8D); Native8(nc, 0x48); Native8(nc, byte_offset);
+	Native8(nc, 0x50);
+	Native8(nc, 0x9F);
+	Native8(nc, 0x0F); Native8(nc, 0x90); Native8(nc, 0xC0);
+
+	// mov edx, ecx, shr edx, 3, and ecx, 7
+	Native8(nc, 0x89); Native8(nc, 0xCA);
+	Native8(nc, 0xC1); Native8(nc, 0xEA); Native8(nc, 0x03);
+	Native8(nc, 0x83); Native8(nc, 0xE1); Native8(nc, 0x07);
+
+	// movzx edx, byte [r11 + rdx + code_bytes]
+	Native8(nc, 0x41); Native8(nc, 0x0F); Native8(nc, 0xB6); Native8(nc, 0x94); Native8(nc, 0x13);
+	Native32(nc, SIM_OFFSET(code_bytes));
+
+	// bt edx, ecx, setc cl, movzx ecx, cl
+	Native8(nc, 0x0F); Native8(nc, 0xA3); Native8(nc, 0xCA);
+	Native8(nc, 0x0F); Native8(nc, 0x92); Native8(nc, 0xC1);
+	Native8(nc, 0x0F); Native8(nc, 0xB6); Native8(nc, 0xC9);
+
+	// add al, 0x7F overflows exactly when al is 1, then sahf puts the rest
+	// back, pop rax
+	Native8(nc, 0x04); Native8(nc, 0x7F);
+	Native8(nc, 0x9E);
+	Native8(nc, 0x58);
+
+	ExitIfRcxNonZero(c, MakeExit(c, OpIP(c, op_index), op_index, true));
+
+	if (!nc->error)
+	{
+		nc->base[skip_from - 1] = (u8)(nc->at - skip_from);
+	}
+}
+
+function void NativeInstruction(NativeCompile *c, MicroOp *op, u32 op_index)
+{
+	NativeCode *nc = &c->code;
+
+	if (op->dest == OperandClass_Mem || op->source == OperandClass_Mem)
+	{
+		NativeGuestAddress(c, op, op_index);
+	}
+
+	if (op->dest == OperandClass_Mem && op->mnemonic != CMP)
+	{
+		// The address is below 1MB (see NativeGuestAddress), so the page
+		// number fits the 20 bits this expects
+		NativeMarkDirty(nc, 0);
+		NativeCheckCodeByte(c, op_index, 0);
+		if (op->wide)
+		{
+			NativeMarkDirty(nc, 1);
+			NativeCheckCodeByte(c, op_index, 1);
+		}
+	}
+
+	switch (op->mnemonic)
+	{
+		case MOV:
+		{
+			if (op->source == OperandClass_Imm)
+			{
+				NativeOperandOp(nc, 0xC6, op->wide, 0, op->dest, op->dest_reg);
+				NativeImmediate(nc, op->wide, op->imm);
+			}
+			else
+			{
+				// Through dx
+				NativeOperandOp(nc, 0x8A, op->wide, 2, op->source, op->source_reg);
+				NativeOperandOp(nc, 0x88, op->wide, 2, op->dest, op->dest_reg);
+			}
+		} break;
+
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		case CMP:
+		{
+			u8 alu = AluIndex(op->mnemonic);
+
+			if (op->source == OperandClass_Imm)
+			{
+				NativeOperandOp(nc, 0x80, op->wide, alu, op->dest, op->dest_reg);
+				NativeImmediate(nc, op->wide, op->imm);
+			}
+			else
+			{
+				NativeOperandOp(nc, 0x8A, op->wide, 2, op->source, op->source_reg);
+				NativeOperandOp(nc, (u8)(alu << 3), op->wide, 2, op->dest, op->dest_reg);
+			}
+		} break;
+
+		case INC:
+		case DEC:
+		{
+			NativeOperandOp(nc, 0xFE, op->wide, (u8)(op->mnemonic == INC ? 0 : 1), op->dest, op->dest_reg);
+		} break;
+	}
+}
+
+// The jump or loop that ends the block. Falls through into the taken path
+// and exits when it isn't taken.
+function void NativeBranch(NativeCompile *c, MicroOp *op, u32 op_count)
+{
+	NativeCode *nc = &c->code;
+
+	NativeExit not_taken = MakeExit(c, op->next_ip, op_count, false);
+
+	switch (op->mnemonic)
+	{
+		case LOOPNE:
+		case LOOPE:
+		case LOOP:
+		case JCXZ:
+		{
+			NativeLoadSlot(nc, 1, Slot_CX);
+
+			if (op->mnemonic == JCXZ)
+			{
+				ExitIfRcxNonZero(c, not_taken);
+				break;
+			}
+
+			// lea ecx, [rcx - 1], mov [r11 + cx], cx, movzx ecx, cx
+			Native8(nc, 0x8D); Native8(nc, 0x49); Native8(nc, 0xFF);
+			Native8(nc, 0x66); Native8(nc, 0x41); Native8(nc, 0x89); Native8(nc, 0x8B);
+			Native32(nc, SIM_OFFSET(regs) + 2*Slot_CX);
+			Native8(nc, 0x0F); Native8(nc, 0xB7); Native8(nc, 0xC9);
+
+			ExitIfRcxZero(c, not_taken);
+
+			if (op->mnemonic == LOOPE)
+			{
+				ExitOnCondition(c, (u8)(JNE - JO), not_taken);
+			}
+			else if (op->mnemonic == LOOPNE)
+			{
+				ExitOnCondition(c, (u8)(JE - JO), not_taken);
+			}
+		} break;
+
+		default:
+		{
+			// The inverse condition is the one with the low bit flipped
+			ExitOnCondition(c, (u8)((op->mnemonic - JO) ^ 1), not_taken);
+		} break;
+	}
+}
+
+function void NativeLoopBack(NativeCompile *c, u64 body_start, u32 op_count)
+{
+	NativeCode *nc = &c->code;
+
+	// lea r9, [r9 + op_count]
+	Native8(nc, 0x4D); Native8(nc, 0x8D); Native8(nc, 0x89); Native32(nc, op_count);
+
+	// lea r8, [r8 - 1], mov rcx, r8
+	Native8(nc, 0x4D); Native8(nc, 0x8D); Native8(nc, 0x80); Native32(nc, (u32)-1);
+	Native8(nc, 0x4C); Native8(nc, 0x89); Native8(nc, 0xC1);
+
+	// Out of iterations. The one that just finished is already in r9.
+	ExitIfRcxZero(c, MakeExit(c, c->block->start_ip, 0, false));
+
+	// jmp body_start
+	Native8(nc, 0xE9);
+	Native32(nc, (u32)(body_start - (nc->at + 4)));
+}
+
+function void CompileBlock(Jit *jit, BlockCache *cache, Block *block)
+{
+	MicroOp *ops = &cache->ops[block->first_op];
+
+	bool supported = true;
+	for (u32 index = 0; index < block->op_count; index++)
+	{
+		supported &= NativeSupports(&ops[index]);
+	}
+
+	u64 start = AlignPow2(jit->code_used, 16);
+	if (!supported || start + JIT_MAX_BLOCK_BYTES > JIT_CODE_SIZE)
+	{
+		jit->blocks_rejected += 1;
+		return;
+	}
+
+	NativeCompile *c = &(NativeCompile){ 0 };
+	c->block = block;
+	c->ops   = ops;
+
+	MicroOp *last = &ops[block->op_count - 1];
+	c->loops = EndsBlock(last->mnemonic) && last->jump_ip == block->start_ip;
+
+	c->first_flags_write = block->op_count;
+	for (u32 index = 0; index < block->op_count; index++)
+	{
+		Mnemonic mnemonic = ops[index].mnemonic;
+		if (c->first_flags_write == block->op_count)
+		{
+			c->reads_flags |= ReadsFlags(mnemonic);
+		}
+
+		if (WritesFlags(mnemonic) && c->first_flags_write == block->op_count)
+		{
+			c->first_flags_write = index;
+		}
+	}
+
+	// Only the pages this block goes in need to be writable
+	u64 page_start = start & ~(u64)4095;
+	u64 page_end   = AlignPow2(start + JIT_MAX_BLOCK_BYTES, 4096);
+	if (!SetPagesExecutable(jit->code + page_start, page_end - page_start, false))
+	{
+		jit->blocks_rejected += 1;
+		return;
+	}
+
+	NativeCode *nc = &c->code;
+	nc->base     = jit->code + start;
+	nc->capacity = JIT_MAX_BLOCK_BYTES;
+
+	//
+	// Prologue
+	//
+
+#if defined(_WIN32)
+	// mov r11, rcx, mov r8, rdx
+	Native8(nc, 0x49); Native8(nc, 0x89); Native8(nc, 0xCB);
+	Native8(nc, 0x49); Native8(nc, 0x89); Native8(nc, 0xD0);
+#else
+	// mov r11, rdi, mov r8, rsi
+	Native8(nc, 0x49); Native8(nc, 0x89); Native8(nc, 0xFB);
+	Native8(nc, 0x49); Native8(nc, 0x89); Native8(nc, 0xF0);
+#endif
+
+	// mov r10, [r11 + memory], xor r9d, r9d
+	Native8(nc, 0x4D); Native8(nc, 0x8B); Native8(nc, 0x93); Native32(nc, SIM_OFFSET(memory));
+	Native8(nc, 0x45); Native8(nc, 0x31); Native8(nc, 0xC9);
+
+	if (c->reads_flags)
+	{
+		// Load the arithmetic flags into the host's. The caller has made sure
+		// Simulator.flags is up to date.
+		//   movzx ecx, word [r11 + flags], and ecx, CPUFLAGS_ARITHMETIC
+		//   pushfq, pop rax, and eax, ~CPUFLAGS_ARITHMETIC, or eax, ecx
+		//   push rax, popfq
+		Native8(nc, 0x41); Native8(nc, 0x0F); Native8(nc, 0xB7); Native8(nc, 0x8B);
+		Native32(nc, SIM_OFFSET(flags));
+		Native8(nc, 0x81); Native8(nc, 0xE1); Native32(nc, CPUFLAGS_ARITHMETIC);
+		Native8(nc, 0x9C);
+		Native8(nc, 0x58);
+		Native8(nc, 0x25); Native32(nc, ~(u32)CPUFLAGS_ARITHMETIC);
+		Native8(nc, 0x09); Native8(nc, 0xC8);
+		Native8(nc, 0x50);
+		Native8(nc, 0x9D);
+	}
+
+	//
+	// Body
+	//
+
+	u64 body_start = nc->at;
+
+	u32 op_count = block->op_count;
+	for (u32 index = 0; index < op_count; index++)
+	{
+		MicroOp *op = &ops[index];
+		if (!EndsBlock(op->mnemonic))
+		{
+			NativeInstruction(c, op, index);
+		}
+	}
+
+	if (EndsBlock(last->mnemonic))
+	{
+		NativeBranch(c, last, op_count);
+
+		if (c->loops)
+		{
+			NativeLoopBack(c, body_start, op_count);
+		}
+		else
+		{
+			ExitAlways(c, MakeExit(c, last->jump_ip, op_count, false));
+		}
+	}
+	else
+	{
+		ExitAlways(c, MakeExit(c, block->end_ip, op_count, false));
+	}
+
+	EmitExits(c);
+
+	SetPagesExecutable(jit->code + page_start, page_end - page_start, true);
+
+	if (nc->error)
+	{
+		jit->blocks_rejected += 1;
+		return;
+	}
+
+	// C has no cast from a data pointer to a function pointer
+	union
+	{
+		u8              *code;
+		NativeBlockProc *proc;
+	} entry;
+	entry.code = nc->base;
+
+	block->native             = entry.proc;
+	block->native_reads_flags = c->reads_flags;
+
+	jit->code_used        = start + nc->at;
+	jit->blocks_compiled += 1;
+}
+
+#else
+
+function void CompileBlock(Jit *jit, BlockCache *cache, Block *block)
+{
+	(void)jit;
+	(void)cache;
+	(void)block;
+}
+
+#endif
@@ -0,0 +1,50 @@
+// Compiles hot basic blocks from the block cache into x86-64 code.
+//
+// Guest registers stay in Simulator.regs and are operated on in place, with
+// the host instruction of the same width, so the host flags come out exactly
+// as the 8086 would set them. Conditional jumps and adc/sbb use the host
+// flags directly, and the flags are only written back to the simulator when
+// the native code returns. Everything between two guest instructions (address
+// arithmetic, loop counters) is done with mov, lea and jrcxz, none of which
+// touch the flags.
+//
+// A block that jumps back to its own start loops natively, up to the number
+// of iterations it is given. Word accesses that would wrap around the end of
+// their segment leave the native code at that instruction so the interpreter
+// can do it, and so do writes to bytes with cached code in them (see
+// Simulator.code_bytes), which the interpreter then invalidates. Segment
+// bases come from Simulator.segment_bases, and while a segment could wrap
+// around the end of memory (Simulator.segments_wrap) the block runs as
+// micro-ops instead.
+//
+// Blocks with anything other than mov, the immed group, inc, dec, conditional
+// jumps and the loops aren't compiled and keep running as micro-ops.
+//
+// The native code takes the simulator and the most iterations it may run,
+// sets Simulator.ip and returns the number of instructions it executed,
+// shifted up by one. The low bit is set if it stopped at an instruction it
+// couldn't run.
+
+#define JIT_CODE_SIZE     Megabytes(16)
+#define JIT_HOT_THRESHOLD 32
+
+typedef struct Jit
+{
+	// Never writable and executable at the same time
+	u8 *code;
+	u64 code_used;
+
+	u64 blocks_compiled;
+	u64 blocks_rejected;
+} Jit;
+
+// Needs the block cache. Returns false when the JIT isn't supported on the
+// host or the code buffer can't be allocated.
+function bool EnableJit(Simulator *sim);
+function void DisableJit(Simulator *sim);
+
+// Throws away all compiled code, called when the block cache is flushed
+function void ResetJit(Jit *jit);
+
+// Sets block->native if it compiled
+function void CompileBlock(Jit *jit, BlockCache *cache, Block *block);
@@ -0,0 +1,373 @@
+#if defined(__linux__)
+
+typedef struct PerfEventConfig
+{
+	u32 type;
+	u64 config;
+} PerfEventConfig;
+
+global PerfEventConfig perf_event_configs[PerfCounter_Count] =
+{
+	[PerfCounter_Cycles]       = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[PerfCounter_Instructions] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[PerfCounter_BranchMisses] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[PerfCounter_L1DMisses]    = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D|(PERF_COUNT_HW_CACHE_OP_READ << 8)|(PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+function int PerfEventOpen(struct perf_event_attr *attr, int group_fd)
+{
+	// pid 0, cpu -1: this thread, on whichever cpu it runs
+	return (int)syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+function void OpenPerfCounters(PerfCounters *counters)
+{
+	ZeroStruct(counters);
+
+	counters->group_fd = -1;
+	for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+	{
+		counters->fds[counter_index] = -1;
+	}
+
+	for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+	{
+		PerfEventConfig *config = &perf_event_configs[counter_index];
+
+		struct perf_event_attr attr = { 0 };
+		attr.size           = sizeof(attr);
+		attr.type           = config->type;
+		attr.config         = config->config;
+		attr.read_format    = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv     = 1;
+		attr.disabled       = (counters->group_fd == -1);
+
+		int fd = PerfEventOpen(&attr, counters->group_fd);
+		if (fd == -1)
+		{
+			if (counter_index == PerfCounter_Cycles)
+			{
+				if (errno == EACCES || errno == EPERM)
+				{
+					counters->unavailable_reason = StringLit("perf_event_open was denied, check /proc/sys/kernel/perf_event_paranoid");
+				}
+				else if (errno == ENOENT || errno == ENODEV || errno == EOPNOTSUPP)
+				{
+					counters->unavailable_reason = StringLit("this machine exposes no hardware performance counters");
+				}
+				else
+				{
+					counters->unavailable_reason = StringFromCString(strerror(errno));
+				}
+				return;
+			}
+
+			// The other counters are optional, some PMUs (and most VMs) don't
+			// have cache events for instance.
+			continue;
+		}
+
+		if (counters->group_fd == -1)
+		{
+			counters->group_fd = fd;
+		}
+
+		counters->fds[counter_index] = fd;
+		counters->counter_available[counter_index] = true;
+		counters->read_order[counters->read_count++] = counter_index;
+	}
+
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	counters->use_rdpmc = true;
+	for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+	{
+		if (!counters->counter_available[counter_index])
+		{
+			continue;
+		}
+
+		void *page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, counters->fds[counter_index], 0);
+		if (page == MAP_FAILED)
+		{
+			counters->use_rdpmc = false;
+			continue;
+		}
+
+		counters->mmap_pages[counter_index] = page;
+
+		struct perf_event_mmap_page *header = page;
+		if (!header->cap_user_rdpmc)
+		{
+			counters->use_rdpmc = false;
+		}
+	}
+
+	ioctl(counters->group_fd, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+	ioctl(counters->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	counters->available = true;
+}
+
+function void ClosePerfCounters(PerfCounters *counters)
+{
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+	{
+		if (counters->mmap_pages[counter_index])
+		{
+			munmap(counters->mmap_pages[counter_index], page_size);
+		}
+
+		if (counters->fds[counter_index] != -1)
+		{
+			close(counters->fds[counter_index]);
+		}
+	}
+
+	counters->available = false;
+}
+
+function void ReadPerfCountersSlow(PerfCounters *counters, PerfCounterValues *values)
+{
+	u64 buffer[1 + PerfCounter_Count] = { 0 };
+	if (read(counters->group_fd, buffer, sizeof(buffer)) > 0)
+	{
+		u64 count = Min(buffer[0], counters->read_count);
+		for (u64 i = 0; i < count; i++)
+		{
+			values->values[counters->read_order[i]] = buffer[1 + i];
+		}
+	}
+}
+
+// Returns false if the counter isn't currently scheduled on the PMU, in which
+// case rdpmc can't be used and the caller has to go through read().
+function bool ReadPerfCounterRDPMC(struct perf_event_mmap_page *header, u64 *value)
+{
+	u32 seq;
+	u64 count;
+
+	do
+	{
+		seq = header->lock;
+		__asm__ volatile("" ::: "memory");
+
+		u32 index = header->index;
+		if (!index)
+		{
+			return false;
+		}
+
+		count = header->offset;
+
+		u64 width = header->pmc_width;
+		u64 pmc   = __rdpmc((int)(index - 1));
+
+		// The hardware counter is pmc_width bits wide, sign extend it
+		pmc <<= 64 - width;
+		count += (u64)((s64)pmc >> (64 - width));
+
+		__asm__ volatile("" ::: "memory");
+	}
+	while (header->lock != seq);
+
+	*value = count;
+	return true;
+}
+
+function void ReadPerfCounters(PerfCounters *counters, PerfCounterValues *values)
+{
+	ZeroStruct(values);
+
+	if (!counters->available)
+	{
+		return;
+	}
+
+	if (counters->use_rdpmc)
+	{
+		for (u32 i = 0; i < counters->read_count; i++)
+		{
+			u32 counter_index = counters->read_order[i];
+			if (!ReadPerfCounterRDPMC(counters->mmap_pages[counter_index], &values->values[counter_index]))
+			{
+				ReadPerfCountersSlow(counters, values);
+				return;
+			}
+		}
+	}
+	else
+	{
+		ReadPerfCountersSlow(counters, values);
+	}
+}
+
+#else
+
+function void OpenPerfCounters(PerfCounters *counters)
+{
+	ZeroStruct(counters);
+	counters->unavailable_reason = StringLit("hardware counters are only supported on Linux (perf_event_open)");
+}
+
+function void ClosePerfCounters(PerfCounters *counters)
+{
+	counters->available = false;
+}
+
+function void ReadPerfCounters(PerfCounters *counters, PerfCounterValues *values)
+{
+	(void)counters;
+	ZeroStruct(values);
+}
+
+#endif
+
+//
+// Per DecodeKind breakdown
+//
+
+function void InitializePerfBreakdown(PerfBreakdown *breakdown, PerfCounters *counters)
+{
+	ZeroStruct(breakdown);
+
+	if (!counters->available)
+	{
+		return;
+	}
+
+	for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+	{
+		breakdown->read_overhead.values[counter_index] = UINT64_MAX;
+	}
+
+	for (u32 attempt = 0; attempt < 64; attempt++)
+	{
+		PerfCounterValues start, end;
+		ReadPerfCounters(counters, &start);
+		ReadPerfCounters(counters, &end);
+
+		for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+		{
+			u64 delta = end.values[counter_index] - start.values[counter_index];
+			breakdown->read_overhead.values[counter_index] = Min(breakdown->read_overhead.values[counter_index], delta);
+		}
+	}
+}
+
+function void AccumulatePerfSample(PerfBreakdown *breakdown, PerfPhase phase, DecodeKind kind, PerfCounterValues *start, PerfCounterValues *end)
+{
+	PerfCounterValues *total = &breakdown->totals[phase][kind];
+
+	for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+	{
+		u64 delta    = end->values[counter_index] - start->values[counter_index];
+		u64 overhead = breakdown->read_overhead.values[counter_index];
+
+		total->values[counter_index] += delta > overhead ? delta - overhead : 0;
+	}
+}
+
+function void CountPerfInstruction(PerfBreakdown *breakdown, DecodeKind kind)
+{
+	breakdown->instruction_counts[kind] += 1;
+}
+
+function void PrintPerfColumns(FILE *out, PerfCounters *counters, PerfCounterValues *total, u64 instruction_count)
+{
+	double count = (double)Max(instruction_count, 1);
+
+	double cycles       = (double)total->values[PerfCounter_Cycles];
+	double instructions = (double)total->values[PerfCounter_Instructions];
+
+	fprintf(out, " | %8.1f", cycles / count);
+
+	if (counters->counter_available[PerfCounter_Instructions] && cycles > 0.0)
+	{
+		fprintf(out, " %5.2f", instructions / cycles);
+	}
+	else
+	{
+		fprintf(out, " %5s", "-");
+	}
+
+	if (counters->counter_available[PerfCounter_BranchMisses])
+	{
+		fprintf(out, " %8.3f", (double)total->values[PerfCounter_BranchMisses] / count);
+	}
+	else
+	{
+		fprintf(out, " %8s", "-");
+	}
+
+	if (counters->counter_available[PerfCounter_L1DMisses])
+	{
+		fprintf(out, " %8.3f", (double)total->values[PerfCounter_L1DMisses] / count);
+	}
+	else
+	{
+		fprintf(out, " %8s", "-");
+	}
+}
+
+function void PrintPerfBreakdown(FILE *out, PerfCounters *counters, PerfBreakdown *breakdown)
+{
+	if (!counters->available)
+	{
+		fprintf(out, "\nHardware counters unavailable: %.*s\n", StringExpand(counters->unavailable_reason));
+		return;
+	}
+
+	fprintf(out, "\nHardware counters per decoded instruction (read with %s, read overhead subtracted):\n", counters->use_rdpmc ? "rdpmc" : "read()");
+
+	fprintf(out, "%-16s %8s", "", "");
+	for (u32 phase = 0; phase < PerfPhase_Count; phase++)
+	{
+		fprintf(out, " | %-32.*s", StringExpand(perf_phase_names[phase]));
+	}
+	fprintf(out, "\n");
+
+	fprintf(out, "%-16s %8s", "kind", "count");
+	for (u32 phase = 0; phase < PerfPhase_Count; phase++)
+	{
+		fprintf(out, " | %8s %5s %8s %8s", "cycles", "IPC", "br-miss", "L1D-miss");
+	}
+	fprintf(out, "\n");
+
+	u64               total_count = 0;
+	PerfCounterValues totals[PerfPhase_Count] = { 0 };
+
+	for (u32 kind = 0; kind < Decode_Count; kind++)
+	{
+		u64 count = breakdown->instruction_counts[kind];
+		if (!count)
+		{
+			continue;
+		}
+
+		total_count += count;
+
+		fprintf(out, "%-16.*s %8llu", StringExpand(decode_kind_names[kind]), (unsigned long long)count);
+		for (u32 phase = 0; phase < PerfPhase_Count; phase++)
+		{
+			PerfCounterValues *values = &breakdown->totals[phase][kind];
+			PrintPerfColumns(out, counters, values, count);
+
+			for (u32 counter_index = 0; counter_index < PerfCounter_Count; counter_index++)
+			{
+				totals[phase].values[counter_index] += values->values[counter_index];
+			}
+		}
+		fprintf(out, "\n");
+	}
+
+	fprintf(out, "%-16s %8llu", "total", (unsigned long long)total_count);
+	for (u32 phase = 0; phase < PerfPhase_Count; phase++)
+	{
+		PrintPerfColumns(out, counters, &totals[phase], total_count);
+	}
+	fprintf(out, "\n");
+}
@@ -0,0 +1,79 @@
+typedef enum PerfCounter
+{
+	PerfCounter_Cycles,
+	PerfCounter_Instructions,
+	PerfCounter_BranchMisses,
+	PerfCounter_L1DMisses,
+
+	PerfCounter_Count,
+} PerfCounter;
+
+global String perf_counter_names[PerfCounter_Count] =
+{
+	[PerfCounter_Cycles]       = StringLitConst("cycles"),
+	[PerfCounter_Instructions] = StringLitConst("instructions"),
+	[PerfCounter_BranchMisses] = StringLitConst("branch misses"),
+	[PerfCounter_L1DMisses]    = StringLitConst("L1D misses"),
+};
+
+typedef struct PerfCounterValues
+{
+	u64 values[PerfCounter_Count];
+} PerfCounterValues;
+
+typedef struct PerfCounters
+{
+	bool   available;
+	String unavailable_reason;
+
+	bool counter_available[PerfCounter_Count];
+
+	// Counters are opened as a single group led by the cycle counter so they
+	// are always scheduled together. If the kernel lets us, they are read with
+	// rdpmc straight from user space, otherwise with a read() on the group.
+	bool use_rdpmc;
+	int  group_fd;
+	int  fds[PerfCounter_Count];
+	u32  read_order[PerfCounter_Count];
+	u32  read_count;
+	void *mmap_pages[PerfCounter_Count];
+} PerfCounters;
+
+// Never fails hard: if the counters can't be opened (not Linux, no PMU in a
+// VM, perf_event_paranoid too strict) available stays false, the reason is
+// filled in and reads return zeroes.
+function void OpenPerfCounters(PerfCounters *counters);
+function void ClosePerfCounters(PerfCounters *counters);
+function void ReadPerfCounters(PerfCounters *counters, PerfCounterValues *values);
+
+//
+// Per DecodeKind breakdown of the decode and disassembly phases
+//
+
+typedef enum PerfPhase
+{
+	PerfPhase_Decode,
+	PerfPhase_Disassemble,
+
+	PerfPhase_Count,
+} PerfPhase;
+
+global String perf_phase_names[PerfPhase_Count] =
+{
+	[PerfPhase_Decode]      = StringLitConst("decode"),
+	[PerfPhase_Disassemble] = StringLitConst("disassemble"),
+};
+
+typedef struct PerfBreakdown
+{
+	// What a back-to-back pair of reads costs, subtracted from every sample
+	PerfCounterValues read_overhead;
+
+	u64               instruction_counts[Decode_Count];
+	PerfCounterValues totals[PerfPhase_Count][Decode_Count];
+} PerfBreakdown;
+
+function void InitializePerfBreakdown(PerfBreakdown *breakdown, PerfCounters *counters);
+function void AccumulatePerfSample(PerfBreakdown *breakdown, PerfPhase phase, DecodeKind kind, PerfCounterValues *start, PerfCounterValues *end);
+function void CountPerfInstruction(PerfBreakdown *breakdown, DecodeKind kind);
+function void PrintPerfBreakdown(FILE *out, PerfCounters *counters, PerfBreakdown *breakdown);
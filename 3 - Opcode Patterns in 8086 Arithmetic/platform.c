@@ -0,0 +1,535 @@
+//
+// Timers
+//
+
+#if defined(_WIN32)
+
+function u64 GetOSTimerFreq(void)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return freq.QuadPart;
+}
+
+function u64 ReadOSTimer(void)
+{
+	LARGE_INTEGER value;
+	QueryPerformanceCounter(&value);
+	return value.QuadPart;
+}
+
+#else
+
+function u64 GetOSTimerFreq(void)
+{
+	return 1000000000;
+}
+
+function u64 ReadOSTimer(void)
+{
+	struct timespec value;
+	clock_gettime(CLOCK_MONOTONIC, &value);
+	return (u64)value.tv_sec*GetOSTimerFreq() + (u64)value.tv_nsec;
+}
+
+#endif
+
+function u64 ReadCPUTimer(void)
+{
+	return __rdtsc();
+}
+
+function u64 EstimateCPUTimerFreq(void)
+{
+	u64 milliseconds_to_wait = 100;
+	u64 os_freq = GetOSTimerFreq();
+
+	u64 cpu_start = ReadCPUTimer();
+	u64 os_start  = ReadOSTimer();
+	u64 os_end    = 0;
+	u64 os_elapsed = 0;
+	u64 os_wait_time = os_freq*milliseconds_to_wait / 1000;
+
+	while (os_elapsed < os_wait_time)
+	{
+		os_end     = ReadOSTimer();
+		os_elapsed = os_end - os_start;
+	}
+
+	u64 cpu_end     = ReadCPUTimer();
+	u64 cpu_elapsed = cpu_end - cpu_start;
+
+	u64 cpu_freq = 0;
+	if (os_elapsed)
+	{
+		cpu_freq = os_freq*cpu_elapsed / os_elapsed;
+	}
+
+	return cpu_freq;
+}
+
+//
+// CPU features
+//
+
+#if defined(_MSC_VER)
+
+function void Cpuid(u32 leaf, u32 subleaf, u32 *registers)
+{
+	int values[4];
+	__cpuidex(values, (int)leaf, (int)subleaf);
+	memcpy(registers, values, sizeof(values));
+}
+
+function u64 ReadXCR0(void)
+{
+	return _xgetbv(0);
+}
+
+#else
+
+function void Cpuid(u32 leaf, u32 subleaf, u32 *registers)
+{
+	if (!__get_cpuid_count(leaf, subleaf, &registers[0], &registers[1], &registers[2], &registers[3]))
+	{
+		memset(registers, 0, 4*sizeof(u32));
+	}
+}
+
+function u64 ReadXCR0(void)
+{
+	// The intrinsic wants the xsave target enabled, this doesn't
+	u32 low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return ((u64)high << 32) | low;
+}
+
+#endif
+
+function bool HostHasAVX2(void)
+{
+	u32 registers[4];
+
+	Cpuid(0, 0, registers);
+	if (registers[0] < 7)
+	{
+		return false;
+	}
+
+	// AVX and OSXSAVE, then the OS has to be saving the SSE and AVX state
+	Cpuid(1, 0, registers);
+	u32 avx_osxsave = (1u << 28) | (1u << 27);
+	if ((registers[2] & avx_osxsave) != avx_osxsave || (ReadXCR0() & 6) != 6)
+	{
+		return false;
+	}
+
+	Cpuid(7, 0, registers);
+	return !!(registers[1] & (1u << 5));
+}
+
+//
+// OS metrics
+//
+
+#if defined(_WIN32)
+
+function u64 Win32FileTimeToMicroseconds(FILETIME time)
+{
+	// FILETIMEs are in units of 100ns
+	u64 result = ((u64)time.dwHighDateTime << 32)|(u64)time.dwLowDateTime;
+	return result / 10;
+}
+
+function void Win32ReadMemoryCounters(OSMetrics *metrics)
+{
+	PROCESS_MEMORY_COUNTERS counters = { .cb = sizeof(counters) };
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		// Windows does not tell soft and hard faults apart here
+		metrics->minor_page_faults   = counters.PageFaultCount;
+		metrics->resident_bytes      = counters.WorkingSetSize;
+		metrics->peak_resident_bytes = counters.PeakWorkingSetSize;
+	}
+}
+
+function OSMetrics ReadProcessMetrics(void)
+{
+	OSMetrics result = { 0 };
+
+	FILETIME creation, exit_time, kernel, user;
+	if (GetProcessTimes(GetCurrentProcess(), &creation, &exit_time, &kernel, &user))
+	{
+		result.user_time_us   = Win32FileTimeToMicroseconds(user);
+		result.system_time_us = Win32FileTimeToMicroseconds(kernel);
+	}
+
+	Win32ReadMemoryCounters(&result);
+
+	return result;
+}
+
+function OSMetrics ReadThreadMetrics(void)
+{
+	OSMetrics result = { 0 };
+
+	FILETIME creation, exit_time, kernel, user;
+	if (GetThreadTimes(GetCurrentThread(), &creation, &exit_time, &kernel, &user))
+	{
+		result.user_time_us   = Win32FileTimeToMicroseconds(user);
+		result.system_time_us = Win32FileTimeToMicroseconds(kernel);
+	}
+
+	Win32ReadMemoryCounters(&result);
+
+	return result;
+}
+
+#else
+
+function u64 TimevalToMicroseconds(struct timeval time)
+{
+	return (u64)time.tv_sec*1000000 + (u64)time.tv_usec;
+}
+
+function void MetricsFromRUsage(OSMetrics *metrics, struct rusage *usage)
+{
+	metrics->user_time_us                 = TimevalToMicroseconds(usage->ru_utime);
+	metrics->system_time_us               = TimevalToMicroseconds(usage->ru_stime);
+	metrics->minor_page_faults            = usage->ru_minflt;
+	metrics->major_page_faults            = usage->ru_majflt;
+	metrics->voluntary_context_switches   = usage->ru_nvcsw;
+	metrics->involuntary_context_switches = usage->ru_nivcsw;
+}
+
+function u64 ReadResidentBytes(void)
+{
+	u64 result = 0;
+
+#if defined(__linux__)
+	// /proc/self/statm: size resident shared text lib data dt, in pages
+	FILE *f = fopen("/proc/self/statm", "rb");
+	if (f)
+	{
+		unsigned long long size_pages     = 0;
+		unsigned long long resident_pages = 0;
+		if (fscanf(f, "%llu %llu", &size_pages, &resident_pages) == 2)
+		{
+			result = (u64)resident_pages*(u64)sysconf(_SC_PAGESIZE);
+		}
+		fclose(f);
+	}
+#endif
+
+	return result;
+}
+
+function OSMetrics ReadProcessMetrics(void)
+{
+	OSMetrics result = { 0 };
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		MetricsFromRUsage(&result, &usage);
+
+		// ru_maxrss is in kilobytes on Linux
+		result.peak_resident_bytes = (u64)usage.ru_maxrss*1024;
+	}
+
+	result.resident_bytes = ReadResidentBytes();
+
+	return result;
+}
+
+function OSMetrics ReadThreadMetrics(void)
+{
+	OSMetrics result = { 0 };
+
+	struct rusage usage;
+#if defined(__linux__)
+	if (getrusage(RUSAGE_THREAD, &usage) == 0)
+#else
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+#endif
+	{
+		MetricsFromRUsage(&result, &usage);
+	}
+
+	result.resident_bytes = ReadResidentBytes();
+	result.peak_resident_bytes = result.resident_bytes;
+
+	return result;
+}
+
+#endif
+
+function OSMetrics OSMetricsDelta(OSMetrics *start, OSMetrics *end)
+{
+	OSMetrics result =
+	{
+		.user_time_us                 = end->user_time_us                 - start->user_time_us,
+		.system_time_us               = end->system_time_us               - start->system_time_us,
+		.minor_page_faults            = end->minor_page_faults            - start->minor_page_faults,
+		.major_page_faults            = end->major_page_faults            - start->major_page_faults,
+		.voluntary_context_switches   = end->voluntary_context_switches   - start->voluntary_context_switches,
+		.involuntary_context_switches = end->involuntary_context_switches - start->involuntary_context_switches,
+
+		// Resident sizes are a level rather than a counter, so the delta is
+		// how much the zone grew the working set (which can be negative)
+		.resident_bytes               = end->resident_bytes               - start->resident_bytes,
+		.peak_resident_bytes          = end->peak_resident_bytes,
+	};
+	return result;
+}
+
+function void AccumulateOSMetrics(OSMetrics *dest, OSMetrics *source)
+{
+	dest->user_time_us                 += source->user_time_us;
+	dest->system_time_us               += source->system_time_us;
+	dest->minor_page_faults            += source->minor_page_faults;
+	dest->major_page_faults            += source->major_page_faults;
+	dest->voluntary_context_switches   += source->voluntary_context_switches;
+	dest->involuntary_context_switches += source->involuntary_context_switches;
+	dest->resident_bytes               += source->resident_bytes;
+	dest->peak_resident_bytes           = Max(dest->peak_resident_bytes, source->peak_resident_bytes);
+}
+
+//
+// Files
+//
+
+#if defined(_WIN32)
+
+function String MapEntireFile(const char *file_name)
+{
+	String result = { 0 };
+
+	HANDLE file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping)
+			{
+				void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				if (view)
+				{
+					result.count = (size_t)size.QuadPart;
+					result.bytes = view;
+				}
+
+				// The view keeps the mapping alive
+				CloseHandle(mapping);
+			}
+		}
+
+		CloseHandle(file);
+	}
+
+	return result;
+}
+
+function void UnmapEntireFile(String mapping)
+{
+	if (mapping.bytes)
+	{
+		UnmapViewOfFile(mapping.bytes);
+	}
+}
+
+#else
+
+function String MapEntireFile(const char *file_name)
+{
+	String result = { 0 };
+
+	int fd = open(file_name, O_RDONLY);
+	if (fd != -1)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED)
+			{
+				result.count = (size_t)st.st_size;
+				result.bytes = view;
+			}
+		}
+
+		// The mapping keeps the file alive
+		close(fd);
+	}
+
+	return result;
+}
+
+function void UnmapEntireFile(String mapping)
+{
+	if (mapping.bytes)
+	{
+		munmap((void *)mapping.bytes, mapping.count);
+	}
+}
+
+#endif
+
+//
+// Memory
+//
+
+#if defined(_WIN32)
+
+function void *AllocatePages(u64 size)
+{
+	return VirtualAlloc(NULL, (SIZE_T)size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+}
+
+function void FreePages(void *memory, u64 size)
+{
+	(void)size;
+	if (memory)
+	{
+		VirtualFree(memory, 0, MEM_RELEASE);
+	}
+}
+
+function bool SetPagesExecutable(void *memory, u64 size, bool executable)
+{
+	DWORD old_protect;
+	return VirtualProtect(memory, (SIZE_T)size, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &old_protect) != 0;
+}
+
+#else
+
+function void *AllocatePages(u64 size)
+{
+	void *result = mmap(NULL, (size_t)size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	return result == MAP_FAILED ? NULL : result;
+}
+
+function void FreePages(void *memory, u64 size)
+{
+	if (memory)
+	{
+		munmap(memory, (size_t)size);
+	}
+}
+
+function bool SetPagesExecutable(void *memory, u64 size, bool executable)
+{
+	return mprotect(memory, (size_t)size, executable ? PROT_READ|PROT_EXEC : PROT_READ|PROT_WRITE) == 0;
+}
+
+#endif
+
+//
+// Threads
+//
+
+#if defined(_WIN32)
+
+function DWORD WINAPI Win32ThreadProc(LPVOID param)
+{
+	PlatformThread *thread = param;
+	thread->proc(thread->param);
+	return 0;
+}
+
+function bool StartThread(PlatformThread *thread, ThreadProc *proc, void *param)
+{
+	thread->proc   = proc;
+	thread->param  = param;
+	thread->handle = CreateThread(NULL, 0, Win32ThreadProc, thread, 0, NULL);
+	return thread->handle != NULL;
+}
+
+function void JoinThread(PlatformThread *thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+}
+
+function u32 GetProcessorCount(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (u32)info.dwNumberOfProcessors;
+}
+
+function u64 AtomicAddU64(volatile u64 *value, u64 addend)
+{
+	return (u64)InterlockedExchangeAdd64((volatile LONG64 *)value, (LONG64)addend);
+}
+
+function u64 AtomicLoadU64(volatile u64 *value)
+{
+	return (u64)InterlockedCompareExchange64((volatile LONG64 *)value, 0, 0);
+}
+
+function void AtomicStoreU64(volatile u64 *value, u64 new_value)
+{
+	InterlockedExchange64((volatile LONG64 *)value, (LONG64)new_value);
+}
+
+function void SleepMilliseconds(u32 milliseconds)
+{
+	Sleep(milliseconds);
+}
+
+#else
+
+function void *PosixThreadProc(void *param)
+{
+	PlatformThread *thread = param;
+	thread->proc(thread->param);
+	return NULL;
+}
+
+function bool StartThread(PlatformThread *thread, ThreadProc *proc, void *param)
+{
+	thread->proc  = proc;
+	thread->param = param;
+	return pthread_create(&thread->handle, NULL, PosixThreadProc, thread) == 0;
+}
+
+function void JoinThread(PlatformThread *thread)
+{
+	pthread_join(thread->handle, NULL);
+}
+
+function u32 GetProcessorCount(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (u32)count : 1;
+}
+
+function u64 AtomicAddU64(volatile u64 *value, u64 addend)
+{
+	return __atomic_fetch_add(value, addend, __ATOMIC_SEQ_CST);
+}
+
+function u64 AtomicLoadU64(volatile u64 *value)
+{
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+function void AtomicStoreU64(volatile u64 *value, u64 new_value)
+{
+	__atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+}
+
+function void SleepMilliseconds(u32 milliseconds)
+{
+	struct timespec duration =
+	{
+		.tv_sec  = milliseconds / 1000,
+		.tv_nsec = (long)(milliseconds % 1000)*1000000,
+	};
+	nanosleep(&duration, NULL);
+}
+
+#endif
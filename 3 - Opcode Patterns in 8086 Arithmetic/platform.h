@@ -0,0 +1,100 @@
+//
+// Timers
+//
+
+function u64 GetOSTimerFreq(void);
+function u64 ReadOSTimer(void);
+function u64 ReadCPUTimer(void);
+function u64 EstimateCPUTimerFreq(void);
+
+//
+// CPU features
+//
+
+// AVX2, with an OS that saves the YMM registers
+function bool HostHasAVX2(void);
+
+//
+// OS metrics
+//
+
+typedef struct OSMetrics
+{
+	u64 user_time_us;
+	u64 system_time_us;
+
+	u64 minor_page_faults;
+	u64 major_page_faults;
+
+	u64 voluntary_context_switches;
+	u64 involuntary_context_switches;
+
+	u64 resident_bytes;
+	u64 peak_resident_bytes;
+} OSMetrics;
+
+// Whole process. Reads /proc/self on Linux, so it's not something you want to
+// call in a hot loop.
+function OSMetrics ReadProcessMetrics(void);
+
+// Calling thread only, apart from the resident sizes which are always process
+// wide. On Windows the context switch counts are not available and stay zero.
+function OSMetrics ReadThreadMetrics(void);
+
+function OSMetrics OSMetricsDelta(OSMetrics *start, OSMetrics *end);
+function void      AccumulateOSMetrics(OSMetrics *dest, OSMetrics *source);
+
+//
+// Files
+//
+
+// Maps a whole file read-only into memory. Returns an empty string if the file
+// couldn't be opened or is empty.
+function String MapEntireFile(const char *file_name);
+function void   UnmapEntireFile(String mapping);
+
+//
+// Memory
+//
+
+// Zeroed, page aligned memory straight from the OS. Pages are only backed
+// once they are touched, so it's fine to ask for large ranges that will be
+// used sparsely. Returns NULL on failure.
+function void *AllocatePages(u64 size);
+function void  FreePages(void *memory, u64 size);
+
+// Flips pages between read/write and read/execute, never both at once
+function bool SetPagesExecutable(void *memory, u64 size, bool executable);
+
+//
+// Threads
+//
+
+typedef void ThreadProc(void *param);
+
+typedef struct PlatformThread
+{
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	ThreadProc *proc;
+	void       *param;
+} PlatformThread;
+
+// The PlatformThread has to stay put until JoinThread, the new thread reads
+// proc and param out of it.
+function bool StartThread(PlatformThread *thread, ThreadProc *proc, void *param);
+function void JoinThread(PlatformThread *thread);
+function u32  GetProcessorCount(void);
+
+// Returns the value from before the add
+function u64 AtomicAddU64(volatile u64 *value, u64 addend);
+
+// Acquire and release, for handing data from one thread to another: whatever
+// was written before the store is visible after a load that sees it
+function u64  AtomicLoadU64(volatile u64 *value);
+function void AtomicStoreU64(volatile u64 *value, u64 new_value);
+
+function void SleepMilliseconds(u32 milliseconds);
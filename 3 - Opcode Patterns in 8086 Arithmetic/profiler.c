@@ -0,0 +1,185 @@
+global Profiler g_profiler;
+global u32      g_profiler_parent;
+
+function void BeginProfile(bool collect_os_metrics)
+{
+	g_profiler.collect_os_metrics = collect_os_metrics;
+
+	if (collect_os_metrics)
+	{
+		g_profiler.start_metrics = ReadProcessMetrics();
+	}
+
+	g_profiler.start_tsc = ReadCPUTimer();
+}
+
+function ProfileBlock BeginProfileBlock(const char *label, u32 anchor_index)
+{
+	ProfileBlock block =
+	{
+		.active       = true,
+		.anchor_index = anchor_index,
+		.parent_index = g_profiler_parent,
+	};
+
+	ProfileAnchor *anchor = &g_profiler.anchors[anchor_index];
+	anchor->label = label;
+	block.old_tsc_elapsed_inclusive = anchor->tsc_elapsed_inclusive;
+
+	g_profiler_parent = anchor_index;
+
+	if (g_profiler.collect_os_metrics)
+	{
+		block.start_metrics = ReadThreadMetrics();
+	}
+
+	block.start_tsc = ReadCPUTimer();
+
+	return block;
+}
+
+function void EndProfileBlock(ProfileBlock *block)
+{
+	u64 elapsed = ReadCPUTimer() - block->start_tsc;
+
+	ProfileAnchor *anchor = &g_profiler.anchors[block->anchor_index];
+	ProfileAnchor *parent = &g_profiler.anchors[block->parent_index];
+
+	parent->tsc_elapsed_exclusive -= elapsed;
+	anchor->tsc_elapsed_exclusive += elapsed;
+	anchor->tsc_elapsed_inclusive  = block->old_tsc_elapsed_inclusive + elapsed;
+	anchor->hit_count += 1;
+
+	if (g_profiler.collect_os_metrics)
+	{
+		OSMetrics end_metrics = ReadThreadMetrics();
+		OSMetrics delta = OSMetricsDelta(&block->start_metrics, &end_metrics);
+		AccumulateOSMetrics(&anchor->metrics, &delta);
+	}
+
+	g_profiler_parent = block->parent_index;
+
+	block->active = false;
+}
+
+function void PrintBytes(FILE *out, s64 bytes)
+{
+	const char *sign = "";
+	if (bytes < 0)
+	{
+		sign  = "-";
+		bytes = -bytes;
+	}
+
+	if (bytes >= (s64)Megabytes(1))
+	{
+		fprintf(out, "%s%.2f MiB", sign, (double)bytes / (double)Megabytes(1));
+	}
+	else if (bytes >= (s64)Kilobytes(1))
+	{
+		fprintf(out, "%s%.2f KiB", sign, (double)bytes / (double)Kilobytes(1));
+	}
+	else
+	{
+		fprintf(out, "%s%lld B", sign, (long long)bytes);
+	}
+}
+
+function void PrintOSMetrics(FILE *out, OSMetrics *metrics, double wall_seconds)
+{
+	u64    cpu_us      = metrics->user_time_us + metrics->system_time_us;
+	double cpu_percent = 0.0;
+	if (wall_seconds > 0.0)
+	{
+		cpu_percent = 100.0*((double)cpu_us / 1000000.0) / wall_seconds;
+	}
+
+	fprintf(out, "cpu %.0f%% of wall (%llu us user, %llu us sys), faults %llu minor / %llu major, ctx switches %llu vol / %llu invol",
+			cpu_percent,
+			(unsigned long long)metrics->user_time_us,
+			(unsigned long long)metrics->system_time_us,
+			(unsigned long long)metrics->minor_page_faults,
+			(unsigned long long)metrics->major_page_faults,
+			(unsigned long long)metrics->voluntary_context_switches,
+			(unsigned long long)metrics->involuntary_context_switches);
+}
+
+function void PrintTimeElapsed(FILE *out, u64 total_tsc_elapsed, u64 cpu_freq, ProfileAnchor *anchor)
+{
+	double percent = 100.0*((double)anchor->tsc_elapsed_exclusive / (double)total_tsc_elapsed);
+	fprintf(out, "  %s[%llu]: %llu (%.2f%%", anchor->label, (unsigned long long)anchor->hit_count, (unsigned long long)anchor->tsc_elapsed_exclusive, percent);
+
+	if (anchor->tsc_elapsed_inclusive != anchor->tsc_elapsed_exclusive)
+	{
+		double percent_with_children = 100.0*((double)anchor->tsc_elapsed_inclusive / (double)total_tsc_elapsed);
+		fprintf(out, ", %.2f%% w/children", percent_with_children);
+	}
+
+	fprintf(out, ")\n");
+
+	if (g_profiler.collect_os_metrics)
+	{
+		double wall_seconds = 0.0;
+		if (cpu_freq)
+		{
+			wall_seconds = (double)anchor->tsc_elapsed_inclusive / (double)cpu_freq;
+		}
+
+		fprintf(out, "      ");
+		PrintOSMetrics(out, &anchor->metrics, wall_seconds);
+		fprintf(out, ", rss ");
+		if ((s64)anchor->metrics.resident_bytes >= 0)
+		{
+			fprintf(out, "+");
+		}
+		PrintBytes(out, (s64)anchor->metrics.resident_bytes);
+		fprintf(out, "\n");
+	}
+}
+
+function void EndAndPrintProfile(FILE *out)
+{
+	g_profiler.end_tsc = ReadCPUTimer();
+
+	if (g_profiler.collect_os_metrics)
+	{
+		g_profiler.end_metrics = ReadProcessMetrics();
+	}
+
+	u64 cpu_freq = EstimateCPUTimerFreq();
+
+	u64 total_tsc_elapsed = g_profiler.end_tsc - g_profiler.start_tsc;
+
+	if (cpu_freq)
+	{
+		fprintf(out, "\nTotal time: %0.4fms (CPU freq %llu)\n", 1000.0*(double)total_tsc_elapsed / (double)cpu_freq, (unsigned long long)cpu_freq);
+	}
+
+	for (u32 anchor_index = 0; anchor_index < ArrayCount(g_profiler.anchors); anchor_index++)
+	{
+		ProfileAnchor *anchor = &g_profiler.anchors[anchor_index];
+		if (anchor->tsc_elapsed_inclusive)
+		{
+			PrintTimeElapsed(out, total_tsc_elapsed, cpu_freq, anchor);
+		}
+	}
+
+	if (g_profiler.collect_os_metrics)
+	{
+		double wall_seconds = 0.0;
+		if (cpu_freq)
+		{
+			wall_seconds = (double)total_tsc_elapsed / (double)cpu_freq;
+		}
+
+		OSMetrics run = OSMetricsDelta(&g_profiler.start_metrics, &g_profiler.end_metrics);
+
+		fprintf(out, "\nWhole run:\n  ");
+		PrintOSMetrics(out, &run, wall_seconds);
+		fprintf(out, "\n  rss ");
+		PrintBytes(out, (s64)g_profiler.end_metrics.resident_bytes);
+		fprintf(out, ", peak rss ");
+		PrintBytes(out, (s64)g_profiler.end_metrics.peak_resident_bytes);
+		fprintf(out, "\n");
+	}
+}
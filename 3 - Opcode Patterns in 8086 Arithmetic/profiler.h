@@ -0,0 +1,63 @@
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+typedef struct ProfileAnchor
+{
+	const char *label;
+
+	u64 hit_count;
+	u64 tsc_elapsed_exclusive; // does not include children
+	u64 tsc_elapsed_inclusive; // does include children
+
+	// Accumulated over every time the zone was entered, inclusive of children.
+	// Only filled in when the profiler collects OS metrics.
+	OSMetrics metrics;
+} ProfileAnchor;
+
+typedef struct ProfileBlock
+{
+	bool active;
+
+	u32 anchor_index;
+	u32 parent_index;
+
+	u64 start_tsc;
+	u64 old_tsc_elapsed_inclusive;
+
+	OSMetrics start_metrics;
+} ProfileBlock;
+
+typedef struct Profiler
+{
+	bool collect_os_metrics;
+
+	u64 start_tsc;
+	u64 end_tsc;
+
+	OSMetrics start_metrics;
+	OSMetrics end_metrics;
+
+	ProfileAnchor anchors[64];
+} Profiler;
+
+// The profiler is not thread safe, zones should only be opened on the main
+// thread. OS metrics are sampled with a system call (or two) on entering and
+// leaving every zone, so they are meant for coarse zones like program phases,
+// not for zones inside of a hot loop.
+function void BeginProfile(bool collect_os_metrics);
+function void EndAndPrintProfile(FILE *out);
+
+function ProfileBlock BeginProfileBlock(const char *label, u32 anchor_index);
+function void EndProfileBlock(ProfileBlock *block);
+
+#if PROFILER
+
+#define ProfileZone_(label, block, index) for (ProfileBlock block = BeginProfileBlock(label, index); block.active; EndProfileBlock(&block))
+#define ProfileZone(label) ProfileZone_(label, Glue(profile_block_, __LINE__), __COUNTER__ + 1)
+
+#else
+
+#define ProfileZone(label)
+
+#endif
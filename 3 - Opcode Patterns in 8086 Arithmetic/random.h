@@ -0,0 +1,67 @@
+// Small seedable PRNG (xorshift64*). Not for anything cryptographic, just so
+// generated workloads are reproducible from a seed.
+
+typedef struct RandomSeries
+{
+	u64 state;
+} RandomSeries;
+
+function RandomSeries SeedRandom(u64 seed)
+{
+	RandomSeries result =
+	{
+		// Mix the seed so that small seeds still give well distributed states,
+		// and make sure the state is never zero.
+		.state = (seed ^ 0x9E3779B97F4A7C15ull)*0xBF58476D1CE4E5B9ull | 1,
+	};
+	return result;
+}
+
+function u64 RandomU64(RandomSeries *series)
+{
+	u64 x = series->state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	series->state = x;
+	return x*0x2545F4914F6CDD1Dull;
+}
+
+function u32 RandomU32(RandomSeries *series)
+{
+	return (u32)(RandomU64(series) >> 32);
+}
+
+// Uniform in [0, count)
+function u32 RandomChoice(RandomSeries *series, u32 count)
+{
+	return (u32)(((u64)RandomU32(series)*(u64)count) >> 32);
+}
+
+// Picks an index with probability proportional to its weight. Returns
+// weight_count if all weights are zero.
+function u32 RandomWeighted(RandomSeries *series, u32 weight_count, u32 *weights)
+{
+	u64 total = 0;
+	for (u32 i = 0; i < weight_count; i++)
+	{
+		total += weights[i];
+	}
+
+	if (!total)
+	{
+		return weight_count;
+	}
+
+	u64 pick = RandomU64(series) % total;
+	for (u32 i = 0; i < weight_count; i++)
+	{
+		if (pick < weights[i])
+		{
+			return i;
+		}
+		pick -= weights[i];
+	}
+
+	return weight_count - 1;
+}
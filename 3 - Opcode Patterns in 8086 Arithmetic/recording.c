@@ -0,0 +1,279 @@
+function u16 RecordRead(void *context, u16 port, bool wide)
+{
+	Recording *rec = context;
+
+	u16 result = wide ? 0xFFFF : 0xFF;
+	if (rec->mode == RecordMode_Record)
+	{
+		IOPort *device = &rec->devices[port];
+		result = device->read(device->context, port, wide);
+
+		if (rec->input_count == rec->input_capacity)
+		{
+			u64 capacity = rec->input_capacity ? 2*rec->input_capacity : 4096;
+			RecordedInput *inputs = realloc(rec->inputs, capacity*sizeof(RecordedInput));
+			if (!inputs)
+			{
+				rec->out_of_memory = true;
+				return result;
+			}
+
+			rec->inputs         = inputs;
+			rec->input_capacity = capacity;
+		}
+
+		RecordedInput *input = &rec->inputs[rec->input_count++];
+		input->port  = port;
+		input->value = result;
+	}
+	else if (rec->input_at < rec->input_count && rec->inputs[rec->input_at].port == port)
+	{
+		u16 value = rec->inputs[rec->input_at++].value;
+		result = wide ? value : (u16)(value & 0xFF);
+	}
+	else
+	{
+		rec->diverged = true;
+	}
+
+	return result;
+}
+
+function void RecordWrite(void *context, u16 port, bool wide, u16 value)
+{
+	Recording *rec = context;
+
+	if (rec->mode != RecordMode_Seek)
+	{
+		IOPort *device = &rec->devices[port];
+		device->write(device->context, port, wide, value);
+	}
+}
+
+function bool TakeCheckpoint(Recording *rec)
+{
+	if (rec->checkpoint_count == rec->checkpoint_capacity)
+	{
+		u32 capacity = rec->checkpoint_capacity ? 2*rec->checkpoint_capacity : 64;
+		Checkpoint *checkpoints = realloc(rec->checkpoints, capacity*sizeof(Checkpoint));
+		if (!checkpoints)
+		{
+			rec->out_of_memory = true;
+			return false;
+		}
+
+		rec->checkpoints         = checkpoints;
+		rec->checkpoint_capacity = capacity;
+	}
+
+	Checkpoint *checkpoint = &rec->checkpoints[rec->checkpoint_count];
+	if (!TakeSnapshot(&rec->store, &checkpoint->snapshot))
+	{
+		rec->out_of_memory = true;
+		return false;
+	}
+
+	checkpoint->input_at = (rec->mode == RecordMode_Record) ? rec->input_count : rec->input_at;
+	rec->checkpoint_count += 1;
+
+	return true;
+}
+
+function bool StartRecording(Recording *rec, Simulator *sim, u64 checkpoint_every)
+{
+	ZeroStruct(rec);
+	rec->sim              = sim;
+	rec->mode             = RecordMode_Record;
+	rec->checkpoint_every = checkpoint_every ? checkpoint_every : RECORD_DEFAULT_CHECKPOINT_EVERY;
+	InitializeSnapshots(&rec->store, sim);
+
+	if (!EnablePorts(sim))
+	{
+		return false;
+	}
+
+	rec->devices = AllocatePages(IO_PORT_COUNT*sizeof(IOPort));
+	if (!rec->devices)
+	{
+		return false;
+	}
+
+	memcpy(rec->devices, sim->io_ports, IO_PORT_COUNT*sizeof(IOPort));
+	for (u32 port = 0; port < IO_PORT_COUNT; port++)
+	{
+		AttachPort(sim, (u16)port, RecordRead, RecordWrite, rec);
+	}
+
+	if (!TakeCheckpoint(rec))
+	{
+		StopRecording(rec);
+		return false;
+	}
+
+	return true;
+}
+
+function void StopRecording(Recording *rec)
+{
+	Simulator *sim = rec->sim;
+
+	if (rec->devices)
+	{
+		memcpy(sim->io_ports, rec->devices, IO_PORT_COUNT*sizeof(IOPort));
+		FreePages(rec->devices, IO_PORT_COUNT*sizeof(IOPort));
+	}
+
+	// Every checkpoint's pages go with the store
+	FreeSnapshots(&rec->store);
+	free(rec->checkpoints);
+	free(rec->inputs);
+
+	ZeroStruct(rec);
+	rec->sim = sim;
+}
+
+function u64 RunRecording(Recording *rec, u64 max_instructions)
+{
+	Simulator *sim = rec->sim;
+
+	u64 start = sim->instruction_count;
+	for (;;)
+	{
+		u64 executed = sim->instruction_count - start;
+		if (max_instructions && executed >= max_instructions)
+		{
+			break;
+		}
+
+		// Up to the next multiple of checkpoint_every
+		u64 next    = (sim->instruction_count / rec->checkpoint_every + 1)*rec->checkpoint_every;
+		u64 stretch = next - sim->instruction_count;
+		if (max_instructions)
+		{
+			stretch = Min(stretch, max_instructions - executed);
+		}
+
+		u64 ran = RunBlocks(sim, stretch);
+		if (sim->error || ran < stretch || sim->ip >= sim->code_end)
+		{
+			break;
+		}
+
+		// After a seek back, the run goes over checkpoints it already has,
+		// and they stay in order by only adding ones past the last
+		Checkpoint *last = &rec->checkpoints[rec->checkpoint_count - 1];
+		if (sim->instruction_count == next && next > last->snapshot.instruction_count && !rec->out_of_memory)
+		{
+			TakeCheckpoint(rec);
+		}
+	}
+
+	return sim->instruction_count - start;
+}
+
+function bool SeekRecording(Recording *rec, u64 instruction_count)
+{
+	Simulator *sim = rec->sim;
+
+	// The last checkpoint at or before it
+	u32 low  = 0;
+	u32 high = rec->checkpoint_count;
+	while (high - low > 1)
+	{
+		u32 middle = low + (high - low) / 2;
+		if (rec->checkpoints[middle].snapshot.instruction_count <= instruction_count)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	if (!rec->checkpoint_count || rec->checkpoints[low].snapshot.instruction_count > instruction_count)
+	{
+		return false;
+	}
+
+	Checkpoint *checkpoint = &rec->checkpoints[low];
+	RestoreSnapshot(&rec->store, &checkpoint->snapshot);
+
+	rec->mode     = RecordMode_Seek;
+	rec->input_at = checkpoint->input_at;
+	rec->diverged = false;
+
+	// RunBlocks takes 0 to mean no limit
+	u64 left = instruction_count - sim->instruction_count;
+	if (left)
+	{
+		RunBlocks(sim, left);
+	}
+
+	// From here on it's running again, so output goes to the devices
+	rec->mode = RecordMode_Replay;
+
+	return sim->instruction_count == instruction_count && !rec->diverged;
+}
+
+function bool WriteInputLog(Recording *rec, const char *file_name)
+{
+	FILE *file = fopen(file_name, "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	bool result = fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC) - 1, file) == sizeof(RECORD_MAGIC) - 1 &&
+				  fwrite(&rec->input_count, sizeof(rec->input_count), 1, file) == 1 &&
+				  fwrite(rec->inputs, sizeof(RecordedInput), rec->input_count, file) == rec->input_count;
+
+	if (fclose(file) != 0)
+	{
+		result = false;
+	}
+
+	return result;
+}
+
+function bool ReadInputLog(Recording *rec, const char *file_name)
+{
+	String log = MapEntireFile(file_name);
+	if (!log.bytes)
+	{
+		return false;
+	}
+
+	u64 header_size = sizeof(RECORD_MAGIC) - 1 + sizeof(u64);
+
+	u64  count  = 0;
+	bool result = log.count >= header_size && memcmp(log.bytes, RECORD_MAGIC, sizeof(RECORD_MAGIC) - 1) == 0;
+	if (result)
+	{
+		memcpy(&count, log.bytes + sizeof(RECORD_MAGIC) - 1, sizeof(count));
+		result = (log.count - header_size) / sizeof(RecordedInput) >= count;
+	}
+
+	RecordedInput *inputs = NULL;
+	if (result && count)
+	{
+		inputs = malloc(count*sizeof(RecordedInput));
+		result = (inputs != NULL);
+	}
+
+	if (result)
+	{
+		memcpy(inputs, log.bytes + header_size, count*sizeof(RecordedInput));
+
+		free(rec->inputs);
+		rec->inputs         = inputs;
+		rec->input_count    = count;
+		rec->input_capacity = count;
+		rec->input_at       = 0;
+		rec->mode           = RecordMode_Replay;
+	}
+
+	UnmapEntireFile(log);
+
+	return result;
+}
@@ -0,0 +1,94 @@
+// Deterministic record and replay. A run follows from the program and the
+// state it starts in, apart from what IN reads from devices, so recording
+// keeps a log of every value read and replaying feeds them back in place of
+// the devices. Along the way the whole machine is checkpointed every so many
+// instructions (see snapshot.h), and seeking to an instruction count restores
+// the last checkpoint at or before it and replays forward from there through
+// RunBlocks. A seek never has more than one checkpoint interval to execute.
+//
+// Every port goes through the recording while it's attached, on its way to
+// the device that was there before. Replaying leaves the devices out of
+// reads, and seeking leaves them out of writes too, so nothing goes out to
+// them twice.
+//
+// The log can be saved and read back in for a replay in another run. The
+// file is RECORD_MAGIC, the u64 number of inputs and then a RecordedInput
+// for each, little endian.
+
+#define RECORD_MAGIC "SIM8086INPUTS\0\0\1"
+
+#define RECORD_DEFAULT_CHECKPOINT_EVERY 10000000
+
+typedef struct RecordedInput
+{
+	u16 port;
+	u16 value;
+} RecordedInput;
+
+typedef struct Checkpoint
+{
+	// How many inputs had been read by then
+	u64      input_at;
+	Snapshot snapshot;
+} Checkpoint;
+
+typedef enum RecordMode
+{
+	RecordMode_Record, // reads go to the devices and into the log
+	RecordMode_Replay, // reads come from the log, writes go to the devices
+	RecordMode_Seek,   // reads come from the log, writes go nowhere
+} RecordMode;
+
+typedef struct Recording
+{
+	Simulator *sim;
+	RecordMode mode;
+
+	// The port table from before, with the devices
+	IOPort *devices;
+
+	u64            input_count;
+	u64            input_capacity;
+	RecordedInput *inputs;
+
+	// The next input to replay
+	u64 input_at;
+
+	// Set when a replay reads a port other than the one recorded next, or
+	// runs out of inputs. It then reads all ones.
+	bool diverged;
+
+	u64         checkpoint_every;
+	u32         checkpoint_count;
+	u32         checkpoint_capacity;
+	Checkpoint *checkpoints;
+
+	// Set when the log or a checkpoint couldn't grow. Checkpoints stop there,
+	// so seeking past it takes longer, but a log that's missing inputs can't
+	// be replayed.
+	bool out_of_memory;
+
+	SnapshotStore store;
+} Recording;
+
+// Puts the recording in front of every port and takes the first checkpoint,
+// of the machine as it is now. Returns false if there was no memory for it.
+function bool StartRecording(Recording *rec, Simulator *sim, u64 checkpoint_every);
+
+// Puts the ports back the way they were and frees the log and checkpoints
+function void StopRecording(Recording *rec);
+
+// Runs like RunBlocks, taking a checkpoint every checkpoint_every
+// instructions past the last one there is, so running on after a seek back
+// keeps the checkpoints from before. Returns the number of instructions
+// executed.
+function u64 RunRecording(Recording *rec, u64 max_instructions);
+
+// Leaves the machine as it was after instruction_count instructions, and
+// the recording replaying. Returns false if the run ended before that, or
+// didn't read what was recorded.
+function bool SeekRecording(Recording *rec, u64 instruction_count);
+
+// A log read back in replaces what was recorded and switches to replaying
+function bool WriteInputLog(Recording *rec, const char *file_name);
+function bool ReadInputLog(Recording *rec, const char *file_name);
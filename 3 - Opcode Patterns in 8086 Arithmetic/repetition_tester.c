@@ -0,0 +1,78 @@
+function void NewTestWave(RepetitionTester *tester, u64 cpu_timer_freq, u32 seconds_to_try)
+{
+	ZeroStruct(tester);
+
+	tester->cpu_timer_freq     = cpu_timer_freq;
+	tester->try_for_time       = (u64)seconds_to_try*cpu_timer_freq;
+	tester->tests_started_at   = ReadCPUTimer();
+	tester->testing            = true;
+	tester->results.min_time   = UINT64_MAX;
+}
+
+function void BeginTime(RepetitionTester *tester)
+{
+	tester->open_block_count += 1;
+	tester->time_accumulated_on_this_test -= ReadCPUTimer();
+}
+
+function void EndTime(RepetitionTester *tester)
+{
+	tester->close_block_count += 1;
+	tester->time_accumulated_on_this_test += ReadCPUTimer();
+}
+
+function bool IsTesting(RepetitionTester *tester)
+{
+	if (!tester->testing)
+	{
+		return false;
+	}
+
+	u64 current_time = ReadCPUTimer();
+
+	if (tester->open_block_count)
+	{
+		if (tester->open_block_count != tester->close_block_count)
+		{
+			fprintf(stderr, "Repetition tester: unbalanced BeginTime/EndTime\n");
+			tester->testing = false;
+			return false;
+		}
+
+		u64 elapsed = tester->time_accumulated_on_this_test;
+
+		RepetitionTestResults *results = &tester->results;
+		results->test_count += 1;
+		results->total_time += elapsed;
+		results->max_time    = Max(results->max_time, elapsed);
+
+		if (elapsed < results->min_time)
+		{
+			results->min_time = elapsed;
+
+			// Every new minimum restarts the clock
+			tester->tests_started_at = current_time;
+		}
+
+		tester->open_block_count              = 0;
+		tester->close_block_count             = 0;
+		tester->time_accumulated_on_this_test = 0;
+	}
+
+	if (current_time - tester->tests_started_at > tester->try_for_time)
+	{
+		tester->testing = false;
+	}
+
+	return tester->testing;
+}
+
+function double SecondsFromCPUTime(u64 cpu_time, u64 cpu_timer_freq)
+{
+	double result = 0.0;
+	if (cpu_timer_freq)
+	{
+		result = (double)cpu_time / (double)cpu_timer_freq;
+	}
+	return result;
+}
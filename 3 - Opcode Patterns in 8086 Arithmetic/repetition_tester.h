@@ -0,0 +1,41 @@
+// Runs a test over and over until it hasn't found a new fastest time for a
+// while, so the minimum is a decent estimate of what the code can do when
+// caches, branch predictors and clocks are all warmed up. Use it like:
+//
+//     NewTestWave(tester, cpu_timer_freq, 2);
+//     while (IsTesting(tester))
+//     {
+//         BeginTime(tester);
+//         ... the thing being tested ...
+//         EndTime(tester);
+//     }
+
+typedef struct RepetitionTestResults
+{
+	u64 test_count;
+	u64 total_time;
+	u64 min_time;
+	u64 max_time;
+} RepetitionTestResults;
+
+typedef struct RepetitionTester
+{
+	u64 cpu_timer_freq;
+	u64 try_for_time;
+	u64 tests_started_at;
+
+	bool testing;
+
+	u32 open_block_count;
+	u32 close_block_count;
+	u64 time_accumulated_on_this_test;
+
+	RepetitionTestResults results;
+} RepetitionTester;
+
+function void NewTestWave(RepetitionTester *tester, u64 cpu_timer_freq, u32 seconds_to_try);
+function bool IsTesting(RepetitionTester *tester);
+function void BeginTime(RepetitionTester *tester);
+function void EndTime(RepetitionTester *tester);
+
+function double SecondsFromCPUTime(u64 cpu_time, u64 cpu_timer_freq);
@@ -0,0 +1,77 @@
+function void PrintSample(FILE *out, Sampler *sampler, Simulator *sim, double ms)
+{
+	u8 text_bytes[256];
+	Buffer output =
+	{
+		.capacity = sizeof(text_bytes),
+		.bytes    = text_bytes,
+	};
+
+	String address_space =
+	{
+		.count = Kilobytes(64),
+		.bytes = sim->memory,
+	};
+
+	String text = DisassembleAt(address_space, sim->ip, output);
+
+	fprintf(out, "Sample %llu at %llu instructions, %.3fms: %04x  %.*s",
+			(unsigned long long)sampler->sample_count, (unsigned long long)sim->instruction_count, ms,
+			sim->ip, StringExpand(text));
+	PrintRegisterLine(out, sim);
+}
+
+function u64 RunSampled(Simulator *sim, Sampler *sampler, FILE *out)
+{
+	u64 start_count = sim->instruction_count;
+
+	u64 os_timer_freq = GetOSTimerFreq();
+	u64 start_time    = ReadOSTimer();
+	u64 every_ticks   = sampler->every_ms*os_timer_freq / 1000;
+	u64 next_time     = start_time + every_ticks;
+
+	u64 next_count = start_count + sampler->every_instructions;
+
+	for (;;)
+	{
+		// Up to the next instruction sample, in pieces short enough to keep
+		// an eye on the clock when sampling by time
+		u64 stretch = 0;
+		if (sampler->every_instructions)
+		{
+			stretch = next_count - sim->instruction_count;
+		}
+		if (sampler->every_ms && (!stretch || stretch > SAMPLE_MAX_STRETCH))
+		{
+			stretch = SAMPLE_MAX_STRETCH;
+		}
+
+		u64 ran = RunBlocks(sim, stretch);
+		if (sim->error || !stretch || ran < stretch || sim->ip >= sim->code_end)
+		{
+			break;
+		}
+
+		u64 now = ReadOSTimer();
+
+		bool sample = false;
+		if (sampler->every_instructions && sim->instruction_count >= next_count)
+		{
+			next_count += sampler->every_instructions;
+			sample      = true;
+		}
+		if (sampler->every_ms && now >= next_time)
+		{
+			next_time = now + every_ticks;
+			sample    = true;
+		}
+
+		if (sample)
+		{
+			sampler->sample_count += 1;
+			PrintSample(out, sampler, sim, 1000.0*(double)(now - start_time) / (double)os_timer_freq);
+		}
+	}
+
+	return sim->instruction_count - start_count;
+}
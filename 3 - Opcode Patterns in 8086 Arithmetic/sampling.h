@@ -0,0 +1,23 @@
+// Fast-forward with a look at the machine now and then: runs at full speed
+// through RunBlocks, block cache and JIT included, and stops every so many
+// instructions or milliseconds to disassemble the instruction at ip and print
+// the registers. Nothing is decoded or formatted in between, so the cost over
+// a plain run is a return from RunBlocks per stretch plus the samples.
+//
+// Time is only looked at between stretches, so a time sample lands at the
+// end of the stretch it fell in, at most SAMPLE_MAX_STRETCH instructions late.
+
+#define SAMPLE_MAX_STRETCH 65536
+
+typedef struct Sampler
+{
+	// Either or both, 0 for off
+	u64 every_instructions;
+	u64 every_ms;
+
+	u64 sample_count;
+} Sampler;
+
+// Runs until the program ends or something goes wrong, printing a sample to
+// out as it goes. Returns the number of instructions executed.
+function u64 RunSampled(Simulator *sim, Sampler *sampler, FILE *out);
@@ -1,14 +1,44 @@
 #include "common.h"
+#include "platform.h"
+#include "profiler.h"
 #include "instruction.h"
 #include "decoder.h"
 #include "disassembler.h"
+#include "perf_counters.h"
+#include "stats.h"
+#include "simulator.h"
+#include "io_ports.h"
+#include "block_cache.h"
+#include "jit.h"
+#include "cycles.h"
+#include "trace.h"
+#include "hotspots.h"
+#include "breakpoints.h"
+#include "sampling.h"
+#include "snapshot.h"
+#include "recording.h"
 
 //
 //
 //
 
+#include "platform.c"
+#include "profiler.c"
 #include "decoder.c"
 #include "disassembler.c"
+#include "perf_counters.c"
+#include "stats.c"
+#include "simulator.c"
+#include "io_ports.c"
+#include "block_cache.c"
+#include "jit.c"
+#include "cycles.c"
+#include "trace.c"
+#include "hotspots.c"
+#include "breakpoints.c"
+#include "sampling.c"
+#include "snapshot.c"
+#include "recording.c"
 
 //
 //
@@ -74,6 +104,14 @@ bail:
 
 global u8 g_input [1 << 16];
 global u8 g_output[1 << 16];
+global u8 g_memory[SIM_MEMORY_SIZE];
+
+global Breakpoints g_breakpoints;
+global Recording   g_recording;
+
+global ConsoleDevice g_console;
+global TimerDevice   g_timer;
+global FileDevice    g_file_device;
 
 #if 0
 typedef struct ArgumentDescription
@@ -151,19 +189,804 @@ function Argument MatchArgument(ArgumentParser *parser)
 }
 #endif
 
-int main(int argument_count, char **arguments)
+function void PrintUsage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [-profile] [-perf] [8086 binary to disassemble]\n", program);
+	fprintf(stderr, "       %s -exec [-trace] [-cycles] [-8088] [-trace-file file] [-hotspots] [-break ip] [-watch address[:count]] [-sample N] [-sample-ms N] [-record file] [-replay file] [-checkpoint-every millions] [-seek N] [-ports] [-port-input file] [-port-output file] [-icache] [-blocks] [-jit] [-profile] [8086 binary to execute]\n", program);
+	fprintf(stderr, "       %s -print-trace [trace file written by -trace-file]\n", program);
+	fprintf(stderr, "       %s -stats [-threads N] [-csv file] [-profile] [8086 binaries...]\n", program);
+}
+
+function int RunStats(u32 file_count, StatsFileResult *files, u32 thread_count, String csv_name)
 {
-	if (argument_count != 2)
+	DecodeStats *stats = &(DecodeStats){ 0 };
+
+	u64 start = ReadOSTimer();
+	ProfileZone("Gather Statistics")
+	{
+		GatherDecodeStatsForFiles(stats, file_count, files, thread_count);
+	}
+	u64 elapsed = ReadOSTimer() - start;
+
+	int result = 0;
+	for (u32 file_index = 0; file_index < file_count; file_index++)
+	{
+		StatsFileResult *file = &files[file_index];
+		if (file->failed)
+		{
+			fprintf(stderr, "Error while decoding %.*s:\n\t%.*s\n", StringExpand(file->file_name), StringExpand(file->error_message));
+			result = 1;
+		}
+	}
+
+	double seconds = (double)elapsed / (double)GetOSTimerFreq();
+	printf("; statistics for %u file%s on %u thread%s, %.3fms (%.2f MB/s)\n",
+		   file_count, file_count == 1 ? "" : "s", thread_count, thread_count == 1 ? "" : "s", 1000.0*seconds,
+		   seconds > 0.0 ? (double)stats->total.bytes / (seconds*1024.0*1024.0) : 0.0);
+	PrintDecodeStats(stdout, stats);
+
+	if (csv_name.count)
+	{
+		FILE *csv = fopen((const char *)csv_name.bytes, "wb");
+		if (csv)
+		{
+			WriteDecodeStatsCSV(csv, stats);
+			fclose(csv);
+		}
+		else
+		{
+			fprintf(stderr, "Failed to write '%.*s'\n", StringExpand(csv_name));
+			result = 1;
+		}
+	}
+
+	return result;
+}
+
+typedef struct ExecOptions
+{
+	// Print every instruction with what it changed (see ChangeLog), through
+	// the interpreter. Without it, and the other per-instruction options
+	// below, only the final state is printed, and the program runs through
+	// the block cache and the JIT when they're enabled.
+	bool trace;
+	bool icache;
+	bool blocks;
+	bool jit;
+
+	// Estimate clocks, which runs every instruction through the interpreter
+	bool       cycles;
+	CycleModel cycle_model;
+
+	// Write a binary trace, see trace.h. Also interpreter only.
+	String trace_file;
+
+	// Count executions and clocks per instruction, see hotspots.h. Implies
+	// cycles.
+	bool hotspots;
+
+	// Report every hit and carry on. Not with the options above, which have
+	// their own loop.
+	Breakpoints *breakpoints;
+
+	// Fast-forward, printing the instruction at ip and the registers every
+	// so many instructions and/or milliseconds, see sampling.h. Not with the
+	// options above either.
+	Sampler *sampler;
+
+	// Record what IN reads to record_file, or read it back from replay_file
+	// in place of the devices, with checkpoints every checkpoint_every
+	// instructions. Afterwards, go back to each of the seeks and print the
+	// registers there. See recording.h. Not with the options above.
+	String record_file;
+	String replay_file;
+	u64    checkpoint_every;
+	u32    seek_count;
+	u64    seeks[16];
+
+	// The console and the timer on their usual ports, see io_ports.h
+	bool ports;
+
+	// The file device, reading from port_input and writing to port_output
+	String port_input;
+	String port_output;
+} ExecOptions;
+
+function int RunExecution(String file_name, String code, ExecOptions *options)
+{
+	Simulator *sim = &(Simulator){ 0 };
+	InitializeSimulator(sim, g_memory);
+
+	if (options->icache && !EnableInstructionCache(sim))
+	{
+		fprintf(stderr, "Failed to allocate the instruction cache, running without it\n");
+	}
+
+	if (options->blocks && !EnableBlockCache(sim))
+	{
+		fprintf(stderr, "Failed to allocate the block cache, running without it\n");
+	}
+
+	if (options->jit && !EnableJit(sim))
+	{
+		fprintf(stderr, "The JIT isn't available, running without it\n");
+	}
+
+	if (!LoadProgram(sim, code))
 	{
-		fprintf(stderr, "Incorrect arguments\n");
+		fprintf(stderr, "Failed to load %.*s:\n\t%.*s\n", StringExpand(file_name), StringExpand(sim->error_message));
 		return 1;
 	}
 
-	String file_name = { 0 };
+	if (options->ports &&
+		(!AttachConsole(sim, &g_console, CONSOLE_PORT, stdin, stdout) || !AttachTimer(sim, &g_timer, TIMER_PORT)))
+	{
+		fprintf(stderr, "Failed to allocate the port table\n");
+		return 1;
+	}
+
+	String port_input  = { 0 };
+	FILE  *port_output = NULL;
+	if (options->port_input.count || options->port_output.count)
+	{
+		if (options->port_input.count)
+		{
+			port_input = MapEntireFile((const char *)options->port_input.bytes);
+			if (!port_input.bytes)
+			{
+				fprintf(stderr, "Failed to read file '%.*s'\n", StringExpand(options->port_input));
+				return 1;
+			}
+		}
+
+		if (options->port_output.count)
+		{
+			port_output = fopen((const char *)options->port_output.bytes, "wb");
+			if (!port_output)
+			{
+				fprintf(stderr, "Failed to open '%.*s' for writing\n", StringExpand(options->port_output));
+				return 1;
+			}
+		}
+
+		if (!AttachFileDevice(sim, &g_file_device, FILE_DEVICE_PORT, port_input, port_output))
+		{
+			fprintf(stderr, "Failed to allocate the port table\n");
+			return 1;
+		}
+	}
+
+	// After the devices, which it goes in front of
+	Recording *rec = NULL;
+	if (options->record_file.count || options->replay_file.count || options->seek_count)
+	{
+		rec = &g_recording;
+		if (!StartRecording(rec, sim, options->checkpoint_every))
+		{
+			fprintf(stderr, "Failed to allocate the recording\n");
+			return 1;
+		}
+
+		if (options->replay_file.count && !ReadInputLog(rec, (const char *)options->replay_file.bytes))
+		{
+			fprintf(stderr, "Failed to read the inputs to replay from '%.*s'\n", StringExpand(options->replay_file));
+			return 1;
+		}
+	}
+
+	Tracer  tracer_storage;
+	Tracer *tracer = NULL;
+	if (options->trace_file.count)
+	{
+		tracer = &tracer_storage;
+		if (!StartTrace(tracer, sim, (const char *)options->trace_file.bytes))
+		{
+			fprintf(stderr, "Failed to start writing the trace to '%.*s'\n", StringExpand(options->trace_file));
+			return 1;
+		}
+	}
+
+	HotSpots  spots_storage;
+	HotSpots *spots = NULL;
+	if (options->hotspots)
+	{
+		spots = &spots_storage;
+		if (!AllocateHotSpots(spots))
+		{
+			fprintf(stderr, "Failed to allocate the hot spot counters, running without them\n");
+			spots = NULL;
+		}
+	}
+
+	printf("--- %.*s execution ---\n", StringExpand(file_name));
+
+	u64 start = ReadOSTimer();
+
+	u64 total_cycles = 0;
+
+	if (options->trace || options->cycles || tracer)
+	{
+		Buffer output =
+		{
+			.capacity = sizeof(g_output),
+			.bytes    = g_output,
+		};
+
+		Disassembler *disasm = &(Disassembler){ 0 };
+		DisassemblerParams disasm_params =
+		{
+			.input  = { .count = Kilobytes(64), .bytes = g_memory },
+			.output = output,
+		};
+		InitializeDisassembler(disasm, &disasm_params);
+
+		// With -trace, every line gets what the instruction changed
+		ChangeLog changes;
+		u8        changes_text[CHANGES_TEXT_MAX];
+		if (options->trace)
+		{
+			sim->changes = &changes;
+		}
+
+		ProfileZone("Execute & Trace")
+		{
+			Instruction scratch;
+			Instruction *inst;
+			while ((inst = FetchInstruction(sim, &scratch)) != NULL)
+			{
+				CycleEstimate estimate = { 0 };
+				if (options->cycles)
+				{
+					estimate      = EstimateCycles(sim, inst, options->cycle_model);
+					total_cycles += TotalCycles(&estimate);
+				}
+
+				if (spots)
+				{
+					CountHotSpot(spots, sim->ip, TotalCycles(&estimate));
+				}
+
+				if (options->trace)
+				{
+					DisassemblerResetOutput(disasm, output);
+					DisassembleInstruction(disasm, inst);
+					BeginChanges(sim);
+				}
+
+				if (tracer)
+				{
+					BeginTraceRecord(tracer, sim, inst);
+				}
+
+				ExecuteInstruction(sim, inst);
+
+				if (tracer)
+				{
+					EndTraceRecord(tracer, sim);
+				}
+
+				if (options->trace)
+				{
+					// The disassembly without its newline, then the course's
+					// "mov ax, 1 ; Clocks: +4 = 4 | ax:0x0->0x1 ip:0x0->0x3",
+					// a piece at a time rather than through printf
+					String result = DisassemblerResult(disasm);
+					fwrite(result.bytes, 1, result.count - 1, stdout);
+					fwrite(" ;", 1, 2, stdout);
+
+					if (options->cycles)
+					{
+						fputc(' ', stdout);
+						PrintCycleEstimate(stdout, &estimate, total_cycles);
+						fwrite(" |", 1, 2, stdout);
+					}
+
+					u32 count = FormatChanges(sim, changes_text);
+					changes_text[count++] = '\n';
+					fwrite(changes_text, 1, count, stdout);
+				}
+			}
+		}
+
+		sim->changes = NULL;
+	}
+	else if (options->breakpoints)
+	{
+		ProfileZone("Execute with Breakpoints")
+		{
+			Breakpoints *breaks = options->breakpoints;
+			for (;;)
+			{
+				RunWithBreakpoints(sim, breaks, 0);
+				if (breaks->reason == Break_None)
+				{
+					break;
+				}
+
+				PrintBreak(stdout, breaks, sim);
+			}
+		}
+	}
+	else if (options->sampler)
+	{
+		ProfileZone("Execute with Samples")
+		{
+			RunSampled(sim, options->sampler, stdout);
+		}
+	}
+	else if (rec)
+	{
+		ProfileZone("Execute & Record")
+		{
+			RunRecording(rec, 0);
+		}
+	}
+	else
+	{
+		ProfileZone("Execute")
+		{
+			RunBlocks(sim, 0);
+		}
+	}
+
+	u64 elapsed = ReadOSTimer() - start;
+
+	bool trace_failed = false;
+	if (tracer)
+	{
+		// Not timed, the simulator was only ever waiting on the writer when
+		// the ring was full
+		if (FinishTrace(tracer))
+		{
+			fprintf(stderr, "Traced %llu instructions in %llu bytes to %.*s\n",
+					(unsigned long long)tracer->record_count, (unsigned long long)tracer->byte_count,
+					StringExpand(options->trace_file));
+		}
+		else
+		{
+			fprintf(stderr, "Failed to write the trace to '%.*s'\n", StringExpand(options->trace_file));
+			trace_failed = true;
+		}
+	}
+
+	// Whatever the program wrote to its devices and hasn't gone out yet
+	bool port_output_failed = false;
+	if (options->ports)
+	{
+		FlushPortOutput(&g_console.out);
+	}
+
+	if (port_output)
+	{
+		if (!FlushPortOutput(&g_file_device.output) || fclose(port_output) != 0)
+		{
+			fprintf(stderr, "Failed to write the port output to '%.*s'\n", StringExpand(options->port_output));
+			port_output_failed = true;
+		}
+	}
+
+	if (port_input.bytes)
+	{
+		UnmapEntireFile(port_input);
+	}
+
+	if (sim->error)
+	{
+		fprintf(stderr, "Error at ip 0x%04x while executing %.*s:\n\t%.*s\n", sim->ip, StringExpand(file_name), StringExpand(sim->error_message));
+	}
+
+	// Seeking moves the machine away from how the run ended
+	bool sim_failed        = sim->error;
+	u64  instruction_count = sim->instruction_count;
+
+	printf("\n");
+	PrintRegisters(stdout, sim);
+
+	if (options->cycles)
+	{
+		printf("\nEstimated %s clocks: %llu", options->cycle_model == CycleModel_8088 ? "8088" : "8086",
+			   (unsigned long long)total_cycles);
+		if (sim->instruction_count)
+		{
+			printf(" (%.2f per instruction)", (double)total_cycles / (double)sim->instruction_count);
+		}
+		printf("\n");
+	}
+
+	if (spots)
+	{
+		PrintHotSpots(stdout, spots, sim);
+		FreeHotSpots(spots);
+	}
+
+	bool record_failed = false;
+	if (rec)
+	{
+		if (rec->diverged)
+		{
+			fprintf(stderr, "The run didn't read the ports recorded in '%.*s'\n", StringExpand(options->replay_file));
+			record_failed = true;
+		}
+
+		if (options->record_file.count)
+		{
+			if (!rec->out_of_memory && WriteInputLog(rec, (const char *)options->record_file.bytes))
+			{
+				fprintf(stderr, "Recorded %llu inputs to %.*s\n", (unsigned long long)rec->input_count, StringExpand(options->record_file));
+			}
+			else
+			{
+				fprintf(stderr, "Failed to record the inputs to '%.*s'\n", StringExpand(options->record_file));
+				record_failed = true;
+			}
+		}
+		else if (rec->out_of_memory)
+		{
+			fprintf(stderr, "Ran out of memory for checkpoints, seeking past %llu instructions replays from there\n",
+					(unsigned long long)rec->checkpoints[rec->checkpoint_count - 1].snapshot.instruction_count);
+		}
+
+		for (u32 index = 0; index < options->seek_count; index++)
+		{
+			u64 target = options->seeks[index];
+
+			u64  seek_start = ReadOSTimer();
+			bool reached    = SeekRecording(rec, target);
+			u64  seek_time  = ReadOSTimer() - seek_start;
+
+			if (reached)
+			{
+				printf("\nAfter %llu instructions:\n", (unsigned long long)target);
+				PrintRegisterLine(stdout, sim);
+			}
+			else if (rec->diverged)
+			{
+				printf("\nThe replay didn't read the recorded ports before %llu instructions\n", (unsigned long long)target);
+				record_failed = true;
+			}
+			else
+			{
+				printf("\nThe run ended after %llu instructions, before %llu\n",
+					   (unsigned long long)instruction_count, (unsigned long long)target);
+			}
+
+			fprintf(stderr, "Seek to %llu in %.3fms\n", (unsigned long long)target,
+					1000.0*(double)seek_time / (double)GetOSTimerFreq());
+		}
+
+		StopRecording(rec);
+	}
+
+	fflush(stdout);
+
+	double seconds = (double)elapsed / (double)GetOSTimerFreq();
+	fprintf(stderr, "%llu instructions in %.3fms\n", (unsigned long long)instruction_count, 1000.0*seconds);
+
+	return (sim_failed || trace_failed || port_output_failed || record_failed) ? 1 : 0;
+}
+
+int main(int argument_count, char **arguments)
+{
+	u32             file_count = 0;
+	StatsFileResult files[256];
 
 	bool show_bytes      = true;
 	int  show_bytes_base = 2;
 
+	bool profile = false;
+	bool perf    = false;
+
+	bool        exec         = false;
+	ExecOptions exec_options = { 0 };
+	Sampler     sampler      = { 0 };
+
+	bool print_trace = false;
+
+	bool   stats        = false;
+	u32    thread_count = 1;
+	String csv_name     = { 0 };
+
+	for (int argument_index = 1; argument_index < argument_count; argument_index++)
+	{
+		String argument = StringFromCString(arguments[argument_index]);
+
+		// --stats and -stats mean the same thing
+		if (argument.count > 2 && argument.bytes[0] == '-' && argument.bytes[1] == '-')
+		{
+			argument.bytes += 1;
+			argument.count -= 1;
+		}
+
+		bool has_value = (argument_index + 1 < argument_count);
+		String value = { 0 };
+		if (has_value)
+		{
+			value = StringFromCString(arguments[argument_index + 1]);
+		}
+
+		bool ok = true;
+
+		if (StringsAreEqual(argument, StringLit("-profile")))
+		{
+			profile = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-perf")))
+		{
+			perf = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-exec")))
+		{
+			exec = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-trace")))
+		{
+			exec               = true;
+			exec_options.trace = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-cycles")))
+		{
+			exec                = true;
+			exec_options.cycles = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-8088")))
+		{
+			exec                     = true;
+			exec_options.cycles      = true;
+			exec_options.cycle_model = CycleModel_8088;
+		}
+		else if (StringsAreEqual(argument, StringLit("-trace-file")) && has_value)
+		{
+			exec                    = true;
+			exec_options.trace_file = value;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-print-trace")))
+		{
+			print_trace = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-hotspots")))
+		{
+			exec                  = true;
+			exec_options.cycles   = true;
+			exec_options.hotspots = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-break")) && has_value)
+		{
+			u64 ip = ParseU64(value, &ok);
+			if (ok && ip <= 0xFFFF)
+			{
+				AddBreakpoint(&g_breakpoints, (u16)ip);
+			}
+			else
+			{
+				ok = false;
+			}
+
+			exec                     = true;
+			exec_options.breakpoints = &g_breakpoints;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-watch")) && has_value)
+		{
+			String address_string;
+			SplitString(&value, ':', &address_string);
+
+			u64 address = ParseU64(address_string, &ok);
+			u64 count   = 1;
+			if (ok && value.count)
+			{
+				count = ParseU64(value, &ok);
+			}
+
+			if (ok && !AddWatchpoint(&g_breakpoints, (u32)Min(address, SIM_MEMORY_SIZE), (u32)Min(count, SIM_MEMORY_SIZE)))
+			{
+				ok = false;
+			}
+
+			exec                     = true;
+			exec_options.breakpoints = &g_breakpoints;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-sample")) && has_value)
+		{
+			sampler.every_instructions = ParseU64(value, &ok);
+			if (!sampler.every_instructions)
+			{
+				ok = false;
+			}
+
+			exec                 = true;
+			exec_options.sampler = &sampler;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-sample-ms")) && has_value)
+		{
+			sampler.every_ms = ParseU64(value, &ok);
+			if (!sampler.every_ms)
+			{
+				ok = false;
+			}
+
+			exec                 = true;
+			exec_options.sampler = &sampler;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-record")) && has_value)
+		{
+			exec                     = true;
+			exec_options.record_file = value;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-replay")) && has_value)
+		{
+			exec                     = true;
+			exec_options.replay_file = value;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-checkpoint-every")) && has_value)
+		{
+			u64 millions = ParseU64(value, &ok);
+			if (!millions || millions > 1000000)
+			{
+				ok = false;
+			}
+
+			exec                          = true;
+			exec_options.checkpoint_every = millions*1000000;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-seek")) && has_value)
+		{
+			if (exec_options.seek_count < ArrayCount(exec_options.seeks))
+			{
+				exec_options.seeks[exec_options.seek_count++] = ParseU64(value, &ok);
+			}
+			else
+			{
+				ok = false;
+			}
+
+			exec = true;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-ports")))
+		{
+			exec               = true;
+			exec_options.ports = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-port-input")) && has_value)
+		{
+			exec                    = true;
+			exec_options.port_input = value;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-port-output")) && has_value)
+		{
+			exec                     = true;
+			exec_options.port_output = value;
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-icache")))
+		{
+			exec_options.icache = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-blocks")))
+		{
+			exec_options.blocks = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-jit")))
+		{
+			exec_options.blocks = true;
+			exec_options.jit    = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-stats")))
+		{
+			stats = true;
+		}
+		else if (StringsAreEqual(argument, StringLit("-threads")) && has_value)
+		{
+			u64 count = ParseU64(value, &ok);
+			thread_count = (u32)(count ? Min(count, 256) : GetProcessorCount());
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-csv")) && has_value)
+		{
+			csv_name = value;
+			argument_index++;
+		}
+		else if (argument.count && argument.bytes[0] != '-' && file_count < ArrayCount(files))
+		{
+			files[file_count++] = (StatsFileResult){ .file_name = argument };
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "Bad argument '%.*s'\n", StringExpand(argument));
+			PrintUsage(arguments[0]);
+			return 1;
+		}
+	}
+
+	if (exec_options.breakpoints && (exec_options.trace || exec_options.cycles || exec_options.trace_file.count))
+	{
+		fprintf(stderr, "-break and -watch don't combine with -trace, -cycles or -trace-file\n");
+		return 1;
+	}
+
+	bool recording = exec_options.record_file.count || exec_options.replay_file.count || exec_options.seek_count;
+	if (recording &&
+		(exec_options.trace || exec_options.cycles || exec_options.trace_file.count || exec_options.breakpoints || exec_options.sampler))
+	{
+		fprintf(stderr, "-record, -replay and -seek don't combine with -trace, -cycles, -trace-file, -break, -watch or -sample\n");
+		return 1;
+	}
+
+	if (exec_options.record_file.count && exec_options.replay_file.count)
+	{
+		fprintf(stderr, "-record and -replay don't combine\n");
+		return 1;
+	}
+
+	if (exec_options.sampler &&
+		(exec_options.trace || exec_options.cycles || exec_options.trace_file.count || exec_options.breakpoints))
+	{
+		fprintf(stderr, "-sample and -sample-ms don't combine with -trace, -cycles, -trace-file, -break or -watch\n");
+		return 1;
+	}
+
+	if (!file_count || (!stats && file_count > 1))
+	{
+		PrintUsage(arguments[0]);
+		return 1;
+	}
+
+	BeginProfile(profile);
+
+	if (stats)
+	{
+		int result = RunStats(file_count, files, thread_count, csv_name);
+
+		if (profile)
+		{
+			fflush(stdout);
+			EndAndPrintProfile(stderr);
+		}
+
+		return result;
+	}
+
+	String file_name = files[0].file_name;
+
+	if (print_trace)
+	{
+		// Traces outgrow g_input in no time
+		String trace = MapEntireFile((const char *)file_name.bytes);
+		if (!trace.bytes)
+		{
+			fprintf(stderr, "Failed to read file '%.*s'\n", StringExpand(file_name));
+			return 1;
+		}
+
+		int result = 0;
+		ProfileZone("Print Trace")
+		{
+			result = PrintTrace(stdout, trace) ? 0 : 1;
+		}
+		UnmapEntireFile(trace);
+
+		if (profile)
+		{
+			fflush(stdout);
+			EndAndPrintProfile(stderr);
+		}
+
+		return result;
+	}
+
 #if 0
 	ArgumentParser arg_parser;
 	InitializeArgumentParser(&arg_parser, argument_count, arguments, program_arguments);
@@ -196,13 +1019,17 @@ int main(int argument_count, char **arguments)
 	}
 #endif
 
-	file_name = StringFromCString(arguments[1]);
-
 	size_t bytes_read = 0;
-	ReadFileError error = ReadFileIntoMemory(arguments[1], g_input, sizeof(g_input), &bytes_read);
+	ReadFileError error = ReadFileError_None;
+
+	ProfileZone("Read Input")
+	{
+		error = ReadFileIntoMemory((const char *)file_name.bytes, g_input, sizeof(g_input), &bytes_read);
+	}
+
 	if (error != ReadFileError_None)
 	{
-		fprintf(stderr, "Failed to read file '%s' into memory!\n", arguments[1]);
+		fprintf(stderr, "Failed to read file '%.*s' into memory!\n", StringExpand(file_name));
 		return 1;
 	}
 
@@ -212,6 +1039,19 @@ int main(int argument_count, char **arguments)
 		.bytes = g_input,
 	};
 
+	if (exec)
+	{
+		int result = RunExecution(file_name, input, &exec_options);
+
+		if (profile)
+		{
+			fflush(stdout);
+			EndAndPrintProfile(stderr);
+		}
+
+		return result;
+	}
+
 	Buffer output =
 	{
 		.capacity = sizeof(g_output),
@@ -235,14 +1075,37 @@ int main(int argument_count, char **arguments)
 	};
 	InitializeDisassembler(disasm, &disasm_params);
 
+	PerfCounters  *perf_counters  = &(PerfCounters){ 0 };
+	PerfBreakdown *perf_breakdown = &(PerfBreakdown){ 0 };
+
+	if (perf)
+	{
+		OpenPerfCounters(perf_counters);
+		InitializePerfBreakdown(perf_breakdown, perf_counters);
+	}
+
 	printf("; disassembly for %.*s\n", StringExpand(file_name));
 	printf("bits 16\n");
 
+	ProfileZone("Decode & Disassemble")
 	for (;;)
 	{
 		Instruction inst;
 
-		if (!DecodeNextInstruction(decoder, &inst))
+		PerfCounterValues perf_start, perf_decoded, perf_disassembled;
+		if (perf)
+		{
+			ReadPerfCounters(perf_counters, &perf_start);
+		}
+
+		bool decoded = DecodeNextInstruction(decoder, &inst);
+
+		if (perf)
+		{
+			ReadPerfCounters(perf_counters, &perf_decoded);
+		}
+
+		if (!decoded)
 		{
 			if (decoder->error)
 			{
@@ -254,6 +1117,16 @@ int main(int argument_count, char **arguments)
 		DisassemblerResetOutput(disasm, output);
 		DisassembleInstruction(disasm, &inst);
 
+		if (perf)
+		{
+			ReadPerfCounters(perf_counters, &perf_disassembled);
+
+			DecodeKind kind = DecodeKindOfInstruction(decoder, &inst);
+			CountPerfInstruction(perf_breakdown, kind);
+			AccumulatePerfSample(perf_breakdown, PerfPhase_Decode,      kind, &perf_start,   &perf_decoded);
+			AccumulatePerfSample(perf_breakdown, PerfPhase_Disassemble, kind, &perf_decoded, &perf_disassembled);
+		}
+
 		if (disasm->error)
 		{
 			fprintf(stderr, "Error while disassembling %.*s:\n\t%.*s\n\n", StringExpand(file_name), StringExpand(disasm->error_message));
@@ -264,5 +1137,18 @@ int main(int argument_count, char **arguments)
 		printf("%.*s", StringExpand(result));
 	}
 
+	if (profile)
+	{
+		fflush(stdout);
+		EndAndPrintProfile(stderr);
+	}
+
+	if (perf)
+	{
+		fflush(stdout);
+		PrintPerfBreakdown(stderr, perf_counters, perf_breakdown);
+		ClosePerfCounters(perf_counters);
+	}
+
 	return 0;
 }
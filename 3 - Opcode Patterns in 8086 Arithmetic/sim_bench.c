@@ -0,0 +1,1575 @@
+#include "common.h"
+#include "platform.h"
+#include "random.h"
+#include "instruction.h"
+#include "decoder.h"
+#include "simulator.h"
+#include "io_ports.h"
+#include "block_cache.h"
+#include "jit.h"
+#include "emitter.h"
+#include "snapshot.h"
+#include "recording.h"
+#include "batch.h"
+#include "repetition_tester.h"
+
+//
+//
+//
+
+#include "platform.c"
+#include "decoder.c"
+#include "simulator.c"
+#include "io_ports.c"
+#include "block_cache.c"
+#include "jit.c"
+#include "emitter.c"
+#include "snapshot.c"
+#include "recording.c"
+#include "batch.c"
+#include "repetition_tester.c"
+
+//
+// Benchmark of the different ways the simulator can run a program, on loop
+// heavy workloads built with the emitter. Every mode has to end up in exactly
+// the same state as plain decode-and-execute before it gets timed.
+//
+
+typedef enum SimMode
+{
+	SimMode_Decode,
+	SimMode_InstructionCache,
+	SimMode_BlocksSwitch,
+	SimMode_BlocksEagerFlags,
+	SimMode_BlocksThreaded,
+	SimMode_BlocksFused,
+	SimMode_BlocksLoops,
+	SimMode_Jit,
+	SimMode_JitLoops,
+
+	SimMode_Count,
+} SimMode;
+
+global String sim_mode_names[SimMode_Count] =
+{
+	[SimMode_Decode]           = StringLitConst("decode every instruction"),
+	[SimMode_InstructionCache] = StringLitConst("instruction cache"),
+	[SimMode_BlocksSwitch]     = StringLitConst("basic blocks, switch"),
+	[SimMode_BlocksEagerFlags] = StringLitConst("basic blocks, threaded, eager flags"),
+	[SimMode_BlocksThreaded]   = StringLitConst("basic blocks, threaded"),
+	[SimMode_BlocksFused]      = StringLitConst("basic blocks, threaded, fused"),
+	[SimMode_BlocksLoops]      = StringLitConst("basic blocks, fused, loop idioms"),
+	[SimMode_Jit]              = StringLitConst("basic blocks, x86-64 JIT"),
+	[SimMode_JitLoops]         = StringLitConst("x86-64 JIT, loop idioms"),
+};
+
+typedef struct MachineState
+{
+	u16      words[Slot_Count];
+	u16      ip;
+	CPUFlags flags;
+	u64      instruction_count;
+	u64      memory_hash;
+	bool     error;
+} MachineState;
+
+function u64 HashMemory(u8 *memory, u64 size)
+{
+	// FNV-1a
+	u64 hash = 0xcbf29ce484222325ull;
+	for (u64 i = 0; i < size; i++)
+	{
+		hash = (hash ^ memory[i])*0x100000001b3ull;
+	}
+	return hash;
+}
+
+function MachineState CaptureState(Simulator *sim)
+{
+	MachineState result =
+	{
+		.ip                = sim->ip,
+		.flags             = ReadFlags(sim, 0xFFFF),
+		.instruction_count = sim->instruction_count,
+		.memory_hash       = HashMemory(sim->memory, SIM_MEMORY_SIZE),
+		.error             = sim->error,
+	};
+	memcpy(result.words, sim->regs.words, sizeof(result.words));
+	return result;
+}
+
+function bool StatesMatch(MachineState *a, MachineState *b)
+{
+	return memcmp(a->words, b->words, sizeof(a->words)) == 0 &&
+		   a->ip                == b->ip &&
+		   a->flags             == b->flags &&
+		   a->instruction_count == b->instruction_count &&
+		   a->memory_hash       == b->memory_hash &&
+		   a->error             == b->error;
+}
+
+function bool SetupMode(Simulator *sim, SimMode mode)
+{
+	bool result = true;
+
+	sim->eager_flags = (mode == SimMode_BlocksEagerFlags);
+
+	switch (mode)
+	{
+		case SimMode_Decode:
+		{
+			DisableInstructionCache(sim);
+			DisableBlockCache(sim);
+		} break;
+
+		case SimMode_InstructionCache:
+		{
+			DisableBlockCache(sim);
+			result = EnableInstructionCache(sim);
+		} break;
+
+		case SimMode_BlocksSwitch:
+		case SimMode_BlocksEagerFlags:
+		case SimMode_BlocksThreaded:
+		case SimMode_BlocksFused:
+		case SimMode_BlocksLoops:
+		case SimMode_Jit:
+		case SimMode_JitLoops:
+		{
+			// Whatever doesn't translate goes through the interpreter, with
+			// the instruction cache
+			result = EnableInstructionCache(sim) && EnableBlockCache(sim);
+			if (result)
+			{
+				sim->blocks->dispatch = (mode == SimMode_BlocksSwitch ? MicroDispatch_Switch : MicroDispatch_Threaded);
+				sim->blocks->fuse     = (mode >= SimMode_BlocksFused ? FusePairs_All : 0);
+				sim->blocks->loops    = (mode == SimMode_BlocksLoops || mode == SimMode_JitLoops);
+
+				if (mode == SimMode_Jit || mode == SimMode_JitLoops)
+				{
+					result = EnableJit(sim);
+				}
+				else
+				{
+					DisableJit(sim);
+				}
+			}
+		} break;
+
+		default:
+		{
+			result = false;
+		} break;
+	}
+
+	return result;
+}
+
+// Runs program from the start for max_instructions, 0 for all of it
+function void RunProgramFor(Simulator *sim, String program, u64 max_instructions)
+{
+	ResetSimulator(sim);
+	memset(sim->memory, 0, SIM_MEMORY_SIZE);
+	LoadProgram(sim, program);
+
+	if (sim->blocks)
+	{
+		RunBlocks(sim, max_instructions);
+	}
+	else
+	{
+		RunSimulator(sim, max_instructions);
+	}
+}
+
+function void RunProgram(Simulator *sim, String program)
+{
+	RunProgramFor(sim, program, 0);
+}
+
+//
+// Workloads. Each runs an inner loop of 1000 iterations inside an outer loop,
+// so the total iteration count can be scaled up to whatever takes long enough
+// to measure.
+//
+
+#define INNER_ITERATIONS 1000
+
+typedef void BuildWorkload(Emitter *e, u16 outer_iterations);
+
+// Register arithmetic and LOOP
+function void BuildSumLoop(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegReg(e, ADD, AX, CX);
+	EmitOpRegImm(e, ADD, BX, 3);
+	EmitJump(e, LOOP, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// The add/sub/cmp mix of listing 41 on registers and memory, closed off with
+// dec/jnz
+function void BuildListing41Style(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	EmitMovRegImm(e, BP, 0x1000);
+	EmitMovRegImm(e, SI, 0x10);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegImm(e, ADD, BX, 5);
+	EmitOpRegImm(e, SUB, BX, 2);
+	EmitOpRegReg(e, CMP, BX, AX);
+	EmitOpRegMem(e, ADD, AX, Mem(BP, SI, 0));
+	EmitOpMemImm(e, SUB, Mem(Reg_None, Reg_None, 0x2000), 1, true);
+	EmitOpMemReg(e, ADD, Mem(BP, SI, 4), BX);
+	EmitOpRegImm(e, CMP, SI, 0x10);
+	EmitIncDec(e, DEC, CX);
+	EmitJump(e, JNE, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// The register half of listing 41, which is all sums, so the loop idioms
+// can skip straight to the last iteration of every inner loop
+function void BuildListing41Registers(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	EmitMovRegImm(e, SI, 0x10);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegImm(e, ADD, BX, 5);
+	EmitOpRegImm(e, SUB, BX, 2);
+	EmitOpRegReg(e, CMP, BX, AX);
+	EmitOpRegReg(e, ADD, AX, SI);
+	EmitOpRegReg(e, SUB, DI, BX);
+	EmitOpRegImm(e, CMP, SI, 0x10);
+	EmitIncDec(e, DEC, CX);
+	EmitJump(e, JNE, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// Loads and stores walking through memory
+function void BuildMemoryWalk(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, SI, 0x1000);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegMem(e, MOV, AX, Mem(SI, Reg_None, 0));
+	EmitOpRegReg(e, ADD, AX, BX);
+	EmitOpMemReg(e, MOV, Mem(SI, Reg_None, 0), AX);
+	EmitOpRegImm(e, ADD, SI, 2);
+	EmitIncDec(e, INC, BX);
+	EmitIncDec(e, DEC, CX);
+	EmitJump(e, JNE, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// The movs of listings 39 and 40, through separate data, extra and stack
+// segments. The base registers walk over the end of the segments, so the
+// offsets wrap around, and now and then a word straddles the wrap.
+function void BuildSegmentedMovs(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, AX, 0x1000);
+	EmitMovSegReg(e, DS, AX);
+	EmitMovRegImm(e, AX, 0x2000);
+	EmitMovSegReg(e, ES, AX);
+	EmitMovRegImm(e, AX, 0x3000);
+	EmitMovSegReg(e, SS, AX);
+	EmitMovRegImm(e, SI, 4);
+	EmitMovRegImm(e, DI, 8);
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, BX, 0xFF00);
+	EmitMovRegImm(e, BP, 0xFFC0);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegMem(e, MOV, AL, Mem(BX, SI, 0));
+	EmitOpRegMem(e, MOV, AH, Mem(BX, SI, 4));
+	EmitOpMemReg(e, MOV, Mem(BP, DI, 0), AX);
+	EmitOpMemImm(e, MOV, Mem(BP, Reg_None, -37), 347, true);
+	EmitOpMemReg(e, MOV, Mem(BX, DI, -300), AX);
+	EmitOpMemReg(e, MOV, SegMem(ES, DI, Reg_None, 1000), AX);
+	EmitOpRegMem(e, MOV, AX, Mem(Reg_None, Reg_None, 2555));
+	EmitOpRegImm(e, ADD, BX, 3);
+	EmitOpRegImm(e, ADD, BP, 5);
+	EmitJump(e, LOOP, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// A data dependent branch in the middle of the loop
+function void BuildBranchy(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegReg(e, MOV, AX, CX);
+	EmitOpRegImm(e, AND, AX, 3);
+	EmitOpRegImm(e, CMP, AX, 1);
+	u32 skip = EmitJumpForward(e, JE);
+	EmitOpRegReg(e, ADD, BX, AX);
+	PatchJump(e, skip);
+	EmitOpRegReg(e, XOR, DI, BX);
+	EmitJump(e, LOOP, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// Mostly arithmetic, with flag results that are almost all overwritten
+// before anything reads them
+function void BuildFlagHeavy(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegReg(e, ADD, AX, CX);
+	EmitOpRegReg(e, ADC, BX, AX);
+	EmitOpRegImm(e, SUB, SI, 7);
+	EmitOpRegReg(e, SBB, DI, SI);
+	EmitOpRegReg(e, XOR, AX, DI);
+	EmitOpRegImm(e, AND, BX, 0x7FFF);
+	EmitOpRegReg(e, CMP, AX, BX);
+	u32 skip = EmitJumpForward(e, JL);
+	EmitIncDec(e, INC, BP);
+	PatchJump(e, skip);
+	EmitIncDec(e, DEC, CX);
+	EmitJump(e, JNE, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// Constants moved into a register right before the op that takes them
+function void BuildRegisterConstants(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitMovRegImm(e, AX, 7);
+	EmitOpRegReg(e, ADD, BX, AX);
+	EmitMovRegImm(e, SI, 0x55);
+	EmitOpRegReg(e, XOR, DI, SI);
+	EmitMovRegImm(e, AX, 3);
+	EmitOpRegReg(e, SUB, BP, AX);
+	EmitIncDec(e, DEC, CX);
+	EmitJump(e, JNE, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// Keeps its totals in words on the same page as its code, without ever
+// writing to the code itself
+function void BuildStoresNearCode(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitOpRegReg(e, ADD, BX, CX);
+	EmitOpMemReg(e, MOV, Mem(Reg_None, Reg_None, 0xF0), BX);
+	EmitOpMemReg(e, ADD, Mem(Reg_None, Reg_None, 0xF2), CX);
+	EmitJump(e, LOOP, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// Patches the immediate of an instruction it runs every iteration, then keeps
+// a running total in a word right after its own code, on the same page
+function void BuildSelfModifying(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	u32 patched = EmitLabel(e);
+	EmitMovRegImm(e, AX, 0);
+	EmitOpRegReg(e, ADD, BX, AX);
+	EmitOpMemReg(e, MOV, Mem(Reg_None, Reg_None, patched + 1), CX);
+	EmitOpMemReg(e, ADD, Mem(Reg_None, Reg_None, 0xF0), BX);
+	EmitOpRegReg(e, XOR, SI, BX);
+	EmitJump(e, LOOP, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+// Patches the last byte of a 7 byte instruction, a word store of an
+// immediate through an es: prefix, which a cache can only find again by
+// looking back far enough from the address written
+function void BuildSelfModifyingPrefixed(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, DX, outer_iterations);
+	u32 outer = EmitLabel(e);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	u32 patched = EmitLabel(e);
+	EmitOpMemImm(e, MOV, SegMem(ES, Reg_None, Reg_None, 0x2000), 0x1111, true);
+	EmitOpMemReg(e, MOV, Mem(Reg_None, Reg_None, patched + 6), CL);
+	EmitOpRegMem(e, ADD, BX, SegMem(ES, Reg_None, Reg_None, 0x2000));
+	EmitJump(e, LOOP, inner);
+	EmitIncDec(e, DEC, DX);
+	EmitJump(e, JNE, outer);
+}
+
+typedef struct Workload
+{
+	String         name;
+	BuildWorkload *build;
+	String         program;
+} Workload;
+
+global Workload g_workloads[] =
+{
+	{ StringLitConst("sum loop"),                      BuildSumLoop               },
+	{ StringLitConst("listing 0041 style"),            BuildListing41Style        },
+	{ StringLitConst("listing 0041 style, registers"), BuildListing41Registers    },
+	{ StringLitConst("memory walk"),                   BuildMemoryWalk            },
+	{ StringLitConst("listing 0039/0040 style movs"),  BuildSegmentedMovs         },
+	{ StringLitConst("branchy"),                       BuildBranchy               },
+	{ StringLitConst("flag heavy"),                    BuildFlagHeavy             },
+	{ StringLitConst("constants through registers"),   BuildRegisterConstants     },
+	{ StringLitConst("stores next to code"),           BuildStoresNearCode        },
+	{ StringLitConst("self-modifying"),                BuildSelfModifying         },
+	{ StringLitConst("self-modifying, prefixed"),      BuildSelfModifyingPrefixed },
+};
+
+global u8 g_program_buffers[ArrayCount(g_workloads)][1024];
+
+//
+// Lazy flags check. Every flag the simulator reports, and every condition a
+// jump can test, is compared against flags worked out from first principles:
+// exhaustively for 8-bit operands, on random operands for 16-bit ones.
+//
+
+function CPUFlags ReferenceFlags(Mnemonic op, u32 a, u32 b, u32 carry, bool wide)
+{
+	u32 bits = wide ? 16 : 8;
+	u32 mask = (1u << bits) - 1;
+
+	s32 signed_a = (s32)(a << (32 - bits)) >> (32 - bits);
+	s32 signed_b = (s32)(b << (32 - bits)) >> (32 - bits);
+	s32 min      = -(1 << (bits - 1));
+	s32 max      =  (1 << (bits - 1)) - 1;
+
+	u32 result = 0;
+	s32 signed_result = 0;
+
+	bool cf = false;
+	bool af = false;
+
+	switch (op)
+	{
+		case ADD:
+		case ADC:
+		case INC:
+		{
+			u32 carry_in = (op == ADC) ? carry : 0;
+			result        = a + b + carry_in;
+			signed_result = signed_a + signed_b + (s32)carry_in;
+			cf = (op == INC) ? !!carry : (result >> bits) != 0;
+			af = ((a & 0xF) + (b & 0xF) + carry_in) > 0xF;
+		} break;
+
+		case SUB:
+		case SBB:
+		case CMP:
+		case DEC:
+		{
+			u32 borrow_in = (op == SBB) ? carry : 0;
+			result        = a - b - borrow_in;
+			signed_result = signed_a - signed_b - (s32)borrow_in;
+			cf = (op == DEC) ? !!carry : a < b + borrow_in;
+			af = (a & 0xF) < (b & 0xF) + borrow_in;
+		} break;
+
+		case AND: { result = a & b; signed_result = (s32)(result << (32 - bits)) >> (32 - bits); } break;
+		case OR:  { result = a | b; signed_result = (s32)(result << (32 - bits)) >> (32 - bits); } break;
+		case XOR: { result = a ^ b; signed_result = (s32)(result << (32 - bits)) >> (32 - bits); } break;
+	}
+
+	result &= mask;
+
+	u32 set_bits = 0;
+	for (u32 bit = 0; bit < 8; bit++)
+	{
+		set_bits += (result >> bit) & 1;
+	}
+
+	CPUFlags flags = 0;
+	flags |= cf                                          ? CPUFlag_CF : 0;
+	flags |= (set_bits % 2 == 0)                         ? CPUFlag_PF : 0;
+	flags |= af                                          ? CPUFlag_AF : 0;
+	flags |= (result == 0)                               ? CPUFlag_ZF : 0;
+	flags |= (result >> (bits - 1))                      ? CPUFlag_SF : 0;
+	flags |= (signed_result < min || signed_result > max) ? CPUFlag_OF : 0;
+
+	return flags;
+}
+
+global Mnemonic g_flag_ops[] = { ADD, ADC, SUB, SBB, CMP, AND, OR, XOR, INC, DEC };
+
+// Returns false and says why on the first mismatch
+function bool CheckFlagsCase(Simulator *sim, Mnemonic op, u16 a, u16 b, u32 carry, bool wide)
+{
+	// Some earlier operation with a carry of its own left pending, the way
+	// adc, sbb, inc and dec find it
+	sim->lazy_flags = (LazyFlags){ 0 };
+	WriteFlags(sim, 0);
+	Arithmetic(sim, carry ? SUB : ADD, 0, (u16)carry, false);
+
+	if (op == INC || op == DEC)
+	{
+		b = 1;
+		IncDec(sim, op, a, wide);
+	}
+	else
+	{
+		Arithmetic(sim, op, a, b, wide);
+	}
+
+	CPUFlags expected = ReferenceFlags(op, a, b, carry, wide);
+
+	bool ok = (ReadFlags(sim, CPUFLAGS_ARITHMETIC) == expected);
+
+	for (u32 bit = 0; ok && bit < 16; bit++)
+	{
+		CPUFlags flag = (CPUFlags)(1 << bit);
+		ok = (ReadFlags(sim, flag) == (expected & flag));
+	}
+
+	for (Mnemonic jump = JO; ok && jump <= JG; jump++)
+	{
+		Simulator eager = *sim;
+		WriteFlags(&eager, expected);
+		ok = (ConditionHolds(sim, jump) == ConditionHolds(&eager, jump));
+	}
+
+	if (!ok)
+	{
+		printf("lazy flags MISMATCH: %.*s %s 0x%x, 0x%x with carry %u: got ",
+			   StringExpand(mnemonic_names[op]), wide ? "word" : "byte", a, b, carry);
+		PrintFlags(stdout, ReadFlags(sim, CPUFLAGS_ARITHMETIC));
+		printf(", expected ");
+		PrintFlags(stdout, expected);
+		printf("\n");
+	}
+
+	return ok;
+}
+
+function bool CheckLazyFlags(void)
+{
+	Simulator *sim = &(Simulator){ 0 };
+
+	u64 case_count = 0;
+
+	for (u32 op_index = 0; op_index < ArrayCount(g_flag_ops); op_index++)
+	{
+		Mnemonic op = g_flag_ops[op_index];
+
+		for (u32 carry = 0; carry < 2; carry++)
+		{
+			for (u32 a = 0; a < 256; a++)
+			{
+				for (u32 b = 0; b < 256; b++)
+				{
+					if (!CheckFlagsCase(sim, op, (u16)a, (u16)b, carry, false))
+					{
+						return false;
+					}
+					case_count++;
+				}
+			}
+		}
+	}
+
+	RandomSeries series = SeedRandom(8086);
+	for (u32 i = 0; i < 1000000; i++)
+	{
+		Mnemonic op    = g_flag_ops[RandomChoice(&series, ArrayCount(g_flag_ops))];
+		u32      value = RandomU32(&series);
+		u32      carry = RandomChoice(&series, 2);
+
+		u16 a = (u16)value;
+		u16 b = (u16)(value >> 16);
+
+		// Make sure the edges come up
+		switch (RandomChoice(&series, 8))
+		{
+			case 0: { b = a;                 } break;
+			case 1: { b = (u16)(0x8000 - a); } break;
+			case 2: { a = 0x7FFF;            } break;
+			case 3: { a = 0x8000;            } break;
+		}
+
+		if (!CheckFlagsCase(sim, op, a, b, carry, true))
+		{
+			return false;
+		}
+		case_count++;
+	}
+
+	printf("Lazy flags match on %llu cases\n", (unsigned long long)case_count);
+	return true;
+}
+
+//
+// Snapshots. Taking and restoring one a number of instructions after the
+// last, against copying all of memory, which is what they save doing.
+//
+
+#define SNAPSHOT_INTERVAL 10000
+
+//
+// Stopping partway. Every mode has to stop at an instruction limit in the
+// same state as decode and execute, flags included, even when the limit lands
+// in a stretch of loop iterations that got skipped in one go.
+//
+
+#define STOPPING_POINTS     16
+#define STOPPING_POINT_MAX  50000
+
+function bool CheckStoppingPoints(u8 *memory, Workload *workloads, u32 workload_count)
+{
+	Simulator *sim = &(Simulator){ 0 };
+	InitializeSimulator(sim, memory);
+
+	u64 case_count = 0;
+	bool ok = true;
+
+	RandomSeries series = SeedRandom(8088);
+	for (u32 workload_index = 0; ok && workload_index < workload_count; workload_index++)
+	{
+		Workload *workload = &workloads[workload_index];
+
+		for (u32 point = 0; ok && point < STOPPING_POINTS; point++)
+		{
+			u64 max_instructions = 1 + RandomChoice(&series, STOPPING_POINT_MAX);
+
+			sim->eager_flags = true;
+			DisableInstructionCache(sim);
+			DisableBlockCache(sim);
+			RunProgramFor(sim, workload->program, max_instructions);
+			MachineState reference = CaptureState(sim);
+
+			for (u32 mode = SimMode_InstructionCache; ok && mode < SimMode_Count; mode++)
+			{
+				if (!SetupMode(sim, mode))
+				{
+					continue;
+				}
+
+				RunProgramFor(sim, workload->program, max_instructions);
+				MachineState state = CaptureState(sim);
+				if (!StatesMatch(&state, &reference))
+				{
+					printf("stopping MISMATCH: %.*s after %llu instructions with %.*s\n",
+						   StringExpand(workload->name), (unsigned long long)max_instructions,
+						   StringExpand(sim_mode_names[mode]));
+					ok = false;
+				}
+				case_count++;
+			}
+		}
+	}
+
+	DisableInstructionCache(sim);
+	DisableBlockCache(sim);
+
+	if (ok)
+	{
+		printf("Stopping partway matches on %llu cases\n", (unsigned long long)case_count);
+	}
+	return ok;
+}
+
+//
+// Fusion a kind of pair at a time. Timed one after another like the modes
+// above, the few percent a pair is worth gets lost in how much a busy machine
+// drifts between them, so the settings here take turns instead.
+//
+
+typedef struct FusionSetting
+{
+	const char *name;
+	u32         pairs;
+} FusionSetting;
+
+global FusionSetting g_fusion_settings[] =
+{
+	{ "no fusion",               0                 },
+	{ "cmp/sub + jcc",           FusePairs_Compare },
+	{ "inc/dec + je/jne/js/jns", FusePairs_Count   },
+	{ "mov reg, imm + immed op", FusePairs_MovImm  },
+	{ "all pairs",               FusePairs_All     },
+};
+
+function void BenchFusion(Simulator *sim, Workload *workload, MachineState *reference, u64 cpu_timer_freq, u64 seconds)
+{
+	printf("  threaded blocks, fusion settings taking turns:\n");
+
+	if (!SetupMode(sim, SimMode_BlocksFused))
+	{
+		printf("    not available\n");
+		return;
+	}
+
+	RepetitionTester testers[ArrayCount(g_fusion_settings)];
+
+	for (u32 index = 0; index < ArrayCount(g_fusion_settings); index++)
+	{
+		FusionSetting *setting = &g_fusion_settings[index];
+
+		sim->blocks->fuse = setting->pairs;
+		RunProgram(sim, workload->program);
+
+		MachineState state = CaptureState(sim);
+		if (!StatesMatch(&state, reference))
+		{
+			printf("    %-34s MISMATCH, final state differs from plain decode and execute with eager flags\n", setting->name);
+			return;
+		}
+
+		// A tester's clock keeps running while the others take their turns,
+		// so each gets as long as all of them together
+		NewTestWave(&testers[index], cpu_timer_freq, (u32)(seconds*ArrayCount(g_fusion_settings)));
+	}
+
+	bool testing = true;
+	while (testing)
+	{
+		testing = false;
+		for (u32 index = 0; index < ArrayCount(g_fusion_settings); index++)
+		{
+			RepetitionTester *tester = &testers[index];
+			if (IsTesting(tester))
+			{
+				sim->blocks->fuse = g_fusion_settings[index].pairs;
+
+				BeginTime(tester);
+				RunProgram(sim, workload->program);
+				EndTime(tester);
+
+				testing = true;
+			}
+		}
+	}
+
+	double unfused = 0.0;
+	for (u32 index = 0; index < ArrayCount(g_fusion_settings); index++)
+	{
+		double seconds_taken           = SecondsFromCPUTime(testers[index].results.min_time, cpu_timer_freq);
+		double instructions_per_second = (double)reference->instruction_count / seconds_taken;
+		if (index == 0)
+		{
+			unfused = instructions_per_second;
+		}
+
+		printf("    %-34s %9.3fms %9.2f M inst/s %+6.1f%%\n", g_fusion_settings[index].name,
+			   1000.0*seconds_taken,
+			   instructions_per_second / 1000000.0,
+			   100.0*(instructions_per_second / unfused - 1.0));
+	}
+}
+
+global Snapshot g_snapshots[2];
+
+function void PrintSnapshotTime(const char *name, RepetitionTester *tester, u64 cpu_timer_freq, u32 pages_copied)
+{
+	double seconds = SecondsFromCPUTime(tester->results.min_time, cpu_timer_freq);
+	printf("  %-36s %9.3fus", name, 1000000.0*seconds);
+	if (pages_copied != (u32)-1)
+	{
+		printf(" %6u pages copied", pages_copied);
+	}
+	printf("\n");
+}
+
+function void BenchSnapshots(Simulator *sim, Workload *workload, MachineState *reference, u64 cpu_timer_freq, u64 seconds)
+{
+	printf("\nsnapshots of %.*s, %u instructions apart\n", StringExpand(workload->name), SNAPSHOT_INTERVAL);
+
+	SnapshotStore *store = &(SnapshotStore){ 0 };
+	InitializeSnapshots(store, sim);
+
+	Snapshot *start = &g_snapshots[0];
+	Snapshot *later = &g_snapshots[1];
+
+	ResetSimulator(sim);
+	memset(sim->memory, 0, SIM_MEMORY_SIZE);
+	LoadProgram(sim, workload->program);
+
+	if (!TakeSnapshot(store, start))
+	{
+		printf("  out of memory for snapshot pages\n");
+		return;
+	}
+
+	// Going back to the start has to give the same result as a fresh run
+	RunBlocks(sim, 0);
+	RestoreSnapshot(store, start);
+	RunBlocks(sim, 0);
+
+	MachineState state = CaptureState(sim);
+	if (!StatesMatch(&state, reference))
+	{
+		printf("  MISMATCH, running again from a restored snapshot ends up somewhere else\n");
+		return;
+	}
+
+	u8 *copy = AllocatePages(SIM_MEMORY_SIZE);
+	if (copy)
+	{
+		RepetitionTester *tester = &(RepetitionTester){ 0 };
+		NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+		while (IsTesting(tester))
+		{
+			BeginTime(tester);
+			memcpy(copy, sim->memory, SIM_MEMORY_SIZE);
+			EndTime(tester);
+		}
+		PrintSnapshotTime("copy all of memory", tester, cpu_timer_freq, SIM_PAGE_COUNT);
+
+		FreePages(copy, SIM_MEMORY_SIZE);
+	}
+
+	{
+		RepetitionTester *tester = &(RepetitionTester){ 0 };
+		NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+		while (IsTesting(tester))
+		{
+			RestoreSnapshot(store, start);
+			RunBlocks(sim, SNAPSHOT_INTERVAL);
+
+			BeginTime(tester);
+			TakeSnapshot(store, later);
+			EndTime(tester);
+
+			FreeSnapshot(store, later);
+		}
+		PrintSnapshotTime("take snapshot", tester, cpu_timer_freq, store->pages_copied);
+	}
+
+	{
+		RepetitionTester *tester = &(RepetitionTester){ 0 };
+		NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+		while (IsTesting(tester))
+		{
+			RunBlocks(sim, SNAPSHOT_INTERVAL);
+
+			BeginTime(tester);
+			RestoreSnapshot(store, start);
+			EndTime(tester);
+		}
+		PrintSnapshotTime("restore snapshot", tester, cpu_timer_freq, store->pages_copied);
+	}
+
+	FreeSnapshot(store, start);
+	FreeSnapshots(store);
+}
+
+//
+// Port I/O. A loop reading bytes from the file device and writing them back
+// out, so every other instruction is a port access through the table.
+//
+
+#define PORT_INPUT_SIZE INNER_ITERATIONS
+
+global u8         g_port_input[PORT_INPUT_SIZE];
+global FileDevice g_file_device;
+
+// Sums the input a byte at a time, echoing every byte to the output, and
+// goes back to the start of the input every outer iteration
+function void BuildPortLoop(Emitter *e, u16 outer_iterations)
+{
+	EmitMovRegImm(e, SI, outer_iterations);
+	EmitMovRegImm(e, DX, FILE_DEVICE_PORT + 1);
+	u32 outer = EmitLabel(e);
+	EmitOutDX(e, AL);
+	EmitIncDec(e, DEC, DX);
+	EmitMovRegImm(e, CX, INNER_ITERATIONS);
+	u32 inner = EmitLabel(e);
+	EmitInDX(e, AL);
+	EmitOpRegReg(e, ADD, BX, AX);
+	EmitOutDX(e, AL);
+	EmitJump(e, LOOP, inner);
+	EmitIncDec(e, INC, DX);
+	EmitIncDec(e, DEC, SI);
+	EmitJump(e, JNE, outer);
+}
+
+function void BenchPorts(Simulator *sim, u64 cpu_timer_freq, u64 seconds, u64 iterations)
+{
+	u16 outer_iterations = (u16)(iterations / INNER_ITERATIONS);
+
+	u8      code_bytes[64];
+	Emitter e = MakeEmitter(code_bytes, sizeof(code_bytes));
+	BuildPortLoop(&e, outer_iterations);
+	if (e.error)
+	{
+		printf("\nInternal error: failed to build the port loop\n");
+		return;
+	}
+	String program = EmittedCode(&e);
+
+	RandomSeries series = SeedRandom(0x300);
+	for (u32 index = 0; index < PORT_INPUT_SIZE; index++)
+	{
+		g_port_input[index] = (u8)RandomU32(&series);
+	}
+
+	String input =
+	{
+		.count = sizeof(g_port_input),
+		.bytes = g_port_input,
+	};
+
+	// Output goes nowhere, it's the trip through the table being measured
+	if (!AttachFileDevice(sim, &g_file_device, FILE_DEVICE_PORT, input, NULL))
+	{
+		printf("\nport table not available\n");
+		return;
+	}
+
+	u64 access_count = (u64)outer_iterations*(2*INNER_ITERATIONS + 1);
+
+	SetupMode(sim, SimMode_Decode);
+	RunProgram(sim, program);
+	MachineState reference = CaptureState(sim);
+
+	printf("\nport I/O through the file device: %llu bytes of code, %llu instructions, %llu port accesses%s\n",
+		   (unsigned long long)program.count, (unsigned long long)reference.instruction_count,
+		   (unsigned long long)access_count, reference.error ? " (stops on an error)" : "");
+
+	SimMode modes[] = { SimMode_InstructionCache, SimMode_BlocksFused, SimMode_Jit };
+	for (u32 mode_index = 0; mode_index < ArrayCount(modes); mode_index++)
+	{
+		SimMode mode = modes[mode_index];
+		printf("  %-36.*s", StringExpand(sim_mode_names[mode]));
+		fflush(stdout);
+
+		if (!SetupMode(sim, mode))
+		{
+			printf("not available\n");
+			continue;
+		}
+
+		RunProgram(sim, program);
+		MachineState state = CaptureState(sim);
+		if (!StatesMatch(&state, &reference))
+		{
+			printf("MISMATCH, final state differs from plain decode and execute\n");
+			continue;
+		}
+
+		RepetitionTester *tester = &(RepetitionTester){ 0 };
+		NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+		while (IsTesting(tester))
+		{
+			BeginTime(tester);
+			RunProgram(sim, program);
+			EndTime(tester);
+		}
+
+		double seconds_taken = SecondsFromCPUTime(tester->results.min_time, cpu_timer_freq);
+		printf("%9.3fms %9.2f M inst/s %7.2f M accesses/s\n",
+			   1000.0*seconds_taken,
+			   (double)reference.instruction_count / seconds_taken / 1000000.0,
+			   (double)access_count / seconds_taken / 1000000.0);
+	}
+
+	DisablePorts(sim);
+}
+
+//
+// Record and replay. The port loop recorded with checkpoints along the way,
+// then seeks to random points in it, each of which has to land on the same
+// state as a fresh run stopped there.
+//
+
+#define RECORD_SEEK_CHECKS 8
+
+global Recording g_recording;
+
+function void StartPortLoop(Simulator *sim, String program)
+{
+	String input =
+	{
+		.count = sizeof(g_port_input),
+		.bytes = g_port_input,
+	};
+
+	ResetSimulator(sim);
+	memset(sim->memory, 0, SIM_MEMORY_SIZE);
+	LoadProgram(sim, program);
+	AttachFileDevice(sim, &g_file_device, FILE_DEVICE_PORT, input, NULL);
+}
+
+function void BenchRecording(Simulator *sim, u64 cpu_timer_freq, u64 seconds, u64 iterations)
+{
+	u8      code_bytes[64];
+	Emitter e = MakeEmitter(code_bytes, sizeof(code_bytes));
+	BuildPortLoop(&e, (u16)(iterations / INNER_ITERATIONS));
+	String program = EmittedCode(&e);
+
+	// The JIT if there is one, it leaves the port accesses to the interpreter
+	if (!SetupMode(sim, SimMode_Jit))
+	{
+		SetupMode(sim, SimMode_BlocksFused);
+	}
+
+	StartPortLoop(sim, program);
+	RunBlocks(sim, 0);
+	u64 instruction_count = sim->instruction_count;
+	u64 checkpoint_every  = Max(instruction_count / 16, 1);
+
+	printf("\nrecording the port loop, %llu instructions, a checkpoint every %llu\n",
+		   (unsigned long long)instruction_count, (unsigned long long)checkpoint_every);
+
+	RandomSeries series = SeedRandom(0x5EE4);
+
+	u64          targets[RECORD_SEEK_CHECKS];
+	MachineState expected[RECORD_SEEK_CHECKS];
+	for (u32 index = 0; index < RECORD_SEEK_CHECKS; index++)
+	{
+		targets[index] = RandomU64(&series) % (instruction_count + 1);
+
+		StartPortLoop(sim, program);
+		if (targets[index])
+		{
+			RunBlocks(sim, targets[index]);
+		}
+		expected[index] = CaptureState(sim);
+	}
+
+	StartPortLoop(sim, program);
+
+	Recording *rec = &g_recording;
+	if (!StartRecording(rec, sim, checkpoint_every))
+	{
+		printf("  out of memory for the recording\n");
+		DisablePorts(sim);
+		return;
+	}
+
+	u64 start = ReadCPUTimer();
+	RunRecording(rec, 0);
+	u64 record_time = ReadCPUTimer() - start;
+
+	printf("  %-36s %9.3fms %6u checkpoints, %llu inputs\n", "record",
+		   1000.0*SecondsFromCPUTime(record_time, cpu_timer_freq), rec->checkpoint_count,
+		   (unsigned long long)rec->input_count);
+
+	for (u32 index = 0; index < RECORD_SEEK_CHECKS; index++)
+	{
+		bool reached = SeekRecording(rec, targets[index]);
+
+		MachineState state = CaptureState(sim);
+		if (!reached || !StatesMatch(&state, &expected[index]))
+		{
+			printf("  MISMATCH, seeking to %llu ends up somewhere else than running there\n",
+				   (unsigned long long)targets[index]);
+			StopRecording(rec);
+			DisablePorts(sim);
+			return;
+		}
+	}
+
+	RepetitionTester *tester = &(RepetitionTester){ 0 };
+	NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+	while (IsTesting(tester))
+	{
+		u64 target = RandomU64(&series) % (instruction_count + 1);
+
+		BeginTime(tester);
+		SeekRecording(rec, target);
+		EndTime(tester);
+	}
+
+	// The worst case is a whole interval of replay, so the maximum matters
+	// as much as the minimum
+	printf("  %-36s %9.3fms min %9.3fms max\n", "seek to a random instruction",
+		   1000.0*SecondsFromCPUTime(tester->results.min_time, cpu_timer_freq),
+		   1000.0*SecondsFromCPUTime(tester->results.max_time, cpu_timer_freq));
+
+	StopRecording(rec);
+	DisablePorts(sim);
+}
+
+//
+// Batches. One routine over lots of different inputs, run input after input
+// on a simulator in each of its modes, against BATCH_LANES inputs at a time
+// on the batch simulator.
+//
+
+#define BATCH_INPUT_COUNT 1024
+
+typedef struct BatchInput
+{
+	u16 seed;
+	u16 length;
+} BatchInput;
+
+global BatchInput     g_batch_inputs[BATCH_INPUT_COUNT];
+global BatchSimulator g_batch;
+
+// Fills in a table, then checksums a stretch of it starting from a seed. The
+// seed (DI) and the length of the stretch (BP) are the inputs. The branch in
+// the loop goes whichever way the data says, and the loop runs a different
+// number of times for different lengths, so lanes go their own ways.
+function void BuildChecksum(Emitter *e)
+{
+	EmitMovRegImm(e, SI, 0x1000);
+	EmitMovRegImm(e, CX, 128);
+	EmitMovRegImm(e, AX, 0x1234);
+	u32 fill = EmitLabel(e);
+	EmitOpRegImm(e, ADD, AX, 0x9E37);
+	EmitOpRegReg(e, XOR, AX, CX);
+	EmitOpMemReg(e, MOV, Mem(SI, Reg_None, 0), AX);
+	EmitOpRegImm(e, ADD, SI, 2);
+	EmitJump(e, LOOP, fill);
+
+	EmitMovRegImm(e, SI, 0x1000);
+	EmitOpRegReg(e, MOV, CX, BP);
+	EmitOpRegReg(e, MOV, BX, DI);
+	EmitOpRegReg(e, XOR, DX, DX);
+	u32 inner = EmitLabel(e);
+	EmitOpRegMem(e, MOV, AX, Mem(SI, Reg_None, 0));
+	EmitOpRegReg(e, XOR, AX, BX);
+	EmitOpRegReg(e, ADD, DX, AX);
+	EmitOpRegImm(e, ADC, DX, 0);
+	EmitOpRegImm(e, CMP, AX, 0x8000);
+	u32 skip = EmitJumpForward(e, JB);
+	EmitOpRegReg(e, ADD, BL, AH);
+	EmitIncDec(e, INC, BX);
+	PatchJump(e, skip);
+	EmitOpRegImm(e, ADD, SI, 2);
+	EmitJump(e, LOOP, inner);
+
+	EmitOpMemReg(e, MOV, Mem(Reg_None, Reg_None, 0x2000), DX);
+	EmitPush(e, BX);
+	EmitPop(e, AX);
+}
+
+function void SetBatchInputs(BatchSimulator *batch, u32 first)
+{
+	ResetBatch(batch);
+
+	for (u32 lane = 0; lane < BATCH_LANES; lane++)
+	{
+		WriteBatchRegister(batch, lane, DI, g_batch_inputs[first + lane].seed);
+		WriteBatchRegister(batch, lane, BP, g_batch_inputs[first + lane].length);
+	}
+}
+
+function void RunBatchInputs(BatchSimulator *batch)
+{
+	for (u32 first = 0; first < BATCH_INPUT_COUNT; first += BATCH_LANES)
+	{
+		SetBatchInputs(batch, first);
+		RunBatch(batch);
+	}
+}
+
+function void RunScalarInput(Simulator *sim, u32 index)
+{
+	ResetSimulator(sim);
+	WriteRegister(sim, DI, g_batch_inputs[index].seed);
+	WriteRegister(sim, BP, g_batch_inputs[index].length);
+
+	if (sim->blocks)
+	{
+		RunBlocks(sim, 0);
+	}
+	else
+	{
+		RunSimulator(sim, 0);
+	}
+}
+
+function bool LaneMatches(BatchSimulator *batch, u32 lane, Simulator *sim)
+{
+	bool result = (batch->ip[lane] == sim->ip &&
+				   ReadBatchFlags(batch, lane) == ReadFlags(sim, 0xFFFF) &&
+				   batch->instruction_counts[lane] == sim->instruction_count &&
+				   (batch->error[lane] != 0) == sim->error &&
+				   memcmp(BatchLaneMemory(batch, lane), sim->memory, SIM_MEMORY_SIZE) == 0);
+
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		if (batch->words[slot][lane] != sim->regs.words[slot])
+		{
+			result = false;
+		}
+	}
+
+	return result;
+}
+
+function void PrintBatchTime(RepetitionTester *tester, u64 cpu_timer_freq, u64 instruction_count)
+{
+	double seconds = SecondsFromCPUTime(tester->results.min_time, cpu_timer_freq);
+	printf("%9.3fms %9.2f M inst/s\n", 1000.0*seconds, (double)instruction_count / seconds / 1000000.0);
+}
+
+function void BenchBatch(Simulator *sim, u64 cpu_timer_freq, u64 seconds)
+{
+	u8      code_bytes[256];
+	Emitter e = MakeEmitter(code_bytes, sizeof(code_bytes));
+	BuildChecksum(&e);
+	if (e.error)
+	{
+		printf("\nInternal error: failed to build the checksum routine\n");
+		return;
+	}
+	String program = EmittedCode(&e);
+
+	RandomSeries series = SeedRandom(1024);
+	for (u32 index = 0; index < BATCH_INPUT_COUNT; index++)
+	{
+		g_batch_inputs[index].seed   = (u16)RandomU32(&series);
+		g_batch_inputs[index].length = (u16)(32 + RandomChoice(&series, 97));
+	}
+
+	printf("\nchecksum over %u different inputs: %llu bytes of code", BATCH_INPUT_COUNT, (unsigned long long)program.count);
+	fflush(stdout);
+
+	BatchSimulator *batch = &g_batch;
+	if (!InitializeBatch(batch))
+	{
+		printf("\n  batch simulator not available\n");
+		return;
+	}
+	LoadBatchProgram(batch, program);
+
+	// Every lane has to end up exactly where a plain simulator does with the
+	// same input
+	SetupMode(sim, SimMode_Decode);
+
+	u64 instruction_count = 0;
+	u64 step_count        = 0;
+
+	for (u32 first = 0; first < BATCH_INPUT_COUNT; first += BATCH_LANES)
+	{
+		SetBatchInputs(batch, first);
+		instruction_count += RunBatch(batch);
+		step_count        += batch->step_count;
+
+		for (u32 lane = 0; lane < BATCH_LANES; lane++)
+		{
+			memset(sim->memory, 0, SIM_MEMORY_SIZE);
+			LoadProgram(sim, program);
+			RunScalarInput(sim, first + lane);
+
+			if (!LaneMatches(batch, lane, sim))
+			{
+				printf("\n  MISMATCH, input %u ends up somewhere else in the batch than on its own\n", first + lane);
+				FreeBatch(batch);
+				return;
+			}
+		}
+	}
+
+	printf(", %llu instructions\n", (unsigned long long)instruction_count);
+
+	SimMode modes[] = { SimMode_InstructionCache, SimMode_BlocksFused, SimMode_Jit };
+	for (u32 mode_index = 0; mode_index < ArrayCount(modes); mode_index++)
+	{
+		SimMode mode = modes[mode_index];
+		printf("  %-36.*s", StringExpand(sim_mode_names[mode]));
+		fflush(stdout);
+
+		if (!SetupMode(sim, mode))
+		{
+			printf("not available\n");
+			continue;
+		}
+
+		memset(sim->memory, 0, SIM_MEMORY_SIZE);
+		LoadProgram(sim, program);
+
+		RepetitionTester *tester = &(RepetitionTester){ 0 };
+		NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+		while (IsTesting(tester))
+		{
+			BeginTime(tester);
+			for (u32 index = 0; index < BATCH_INPUT_COUNT; index++)
+			{
+				RunScalarInput(sim, index);
+			}
+			EndTime(tester);
+		}
+
+		// The batch is still holding the last few inputs
+		if (!LaneMatches(batch, BATCH_LANES - 1, sim))
+		{
+			printf("MISMATCH, the last input ends up somewhere else than in the batch\n");
+			continue;
+		}
+
+		PrintBatchTime(tester, cpu_timer_freq, instruction_count);
+	}
+
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "batch of %u lanes, AVX2", BATCH_LANES);
+		printf("  %-36s", name);
+		fflush(stdout);
+
+		RepetitionTester *tester = &(RepetitionTester){ 0 };
+		NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+		while (IsTesting(tester))
+		{
+			BeginTime(tester);
+			RunBatchInputs(batch);
+			EndTime(tester);
+		}
+
+		PrintBatchTime(tester, cpu_timer_freq, instruction_count);
+		printf("  %.2f of %u lanes busy on average\n", (double)instruction_count / (double)step_count, BATCH_LANES);
+	}
+
+	FreeBatch(batch);
+}
+
+function void PrintUsage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [-seconds N] [-iterations N] [-csv file] [8086 binaries...]\n", program);
+	fprintf(stderr, "  -iterations N  loop iterations per built-in workload, accepts k/m suffixes (default 1m)\n");
+}
+
+int main(int argument_count, char **arguments)
+{
+	u64    seconds    = 2;
+	u64    iterations = 1000000;
+	String csv_name   = { 0 };
+
+	u32      extra_count = 0;
+	Workload extra[16];
+
+	for (int argument_index = 1; argument_index < argument_count; argument_index++)
+	{
+		String argument = StringFromCString(arguments[argument_index]);
+
+		bool has_value = (argument_index + 1 < argument_count);
+		String value = { 0 };
+		if (has_value)
+		{
+			value = StringFromCString(arguments[argument_index + 1]);
+		}
+
+		bool ok = true;
+
+		if (StringsAreEqual(argument, StringLit("-seconds")) && has_value)
+		{
+			seconds = ParseU64(value, &ok);
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-iterations")) && has_value)
+		{
+			iterations = ParseU64(value, &ok);
+			ok &= (iterations >= INNER_ITERATIONS && iterations / INNER_ITERATIONS <= 0xFFFF);
+			argument_index++;
+		}
+		else if (StringsAreEqual(argument, StringLit("-csv")) && has_value)
+		{
+			csv_name = value;
+			argument_index++;
+		}
+		else if (argument.count && argument.bytes[0] != '-' && extra_count < ArrayCount(extra))
+		{
+			String program = MapEntireFile((const char *)argument.bytes);
+			if (!program.count || program.count > Kilobytes(64))
+			{
+				fprintf(stderr, "Couldn't read '%.*s' (or it's bigger than 64k)\n", StringExpand(argument));
+				return 1;
+			}
+			extra[extra_count++] = (Workload){ .name = argument, .program = program };
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "Bad argument '%.*s'\n", StringExpand(argument));
+			PrintUsage(arguments[0]);
+			return 1;
+		}
+	}
+
+	u32      workload_count = 0;
+	Workload workloads[ArrayCount(g_workloads) + ArrayCount(extra)];
+
+	for (u32 index = 0; index < ArrayCount(g_workloads); index++)
+	{
+		Workload *workload = &workloads[workload_count++];
+		*workload = g_workloads[index];
+
+		Emitter e = MakeEmitter(g_program_buffers[index], sizeof(g_program_buffers[index]));
+		workload->build(&e, (u16)(iterations / INNER_ITERATIONS));
+		if (e.error)
+		{
+			fprintf(stderr, "Internal error: failed to build '%.*s'\n", StringExpand(workload->name));
+			return 1;
+		}
+		workload->program = EmittedCode(&e);
+	}
+
+	for (u32 index = 0; index < extra_count; index++)
+	{
+		workloads[workload_count++] = extra[index];
+	}
+
+	FILE *csv = NULL;
+	if (csv_name.count)
+	{
+		csv = fopen((const char *)csv_name.bytes, "ab");
+		if (!csv)
+		{
+			fprintf(stderr, "Couldn't open '%.*s' for writing\n", StringExpand(csv_name));
+			return 1;
+		}
+	}
+
+	u8 *memory = AllocatePages(SIM_MEMORY_SIZE);
+	if (!memory)
+	{
+		fprintf(stderr, "Failed to allocate simulator memory\n");
+		return 1;
+	}
+
+	if (!CheckLazyFlags() || !CheckStoppingPoints(memory, workloads, workload_count))
+	{
+		return 1;
+	}
+
+	u64 cpu_timer_freq = EstimateCPUTimerFreq();
+	printf("CPU timer frequency: %llu\n", (unsigned long long)cpu_timer_freq);
+
+	for (u32 workload_index = 0; workload_index < workload_count; workload_index++)
+	{
+		Workload *workload = &workloads[workload_index];
+
+		Simulator *sim = &(Simulator){ 0 };
+		InitializeSimulator(sim, memory);
+
+		sim->eager_flags = true;
+		RunProgram(sim, workload->program);
+		MachineState reference = CaptureState(sim);
+
+		printf("\n%.*s: %llu bytes of code, %llu instructions%s\n", StringExpand(workload->name),
+			   (unsigned long long)workload->program.count, (unsigned long long)reference.instruction_count,
+			   reference.error ? " (stops on an error)" : "");
+
+		for (u32 mode = 0; mode < SimMode_Count; mode++)
+		{
+			printf("  %-36.*s", StringExpand(sim_mode_names[mode]));
+			fflush(stdout);
+
+			if (!SetupMode(sim, mode))
+			{
+				printf("not available\n");
+				continue;
+			}
+
+			RunProgram(sim, workload->program);
+			MachineState state = CaptureState(sim);
+			if (!StatesMatch(&state, &reference))
+			{
+				printf("MISMATCH, final state differs from plain decode and execute with eager flags\n");
+				continue;
+			}
+
+			RepetitionTester *tester = &(RepetitionTester){ 0 };
+			NewTestWave(tester, cpu_timer_freq, (u32)seconds);
+			while (IsTesting(tester))
+			{
+				BeginTime(tester);
+				RunProgram(sim, workload->program);
+				EndTime(tester);
+			}
+
+			u64    min_time      = tester->results.min_time;
+			double seconds_taken = SecondsFromCPUTime(min_time, cpu_timer_freq);
+
+			double instructions_per_second = (double)reference.instruction_count / seconds_taken;
+			double cycles_per_instruction  = (double)min_time / (double)reference.instruction_count;
+
+			printf("%9.3fms %9.2f M inst/s %7.2f cycles/inst\n",
+				   1000.0*seconds_taken,
+				   instructions_per_second / 1000000.0,
+				   cycles_per_instruction);
+
+			if (csv)
+			{
+				fprintf(csv, "%.*s,%.*s,%llu,%f,%f,%f\n",
+						StringExpand(workload->name),
+						StringExpand(sim_mode_names[mode]),
+						(unsigned long long)reference.instruction_count,
+						seconds_taken,
+						instructions_per_second,
+						cycles_per_instruction);
+			}
+		}
+
+		// The self-modifying ones spend their time translating blocks again
+		if (workload->build != BuildSelfModifying && workload->build != BuildSelfModifyingPrefixed)
+		{
+			BenchFusion(sim, workload, &reference, cpu_timer_freq, seconds);
+		}
+
+		if (workload->build == BuildMemoryWalk)
+		{
+			// The JIT if there is one, it marks pages dirty by itself
+			if (!SetupMode(sim, SimMode_Jit))
+			{
+				SetupMode(sim, SimMode_BlocksFused);
+			}
+			BenchSnapshots(sim, workload, &reference, cpu_timer_freq, seconds);
+		}
+
+		DisableInstructionCache(sim);
+		DisableBlockCache(sim);
+	}
+
+	{
+		Simulator *sim = &(Simulator){ 0 };
+		InitializeSimulator(sim, memory);
+
+		BenchPorts(sim, cpu_timer_freq, seconds, iterations);
+		BenchRecording(sim, cpu_timer_freq, seconds, iterations);
+
+		DisableInstructionCache(sim);
+		DisableBlockCache(sim);
+	}
+
+	{
+		Simulator *sim = &(Simulator){ 0 };
+		InitializeSimulator(sim, memory);
+
+		BenchBatch(sim, cpu_timer_freq, seconds);
+
+		DisableInstructionCache(sim);
+		DisableBlockCache(sim);
+	}
+
+	if (csv)
+	{
+		fclose(csv);
+	}
+
+	return 0;
+}
@@ -0,0 +1,1094 @@
+global u8 register_byte_offsets[] =
+{
+	[AL] = 0,  [CL] = 2,  [DL] = 4,  [BL] = 6,
+	[AH] = 1,  [CH] = 3,  [DH] = 5,  [BH] = 7,
+
+	[AX] = 2*Slot_AX, [CX] = 2*Slot_CX, [DX] = 2*Slot_DX, [BX] = 2*Slot_BX,
+	[SP] = 2*Slot_SP, [BP] = 2*Slot_BP, [SI] = 2*Slot_SI, [DI] = 2*Slot_DI,
+
+	[ES] = 2*Slot_ES, [CS] = 2*Slot_CS, [SS] = 2*Slot_SS, [DS] = 2*Slot_DS,
+};
+
+function Register RegisterOfSlot(u32 slot)
+{
+	return (Register)(slot < Slot_ES ? AX + slot : ES + (slot - Slot_ES));
+}
+
+function void InitializeSimulator(Simulator *sim, u8 *memory)
+{
+	ZeroStruct(sim);
+	sim->memory = memory;
+
+	String address_space =
+	{
+		.count = Kilobytes(64),
+		.bytes = memory,
+	};
+	InitializeDecoder(&sim->decoder, address_space);
+}
+
+function void ResetSimulator(Simulator *sim)
+{
+	ZeroStruct(&sim->regs);
+	ZeroStruct(&sim->segment_bases);
+	sim->segments_wrap = false;
+
+	sim->ip                = 0;
+	sim->flags             = 0;
+	sim->lazy_flags.kind   = LazyFlags_None;
+	sim->instruction_count = 0;
+	sim->decoder.error     = false;
+	sim->error             = false;
+}
+
+function void SimulatorError(Simulator *sim, String message)
+{
+	if (!sim->error)
+	{
+		sim->error_message = message;
+	}
+
+	sim->error = true;
+}
+
+function bool LoadProgram(Simulator *sim, String code)
+{
+	if (code.count > Kilobytes(64))
+	{
+		SimulatorError(sim, StringLit("Program does not fit in 64k"));
+		return false;
+	}
+
+	memcpy(sim->memory, code.bytes, code.count);
+	MarkMemoryDirty(sim, 0, (u32)code.count);
+	sim->code_end = (u32)code.count;
+	sim->ip       = 0;
+
+	InvalidateInstructionCache(sim, 0, sim->code_end);
+
+	if (sim->blocks)
+	{
+		FlushBlockCache(sim->blocks);
+	}
+
+	// Nothing is decoded from anywhere now
+	ZeroStruct(&sim->code_pages);
+	ZeroStruct(&sim->code_bytes);
+
+	return true;
+}
+
+function bool EnableInstructionCache(Simulator *sim)
+{
+	if (!sim->icache)
+	{
+		// Only the pages holding code ever get touched
+		sim->icache = AllocatePages(SIM_ICACHE_ENTRY_COUNT*sizeof(Instruction));
+	}
+
+	return sim->icache != NULL;
+}
+
+function void DisableInstructionCache(Simulator *sim)
+{
+	FreePages(sim->icache, SIM_ICACHE_ENTRY_COUNT*sizeof(Instruction));
+	sim->icache = NULL;
+}
+
+function void InvalidateInstructionCache(Simulator *sim, u32 address, u32 count)
+{
+	if (sim->icache)
+	{
+		// An instruction that starts before address can still overlap it
+		u32 start = address >= INSTRUCTION_MAX_BYTES - 1 ? address - (INSTRUCTION_MAX_BYTES - 1) : 0;
+		u32 end   = Min(address + count, SIM_ICACHE_ENTRY_COUNT);
+
+		for (u32 at = start; at < end; at++)
+		{
+			sim->icache[at].source_byte_count = 0;
+		}
+	}
+}
+
+//
+// Registers and memory
+//
+
+function u16 ReadRegister(Simulator *sim, Register reg)
+{
+	u8 offset = register_byte_offsets[reg];
+	return reg >= AX ? sim->regs.words[offset / 2] : sim->regs.bytes[offset];
+}
+
+// Before a register write, see ChangeLog
+force_inline void LogRegisterWrite(Simulator *sim, u32 slot)
+{
+	ChangeLog *changes = sim->changes;
+	if (changes && !(changes->written_slots & (1 << slot)))
+	{
+		changes->written_slots   |= (u16)(1 << slot);
+		changes->old_words[slot]  = sim->regs.words[slot];
+	}
+}
+
+function void WriteRegister(Simulator *sim, Register reg, u16 value)
+{
+	u8 offset = register_byte_offsets[reg];
+	LogRegisterWrite(sim, offset / 2);
+
+	if (reg >= AX)
+	{
+		sim->regs.words[offset / 2] = value;
+
+		if (reg >= ES)
+		{
+			sim->segment_bases[offset / 2] = (u32)value << 4;
+
+			sim->segments_wrap = false;
+			for (u32 slot = Slot_ES; slot <= Slot_DS; slot++)
+			{
+				if (sim->segment_bases[slot] > SIM_MEMORY_SIZE - Kilobytes(64))
+				{
+					sim->segments_wrap = true;
+				}
+			}
+		}
+	}
+	else
+	{
+		sim->regs.bytes[offset] = (u8)value;
+	}
+}
+
+function u32 SegmentBaseOf(Simulator *sim, EffectiveAddress *ea)
+{
+	return sim->segment_bases[register_byte_offsets[SegmentOfAddress(ea)] / 2];
+}
+
+// The offset part of the address
+function u16 EffectiveAddressOf(Simulator *sim, EffectiveAddress *ea)
+{
+	u16 address = (u16)ea->disp;
+
+	if (ea->reg1)
+	{
+		address += ReadRegister(sim, ea->reg1);
+	}
+
+	if (ea->reg2)
+	{
+		address += ReadRegister(sim, ea->reg2);
+	}
+
+	return address;
+}
+
+function u32 LinearAddress(u32 segment_base, u16 offset)
+{
+	return (segment_base + offset) & (SIM_MEMORY_SIZE - 1);
+}
+
+// The second byte of a word is at the next offset, so a word at offset 0xFFFF
+// wraps around to the start of its segment rather than running past it
+function u16 ReadMemory(Simulator *sim, u32 segment_base, u16 offset, bool wide)
+{
+	u16 result = sim->memory[LinearAddress(segment_base, offset)];
+	if (wide)
+	{
+		result |= (u16)(sim->memory[LinearAddress(segment_base, (u16)(offset + 1))] << 8);
+	}
+	return result;
+}
+
+// Whether either cache decoded the byte at address, see Simulator.code_bytes.
+// Only pages in the first 64k are ever marked, so the bit is always there.
+function bool IsCodeByte(Simulator *sim, u32 address)
+{
+	return sim->code_pages[address >> SIM_PAGE_SHIFT] && (sim->code_bytes[address >> 3] & (1 << (address & 7)));
+}
+
+function void WriteMemory(Simulator *sim, u32 segment_base, u16 offset, bool wide, u16 value)
+{
+	ChangeLog *changes = sim->changes;
+	if (changes && changes->memory_change_count < MAX_MEMORY_WRITES)
+	{
+		MemoryChange *change = &changes->memory_changes[changes->memory_change_count++];
+		change->write.segment_base = segment_base;
+		change->write.offset       = offset;
+		change->write.wide         = wide;
+		change->old_value          = ReadMemory(sim, segment_base, offset, wide);
+	}
+
+	u32 address = LinearAddress(segment_base, offset);
+	sim->memory[address] = (u8)value;
+	sim->dirty_pages[address >> SIM_PAGE_SHIFT] = 1;
+
+	if (IsCodeByte(sim, address))
+	{
+		InvalidateCode(sim, address, 1);
+	}
+
+	if (wide)
+	{
+		address = LinearAddress(segment_base, (u16)(offset + 1));
+		sim->memory[address] = (u8)(value >> 8);
+		sim->dirty_pages[address >> SIM_PAGE_SHIFT] = 1;
+
+		if (IsCodeByte(sim, address))
+		{
+			InvalidateCode(sim, address, 1);
+		}
+	}
+}
+
+function void MarkMemoryDirty(Simulator *sim, u32 address, u32 count)
+{
+	if (count)
+	{
+		u32 first = (address & (SIM_MEMORY_SIZE - 1)) >> SIM_PAGE_SHIFT;
+		u32 last  = ((address + count - 1) & (SIM_MEMORY_SIZE - 1)) >> SIM_PAGE_SHIFT;
+
+		// Around the end of memory and back to the start, when it wraps
+		for (u32 page = first; page != last; page = (page + 1) % SIM_PAGE_COUNT)
+		{
+			sim->dirty_pages[page] = 1;
+			if (sim->code_pages[page])
+			{
+				InvalidateCode(sim, page << SIM_PAGE_SHIFT, SIM_PAGE_SIZE);
+			}
+		}
+
+		sim->dirty_pages[last] = 1;
+		if (sim->code_pages[last])
+		{
+			InvalidateCode(sim, last << SIM_PAGE_SHIFT, SIM_PAGE_SIZE);
+		}
+	}
+}
+
+// Code only ever runs out of the first 64k, see Simulator.memory
+function void MarkCodePages(Simulator *sim, u32 address, u32 count)
+{
+	u32 end = Min(address + count, Kilobytes(64));
+	for (u32 page = address >> SIM_PAGE_SHIFT; page < (end + SIM_PAGE_SIZE - 1) >> SIM_PAGE_SHIFT; page++)
+	{
+		sim->code_pages[page] = 1;
+	}
+
+	for (u32 at = address; at < end; at++)
+	{
+		sim->code_bytes[at >> 3] |= (u8)(1 << (at & 7));
+	}
+}
+
+function void InvalidateCode(Simulator *sim, u32 address, u32 count)
+{
+	if (address < Kilobytes(64))
+	{
+		InvalidateInstructionCache(sim, address, count);
+
+		if (sim->blocks)
+		{
+			InvalidateBlocks(sim->blocks, address, count);
+		}
+	}
+}
+
+function u16 ReadOperand(Simulator *sim, Operand *operand, bool wide)
+{
+	u16 result = 0;
+
+	switch (operand->kind)
+	{
+		case Operand_Reg:
+		case Operand_SegReg:
+		{
+			result = ReadRegister(sim, operand->reg);
+		} break;
+
+		case Operand_Mem:
+		{
+			result = ReadMemory(sim, SegmentBaseOf(sim, &operand->mem), EffectiveAddressOf(sim, &operand->mem), wide);
+		} break;
+	}
+
+	return result;
+}
+
+function void WriteOperand(Simulator *sim, Operand *operand, bool wide, u16 value)
+{
+	switch (operand->kind)
+	{
+		case Operand_Reg:
+		case Operand_SegReg:
+		{
+			WriteRegister(sim, operand->reg, value);
+		} break;
+
+		case Operand_Mem:
+		{
+			WriteMemory(sim, SegmentBaseOf(sim, &operand->mem), EffectiveAddressOf(sim, &operand->mem), wide, value);
+		} break;
+	}
+}
+
+// The decoder doesn't keep the W bit around, but a register operand tells us
+// the width, and so does the size of the immediate. What's left are the
+// single memory operand forms (push/pop/inc/dec/call/jmp through ff and 8f),
+// which are all word sized.
+function bool InstructionIsWide(Instruction *inst)
+{
+	bool result = true;
+
+	if (inst->op1.kind == Operand_Reg)
+	{
+		result = (inst->op1.reg >= AX);
+	}
+	else if (inst->op2.kind == Operand_Reg)
+	{
+		result = (inst->op2.reg >= AX);
+	}
+	else if (inst->flags & InstructionFlag_DataLO)
+	{
+		result = !!(inst->flags & InstructionFlag_DataHI);
+	}
+
+	return result;
+}
+
+function u32 AddOperandWrite(Simulator *sim, Operand *operand, bool wide, MemoryWrite *write)
+{
+	u32 result = 0;
+
+	if (operand->kind == Operand_Mem)
+	{
+		write->segment_base = SegmentBaseOf(sim, &operand->mem);
+		write->offset       = EffectiveAddressOf(sim, &operand->mem);
+		write->wide         = wide;
+		result = 1;
+	}
+
+	return result;
+}
+
+function u32 MemoryWritesOf(Simulator *sim, Instruction *inst, MemoryWrite *writes)
+{
+	u32 result = 0;
+
+	bool wide = InstructionIsWide(inst);
+
+	// The same operands ExecuteInstruction writes to
+	switch (inst->mnemonic)
+	{
+		case MOV:
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		case INC:
+		case DEC:
+		{
+			result += AddOperandWrite(sim, &inst->op1, wide, &writes[result]);
+		} break;
+
+		case XCHG:
+		{
+			result += AddOperandWrite(sim, &inst->op1, wide, &writes[result]);
+			result += AddOperandWrite(sim, &inst->op2, wide, &writes[result]);
+		} break;
+
+		case POP:
+		{
+			result += AddOperandWrite(sim, &inst->op1, true, &writes[result]);
+		} break;
+
+		case PUSH:
+		case CALL:
+		{
+			MemoryWrite *write = &writes[result++];
+			write->segment_base = sim->segment_bases[Slot_SS];
+			write->offset       = (u16)(sim->regs.words[Slot_SP] - 2);
+			write->wide         = true;
+		} break;
+	}
+
+	return result;
+}
+
+function u16 SourceValue(Simulator *sim, Instruction *inst, bool wide)
+{
+	u16 result;
+
+	if (inst->flags & InstructionFlag_DataLO)
+	{
+		result = wide ? (u16)inst->data : inst->data_lo;
+	}
+	else
+	{
+		result = ReadOperand(sim, &inst->op2, wide);
+	}
+
+	return result;
+}
+
+//
+// Flags
+//
+
+function bool EvenParity(u8 value)
+{
+	value ^= value >> 4;
+	value ^= value >> 2;
+	value ^= value >> 1;
+	return !(value & 1);
+}
+
+// Works out the wanted arithmetic flags of the recorded operation. Inlined
+// with a constant wanted, this is only the handful of instructions for those
+// flags.
+force_inline CPUFlags EvaluateLazyFlags(LazyFlags *lazy, CPUFlags wanted)
+{
+	u32 sign = lazy->wide ? 0x8000 : 0x80;
+	u32 mask = lazy->wide ? 0xFFFF : 0xFF;
+
+	u32 a      = lazy->a;
+	u32 b      = lazy->b;
+	u32 result = lazy->result;
+
+	bool adds  = (lazy->kind == LazyFlags_Add || lazy->kind == LazyFlags_Inc);
+	bool logic = (lazy->kind == LazyFlags_Logic);
+
+	CPUFlags flags = 0;
+
+	if ((wanted & CPUFlag_ZF) && !result)
+	{
+		flags |= CPUFlag_ZF;
+	}
+
+	if ((wanted & CPUFlag_SF) && (result & sign))
+	{
+		flags |= CPUFlag_SF;
+	}
+
+	if ((wanted & CPUFlag_PF) && EvenParity((u8)result))
+	{
+		flags |= CPUFlag_PF;
+	}
+
+	if (wanted & CPUFlag_CF)
+	{
+		bool carry = false;
+
+		switch (lazy->kind)
+		{
+			case LazyFlags_Add: { carry = (a + b + lazy->carry > mask); } break;
+			case LazyFlags_Sub: { carry = (a < b + lazy->carry);        } break;
+			case LazyFlags_Inc:
+			case LazyFlags_Dec: { carry = !!lazy->carry;                } break;
+		}
+
+		if (carry)
+		{
+			flags |= CPUFlag_CF;
+		}
+	}
+
+	if ((wanted & CPUFlag_OF) && !logic)
+	{
+		u32 overflow = adds ? (a ^ result) & (b ^ result) : (a ^ b) & (a ^ result);
+		if (overflow & sign)
+		{
+			flags |= CPUFlag_OF;
+		}
+	}
+
+	if ((wanted & CPUFlag_AF) && !logic && ((a ^ b ^ result) & 0x10))
+	{
+		flags |= CPUFlag_AF;
+	}
+
+	return flags;
+}
+
+force_inline CPUFlags ReadFlagsInline(Simulator *sim, CPUFlags wanted)
+{
+	CPUFlags result = sim->flags & wanted;
+
+	if (sim->lazy_flags.kind != LazyFlags_None && (wanted & CPUFLAGS_ARITHMETIC))
+	{
+		result &= ~CPUFLAGS_ARITHMETIC;
+		result |= EvaluateLazyFlags(&sim->lazy_flags, wanted & CPUFLAGS_ARITHMETIC);
+	}
+
+	return result;
+}
+
+function CPUFlags ReadFlags(Simulator *sim, CPUFlags wanted)
+{
+	return ReadFlagsInline(sim, wanted);
+}
+
+function void WriteFlags(Simulator *sim, CPUFlags flags)
+{
+	sim->flags           = flags;
+	sim->lazy_flags.kind = LazyFlags_None;
+}
+
+function void RecordFlags(Simulator *sim, LazyFlagsKind kind, u16 a, u16 b, u32 result, bool wide, u32 carry)
+{
+	LazyFlags *lazy = &sim->lazy_flags;
+	lazy->kind   = kind;
+	lazy->wide   = wide;
+	lazy->carry  = (u8)carry;
+	lazy->a      = a;
+	lazy->b      = b;
+	lazy->result = (u16)result;
+
+	if (sim->eager_flags)
+	{
+		WriteFlags(sim, (CPUFlags)((sim->flags & ~CPUFLAGS_ARITHMETIC) | EvaluateLazyFlags(lazy, CPUFLAGS_ARITHMETIC)));
+	}
+}
+
+// Everything in the immed group. Operands come in already truncated to the
+// operand width.
+force_inline u16 Arithmetic(Simulator *sim, Mnemonic op, u16 a, u16 b, bool wide)
+{
+	u32 mask = wide ? 0xFFFF : 0xFF;
+
+	u32 carry_in = 0;
+	if (op == ADC || op == SBB)
+	{
+		carry_in = ReadFlagsInline(sim, CPUFlag_CF);
+	}
+
+	u32 result = 0;
+	LazyFlagsKind kind = LazyFlags_Logic;
+
+	switch (op)
+	{
+		case ADD:
+		case ADC:
+		{
+			result = (u32)a + (u32)b + carry_in;
+			kind   = LazyFlags_Add;
+		} break;
+
+		case SUB:
+		case SBB:
+		case CMP:
+		{
+			result = (u32)a - (u32)b - carry_in;
+			kind   = LazyFlags_Sub;
+		} break;
+
+		case AND: { result = a & b; } break;
+		case OR:  { result = a | b; } break;
+		case XOR: { result = a ^ b; } break;
+	}
+
+	result &= mask;
+	RecordFlags(sim, kind, a, b, result, wide, carry_in);
+
+	return (u16)result;
+}
+
+// inc and dec set the flags like add and sub 1, but leave the carry alone
+force_inline u16 IncDec(Simulator *sim, Mnemonic op, u16 a, bool wide)
+{
+	u32 mask = wide ? 0xFFFF : 0xFF;
+
+	u32 carry = ReadFlagsInline(sim, CPUFlag_CF);
+
+	u32 result = (op == INC ? (u32)a + 1 : (u32)a - 1) & mask;
+	RecordFlags(sim, op == INC ? LazyFlags_Inc : LazyFlags_Dec, a, 1, result, wide, carry);
+
+	return (u16)result;
+}
+
+force_inline bool FlagSet(Simulator *sim, CPUFlags flag)
+{
+	return !!ReadFlagsInline(sim, flag);
+}
+
+// Only evaluates the flags the condition looks at
+force_inline bool ConditionHolds(Simulator *sim, Mnemonic mnemonic)
+{
+	bool result = false;
+
+	switch (mnemonic)
+	{
+		case JO:  { result =  FlagSet(sim, CPUFlag_OF); } break;
+		case JNO: { result = !FlagSet(sim, CPUFlag_OF); } break;
+		case JB:  { result =  FlagSet(sim, CPUFlag_CF); } break;
+		case JAE: { result = !FlagSet(sim, CPUFlag_CF); } break;
+		case JE:  { result =  FlagSet(sim, CPUFlag_ZF); } break;
+		case JNE: { result = !FlagSet(sim, CPUFlag_ZF); } break;
+		case JBE: { result =  FlagSet(sim, CPUFlag_CF|CPUFlag_ZF); } break;
+		case JA:  { result = !FlagSet(sim, CPUFlag_CF|CPUFlag_ZF); } break;
+		case JS:  { result =  FlagSet(sim, CPUFlag_SF); } break;
+		case JNS: { result = !FlagSet(sim, CPUFlag_SF); } break;
+		case JP:  { result =  FlagSet(sim, CPUFlag_PF); } break;
+		case JPO: { result = !FlagSet(sim, CPUFlag_PF); } break;
+
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		{
+			CPUFlags flags = ReadFlagsInline(sim, CPUFlag_SF|CPUFlag_OF|CPUFlag_ZF);
+
+			bool zf = !!(flags & CPUFlag_ZF);
+			bool sf = !!(flags & CPUFlag_SF);
+			bool of = !!(flags & CPUFlag_OF);
+
+			switch (mnemonic)
+			{
+				case JL:  { result =  sf != of;       } break;
+				case JGE: { result =  sf == of;       } break;
+				case JLE: { result =  zf || sf != of; } break;
+				case JG:  { result = !zf && sf == of; } break;
+			}
+		} break;
+	}
+
+	return result;
+}
+
+//
+// Execution
+//
+
+function void Push(Simulator *sim, u16 value)
+{
+	LogRegisterWrite(sim, Slot_SP);
+
+	u16 sp = (u16)(sim->regs.words[Slot_SP] - 2);
+	sim->regs.words[Slot_SP] = sp;
+	WriteMemory(sim, sim->segment_bases[Slot_SS], sp, true, value);
+}
+
+function u16 Pop(Simulator *sim)
+{
+	LogRegisterWrite(sim, Slot_SP);
+
+	u16 sp = sim->regs.words[Slot_SP];
+	sim->regs.words[Slot_SP] = (u16)(sp + 2);
+	return ReadMemory(sim, sim->segment_bases[Slot_SS], sp, true);
+}
+
+// Without a port table, everything reads as an empty bus, see io_ports.h
+force_inline u16 PortIn(Simulator *sim, u16 port, bool wide)
+{
+	u16 result = wide ? 0xFFFF : 0xFF;
+
+	if (sim->io_ports)
+	{
+		IOPort *entry = &sim->io_ports[port];
+		result = entry->read(entry->context, port, wide);
+	}
+
+	return result;
+}
+
+force_inline void PortOut(Simulator *sim, u16 port, bool wide, u16 value)
+{
+	if (sim->io_ports)
+	{
+		IOPort *entry = &sim->io_ports[port];
+		entry->write(entry->context, port, wide, value);
+	}
+}
+
+function Instruction *FetchInstruction(Simulator *sim, Instruction *scratch)
+{
+	if (sim->error || sim->ip >= sim->code_end)
+	{
+		return NULL;
+	}
+
+	Instruction *inst = scratch;
+	if (sim->icache)
+	{
+		inst = &sim->icache[sim->ip];
+		if (inst->source_byte_count)
+		{
+			return inst;
+		}
+	}
+
+	Decoder *decoder = &sim->decoder;
+	decoder->at = decoder->base + sim->ip;
+
+	if (!DecodeNextInstruction(decoder, inst))
+	{
+		SimulatorError(sim, decoder->error_message);
+
+		// Don't leave a half decoded instruction in the cache
+		inst->source_byte_count = 0;
+		return NULL;
+	}
+
+	if (inst != scratch)
+	{
+		MarkCodePages(sim, sim->ip, inst->source_byte_count);
+	}
+
+	return inst;
+}
+
+function void ExecuteInstruction(Simulator *sim, Instruction *inst)
+{
+	if ((inst->mnemonic == MOV || inst->mnemonic == POP) &&
+		inst->op1.kind == Operand_SegReg && inst->op1.reg == CS)
+	{
+		// Code has to stay in the first 64k, see Simulator.memory
+		SimulatorError(sim, StringLit("Loading CS is not supported"));
+		return;
+	}
+
+	if (inst->flags & InstructionFlag_Far)
+	{
+		// Same as above, a far call or jump loads CS
+		SimulatorError(sim, StringLit("Unsupported instruction"));
+		return;
+	}
+
+	// Jumps are relative to the next instruction
+	sim->ip += (u16)inst->source_byte_count;
+
+	bool wide = InstructionIsWide(inst);
+
+	switch (inst->mnemonic)
+	{
+		case MOV:
+		{
+			WriteOperand(sim, &inst->op1, wide, SourceValue(sim, inst, wide));
+		} break;
+
+		case ADD:
+		case OR:
+		case ADC:
+		case SBB:
+		case AND:
+		case SUB:
+		case XOR:
+		case CMP:
+		{
+			u16 a = ReadOperand(sim, &inst->op1, wide);
+			u16 b = SourceValue(sim, inst, wide);
+
+			u16 result = Arithmetic(sim, inst->mnemonic, a, b, wide);
+			if (inst->mnemonic != CMP)
+			{
+				WriteOperand(sim, &inst->op1, wide, result);
+			}
+		} break;
+
+		case INC:
+		case DEC:
+		{
+			u16 a = ReadOperand(sim, &inst->op1, wide);
+			WriteOperand(sim, &inst->op1, wide, IncDec(sim, inst->mnemonic, a, wide));
+		} break;
+
+		case XCHG:
+		{
+			u16 a = ReadOperand(sim, &inst->op1, wide);
+			u16 b = ReadOperand(sim, &inst->op2, wide);
+			WriteOperand(sim, &inst->op1, wide, b);
+			WriteOperand(sim, &inst->op2, wide, a);
+		} break;
+
+		case PUSH:
+		{
+			Push(sim, ReadOperand(sim, &inst->op1, true));
+		} break;
+
+		case POP:
+		{
+			WriteOperand(sim, &inst->op1, true, Pop(sim));
+		} break;
+
+		case CALL:
+		{
+			u16 target = ReadOperand(sim, &inst->op1, true);
+			Push(sim, sim->ip);
+			sim->ip = target;
+		} break;
+
+		case JMP:
+		{
+			sim->ip = ReadOperand(sim, &inst->op1, true);
+		} break;
+
+		case JO:
+		case JNO:
+		case JB:
+		case JAE:
+		case JE:
+		case JNE:
+		case JBE:
+		case JA:
+		case JS:
+		case JNS:
+		case JP:
+		case JPO:
+		case JL:
+		case JGE:
+		case JLE:
+		case JG:
+		{
+			if (ConditionHolds(sim, inst->mnemonic))
+			{
+				sim->ip += (u16)inst->data;
+			}
+		} break;
+
+		case LOOP:
+		case LOOPE:
+		case LOOPNE:
+		{
+			LogRegisterWrite(sim, Slot_CX);
+			u16 cx = --sim->regs.words[Slot_CX];
+
+			bool taken = (cx != 0);
+			if (inst->mnemonic == LOOPE)
+			{
+				taken &= FlagSet(sim, CPUFlag_ZF);
+			}
+			else if (inst->mnemonic == LOOPNE)
+			{
+				taken &= !FlagSet(sim, CPUFlag_ZF);
+			}
+
+			if (taken)
+			{
+				sim->ip += (u16)inst->data;
+			}
+		} break;
+
+		case JCXZ:
+		{
+			if (!sim->regs.words[Slot_CX])
+			{
+				sim->ip += (u16)inst->data;
+			}
+		} break;
+
+		// The accumulator is op1 for both, the port is an immediate byte or DX
+		case IN:
+		case OUT:
+		{
+			u16 port = (inst->flags & InstructionFlag_DataLO) ? inst->data_lo : sim->regs.words[Slot_DX];
+
+			if (inst->mnemonic == IN)
+			{
+				WriteRegister(sim, inst->op1.reg, PortIn(sim, port, wide));
+			}
+			else
+			{
+				PortOut(sim, port, wide, ReadRegister(sim, inst->op1.reg));
+			}
+		} break;
+
+		default:
+		{
+			// Point back at the instruction we couldn't run
+			sim->ip -= (u16)inst->source_byte_count;
+			SimulatorError(sim, StringLit("Unsupported instruction"));
+			return;
+		} break;
+	}
+
+	sim->instruction_count++;
+}
+
+function u64 RunSimulator(Simulator *sim, u64 max_instructions)
+{
+	u64 start = sim->instruction_count;
+
+	Instruction scratch;
+	while (!max_instructions || sim->instruction_count - start < max_instructions)
+	{
+		Instruction *inst = FetchInstruction(sim, &scratch);
+		if (!inst)
+		{
+			break;
+		}
+
+		ExecuteInstruction(sim, inst);
+	}
+
+	return sim->instruction_count - start;
+}
+
+//
+// Output
+//
+
+function u8 *FormatFlags(u8 *out, CPUFlags flags)
+{
+	static const char letters[] = "C_P_A_ZSTIDO";
+
+	for (u32 bit = 0; bit < sizeof(letters) - 1; bit++)
+	{
+		if (letters[bit] != '_' && (flags & (1 << bit)))
+		{
+			*out++ = (u8)letters[bit];
+		}
+	}
+
+	return out;
+}
+
+function void PrintFlags(FILE *out, CPUFlags flags)
+{
+	u8 letters[16];
+	fwrite(letters, 1, (size_t)(FormatFlags(letters, flags) - letters), out);
+}
+
+// In the order the course listings print them
+global const Register printed_registers[] =
+{
+	AX, BX, CX, DX, SP, BP, SI, DI, ES, CS, SS, DS,
+};
+
+function void BeginChanges(Simulator *sim)
+{
+	ChangeLog *changes = sim->changes;
+	changes->old_ip              = sim->ip;
+	changes->old_flags           = ReadFlags(sim, 0xFFFF);
+	changes->written_slots       = 0;
+	changes->memory_change_count = 0;
+}
+
+// Lowercase, no leading zeros
+function u8 *FormatHex(u8 *out, u32 value, u32 min_digits)
+{
+	u32 digits = 1;
+	while (digits < 8 && (value >> 4*digits))
+	{
+		digits++;
+	}
+	digits = Max(digits, min_digits);
+
+	*out++ = '0';
+	*out++ = 'x';
+	for (u32 digit = digits; digit-- > 0;)
+	{
+		*out++ = "0123456789abcdef"[(value >> 4*digit) & 0xF];
+	}
+
+	return out;
+}
+
+// ":0x0->0x1"
+function u8 *FormatChangedValue(u8 *out, u32 old_value, u32 new_value)
+{
+	*out++ = ':';
+	out = FormatHex(out, old_value, 1);
+	*out++ = '-';
+	*out++ = '>';
+	out = FormatHex(out, new_value, 1);
+	return out;
+}
+
+function u8 *FormatChange(u8 *out, String name, u32 old_value, u32 new_value)
+{
+	*out++ = ' ';
+	memcpy(out, name.bytes, name.count);
+	out += name.count;
+	return FormatChangedValue(out, old_value, new_value);
+}
+
+function u32 FormatChanges(Simulator *sim, u8 *out)
+{
+	ChangeLog *changes = sim->changes;
+	u8        *at      = out;
+
+	for (u32 index = 0; index < ArrayCount(printed_registers); index++)
+	{
+		Register reg  = printed_registers[index];
+		u32      slot = register_byte_offsets[reg] / 2;
+
+		if ((changes->written_slots & (1 << slot)) && changes->old_words[slot] != sim->regs.words[slot])
+		{
+			at = FormatChange(at, register_names[reg], changes->old_words[slot], sim->regs.words[slot]);
+		}
+	}
+
+	for (u32 index = 0; index < changes->memory_change_count; index++)
+	{
+		MemoryChange *change = &changes->memory_changes[index];
+		MemoryWrite  *write  = &change->write;
+
+		u16 value = ReadMemory(sim, write->segment_base, write->offset, write->wide);
+		if (value != change->old_value)
+		{
+			// By linear address
+			*at++ = ' ';
+			*at++ = '[';
+			at = FormatHex(at, LinearAddress(write->segment_base, write->offset), 5);
+			*at++ = ']';
+			at = FormatChangedValue(at, change->old_value, value);
+		}
+	}
+
+	if (sim->ip != changes->old_ip)
+	{
+		at = FormatChange(at, StringLit("ip"), changes->old_ip, sim->ip);
+	}
+
+	CPUFlags flags = ReadFlags(sim, 0xFFFF);
+	if (flags != changes->old_flags)
+	{
+		memcpy(at, " flags:", 7);
+		at += 7;
+		at = FormatFlags(at, changes->old_flags);
+		*at++ = '-';
+		*at++ = '>';
+		at = FormatFlags(at, flags);
+	}
+
+	return (u32)(at - out);
+}
+
+function void PrintRegisterLine(FILE *out, Simulator *sim)
+{
+	fprintf(out, "   ");
+	for (u32 index = 0; index < ArrayCount(printed_registers); index++)
+	{
+		fprintf(out, " %.*s:0x%04x", StringExpand(register_names[printed_registers[index]]), ReadRegister(sim, printed_registers[index]));
+	}
+	fprintf(out, " ip:0x%04x flags:", sim->ip);
+	PrintFlags(out, ReadFlags(sim, 0xFFFF));
+	fprintf(out, "\n");
+}
+
+function void PrintRegisters(FILE *out, Simulator *sim)
+{
+	fprintf(out, "Final registers:\n");
+
+	for (u32 i = 0; i < ArrayCount(printed_registers); i++)
+	{
+		u16 value = ReadRegister(sim, printed_registers[i]);
+		if (value)
+		{
+			fprintf(out, "      %.*s: 0x%04x (%u)\n", StringExpand(register_names[printed_registers[i]]), value, value);
+		}
+	}
+
+	fprintf(out, "      ip: 0x%04x (%u)\n", sim->ip, sim->ip);
+
+	CPUFlags flags = ReadFlags(sim, 0xFFFF);
+	if (flags)
+	{
+		fprintf(out, "   flags: ");
+		PrintFlags(out, flags);
+		fprintf(out, "\n");
+	}
+}
@@ -0,0 +1,252 @@
+// 8086 execution on top of the decoder. The simulator decodes straight out of
+// its own memory at IP, so the program it runs is whatever is in memory at
+// the time, and executes the result with no per-step allocation or output.
+
+#define SIM_MEMORY_SIZE Megabytes(1)
+
+// Granularity of the dirty page tracking, see Simulator.dirty_pages
+#define SIM_PAGE_SHIFT 8
+#define SIM_PAGE_SIZE  (1 << SIM_PAGE_SHIFT)
+#define SIM_PAGE_COUNT (SIM_MEMORY_SIZE >> SIM_PAGE_SHIFT)
+
+typedef u16 CPUFlags;
+enum CPUFlags
+{
+	CPUFlag_CF = 1 << 0,
+	CPUFlag_PF = 1 << 2,
+	CPUFlag_AF = 1 << 4,
+	CPUFlag_ZF = 1 << 6,
+	CPUFlag_SF = 1 << 7,
+	CPUFlag_TF = 1 << 8,
+	CPUFlag_IF = 1 << 9,
+	CPUFlag_DF = 1 << 10,
+	CPUFlag_OF = 1 << 11,
+};
+
+#define CPUFLAGS_ARITHMETIC (CPUFlag_CF|CPUFlag_PF|CPUFlag_AF|CPUFlag_ZF|CPUFlag_SF|CPUFlag_OF)
+
+// The arithmetic flags are evaluated lazily. Arithmetic records the kind of
+// operation, its operands and its result, and individual flags are only
+// worked out from that when something reads them, which for the most part
+// means a conditional jump.
+typedef u8 LazyFlagsKind;
+enum LazyFlagsKind
+{
+	// Simulator.flags is up to date
+	LazyFlags_None,
+
+	LazyFlags_Add, // add, adc
+	LazyFlags_Sub, // sub, sbb, cmp
+	LazyFlags_Inc,
+	LazyFlags_Dec,
+	LazyFlags_Logic,
+};
+
+typedef struct LazyFlags
+{
+	LazyFlagsKind kind;
+	u8            wide;
+
+	// The carry going in for add and sub, the carry left alone for inc and dec
+	u8 carry;
+
+	// Operands as they went in and the result, truncated to the operand width
+	u16 a;
+	u16 b;
+	u16 result;
+} LazyFlags;
+
+// Word registers in encoding order, followed by the segment registers. The
+// byte registers alias the low and high halves of AX..BX.
+typedef u8 RegisterSlot;
+enum RegisterSlot
+{
+	Slot_AX, Slot_CX, Slot_DX, Slot_BX,
+	Slot_SP, Slot_BP, Slot_SI, Slot_DI,
+	Slot_ES, Slot_CS, Slot_SS, Slot_DS,
+
+	Slot_Count,
+
+	// Always zero. Pre-resolved effective addresses use it in place of the
+	// base or index register they don't have, so computing one never branches.
+	Slot_Zero = Slot_Count,
+};
+
+typedef struct Simulator
+{
+	union
+	{
+		u16 words[Slot_Count + 1];
+		u8  bytes[(Slot_Count + 1)*2];
+	} regs;
+
+	u16      ip;
+
+	// Don't read this directly, use ReadFlags. The arithmetic flags in it are
+	// stale while lazy_flags has a pending operation.
+	CPUFlags  flags;
+	LazyFlags lazy_flags;
+
+	// Evaluate every flag right after every operation, the way the hardware
+	// does. Slower, but it's the reference lazy evaluation is checked against.
+	bool eager_flags;
+
+	// SIM_MEMORY_SIZE bytes, owned by whoever initialized the simulator, and
+	// addressed as segment:offset, at (segment << 4) + offset. Offsets wrap
+	// around at 64k within their segment, linear addresses at the end of the
+	// 1MB. Code runs out of the first 64k: CS stays at 0 and IP is the
+	// linear address.
+	u8 *memory;
+
+	// The linear base of each segment register, by register slot, so
+	// translating an address is an add. Kept in step with the registers by
+	// WriteRegister, which is the only thing that may change them.
+	u32 segment_bases[Slot_Count];
+
+	// Some segment starts in the last 64k, so an address through it can wrap
+	// around the end of memory
+	bool segments_wrap;
+
+	// A byte per SIM_PAGE_SIZE of memory, set by every write the simulator
+	// does there, native code included, and only ever cleared by whoever is
+	// keeping track of what changed (see snapshot.h). Anything writing to
+	// memory behind the simulator's back should call MarkMemoryDirty.
+	u8 dirty_pages[SIM_PAGE_COUNT];
+
+	// A byte per SIM_PAGE_SIZE of memory, set for the pages that the
+	// instruction cache or the block cache hold decoded code from. Writes
+	// check it, and a write to one of these pages goes through InvalidateCode
+	// to throw away whatever was decoded from the bytes it changed, if
+	// code_bytes says it changed any. Only cleared when LoadProgram empties
+	// both caches.
+	u8 code_pages[SIM_PAGE_COUNT];
+
+	// A bit per byte of the first 64k, which is all code runs from, set for
+	// the bytes decoded into either cache. Data next to code on a page is
+	// written without invalidating anything. Cleared along with code_pages.
+	u8 code_bytes[Kilobytes(64) / 8];
+
+	// Execution stops when IP reaches the end of the loaded program
+	u32 code_end;
+
+	u64 instruction_count;
+
+	Decoder decoder;
+
+	// Optional. Pre-decoded instructions indexed by IP, filled in the first
+	// time an address is executed, so loops only pay for decoding once. An
+	// entry with a source_byte_count of zero is empty. Entries a write
+	// overlaps are emptied again, see code_pages.
+	Instruction *icache;
+
+	// Optional, see block_cache.h
+	struct BlockCache *blocks;
+
+	// Optional, IO_PORT_COUNT entries, see io_ports.h
+	struct IOPort *io_ports;
+
+	// Optional. The interpreter logs what each instruction changes here, see
+	// ChangeLog.
+	struct ChangeLog *changes;
+
+	bool   error;
+	String error_message;
+} Simulator;
+
+function void InitializeSimulator(Simulator *sim, u8 *memory);
+
+// Back to power-on state: registers, flags and counters cleared, memory left
+// alone, caches kept
+function void ResetSimulator(Simulator *sim);
+function bool LoadProgram(Simulator *sim, String code);
+
+// Decodes the instruction at IP into scratch, or finds it in the instruction
+// cache. Returns NULL once IP is past the end of the program or the bytes
+// there don't decode. The result is only good until the next fetch.
+function Instruction *FetchInstruction(Simulator *sim, Instruction *scratch);
+function void ExecuteInstruction(Simulator *sim, Instruction *inst);
+
+// Runs until the program ends, something goes wrong or max_instructions have
+// been executed (0 for no limit). Returns the number of instructions executed.
+function u64 RunSimulator(Simulator *sim, u64 max_instructions);
+
+#define SIM_ICACHE_ENTRY_COUNT Kilobytes(64)
+
+function bool EnableInstructionCache(Simulator *sim);
+function void DisableInstructionCache(Simulator *sim);
+function void InvalidateInstructionCache(Simulator *sim, u32 address, u32 count);
+
+// Returns the wanted subset of the flags, evaluating only those
+function CPUFlags ReadFlags(Simulator *sim, CPUFlags wanted);
+function void     WriteFlags(Simulator *sim, CPUFlags flags);
+
+function u16 ReadRegister(Simulator *sim, Register reg);
+function void WriteRegister(Simulator *sim, Register reg, u16 value);
+
+// Translates segment:offset to an index into Simulator.memory
+function u32 LinearAddress(u32 segment_base, u16 offset);
+
+function u16  ReadMemory(Simulator *sim, u32 segment_base, u16 offset, bool wide);
+function void WriteMemory(Simulator *sim, u32 segment_base, u16 offset, bool wide, u16 value);
+
+// Linear addresses. Also throws away any code cached from there.
+function void MarkMemoryDirty(Simulator *sim, u32 address, u32 count);
+
+// Empties the instruction cache entries and blocks that overlap the range of
+// linear addresses, which is about to be or has just been written to
+function void InvalidateCode(Simulator *sim, u32 address, u32 count);
+
+typedef struct MemoryWrite
+{
+	u32  segment_base;
+	u16  offset;
+	bool wide;
+} MemoryWrite;
+
+// The memory the instruction will write when it executes, worked out from the
+// registers as they are now. Returns how many writes went into writes, which
+// has room for MAX_MEMORY_WRITES.
+#define MAX_MEMORY_WRITES 2
+function u32 MemoryWritesOf(Simulator *sim, Instruction *inst, MemoryWrite *writes);
+
+// What one instruction changed. Registers and memory are logged by the writes
+// themselves as they happen, each saving what it overwrites, so working out
+// the changes doesn't take a pass over the register file or a look at memory
+// the instruction didn't touch. IP and the flags are one word each and are
+// just kept from before the instruction.
+typedef struct MemoryChange
+{
+	MemoryWrite write;
+	u16         old_value;
+} MemoryChange;
+
+typedef struct ChangeLog
+{
+	u16      old_ip;
+	CPUFlags old_flags;
+
+	// A bit per register slot written, and what it held before the first
+	// write
+	u16 written_slots;
+	u16 old_words[Slot_Count];
+
+	u32          memory_change_count;
+	MemoryChange memory_changes[MAX_MEMORY_WRITES];
+} ChangeLog;
+
+// Call right before executing each instruction, with Simulator.changes set
+function void BeginChanges(Simulator *sim);
+
+// Room FormatChanges needs, whatever changed
+#define CHANGES_TEXT_MAX 512
+
+// Writes what changed since BeginChanges, as " ax:0x0->0x1 ip:0x0->0x3
+// flags:->Z", values that were written but came out the same left out.
+// Returns the number of bytes written to out.
+function u32 FormatChanges(Simulator *sim, u8 *out);
+
+function void PrintFlags(FILE *out, CPUFlags flags);
+function void PrintRegisters(FILE *out, Simulator *sim);
+
+// Every register, IP and the flags on one indented line
+function void PrintRegisterLine(FILE *out, Simulator *sim);
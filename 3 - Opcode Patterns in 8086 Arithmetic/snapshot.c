@@ -0,0 +1,184 @@
+force_inline u32 *SnapshotRefCount(SnapshotStore *store, SnapshotPage page)
+{
+	return &store->chunks[page / SNAPSHOT_PAGES_PER_CHUNK]->ref_counts[page % SNAPSHOT_PAGES_PER_CHUNK];
+}
+
+force_inline u8 *SnapshotPageBytes(SnapshotStore *store, SnapshotPage page)
+{
+	return store->chunks[page / SNAPSHOT_PAGES_PER_CHUNK]->pages[page % SNAPSHOT_PAGES_PER_CHUNK];
+}
+
+function void InitializeSnapshots(SnapshotStore *store, Simulator *sim)
+{
+	ZeroStruct(store);
+	store->sim        = sim;
+	store->first_free = SNAPSHOT_NO_PAGE;
+
+	for (u32 page = 0; page < SIM_PAGE_COUNT; page++)
+	{
+		store->live[page] = SNAPSHOT_NO_PAGE;
+	}
+}
+
+function void FreeSnapshots(SnapshotStore *store)
+{
+	for (u32 index = 0; index < store->chunk_count; index++)
+	{
+		FreePages(store->chunks[index], sizeof(SnapshotChunk));
+	}
+
+	InitializeSnapshots(store, store->sim);
+}
+
+function SnapshotPage AllocateSnapshotPage(SnapshotStore *store)
+{
+	if (store->first_free == SNAPSHOT_NO_PAGE)
+	{
+		if (store->chunk_count == SNAPSHOT_MAX_CHUNKS)
+		{
+			return SNAPSHOT_NO_PAGE;
+		}
+
+		SnapshotChunk *chunk = AllocatePages(sizeof(SnapshotChunk));
+		if (!chunk)
+		{
+			return SNAPSHOT_NO_PAGE;
+		}
+
+		u32 first = store->chunk_count*SNAPSHOT_PAGES_PER_CHUNK;
+		store->chunks[store->chunk_count++] = chunk;
+
+		// Lowest numbers first off the list
+		for (u32 index = SNAPSHOT_PAGES_PER_CHUNK; index-- > 0;)
+		{
+			memcpy(chunk->pages[index], &store->first_free, sizeof(SnapshotPage));
+			store->first_free = first + index;
+		}
+	}
+
+	SnapshotPage page = store->first_free;
+	memcpy(&store->first_free, SnapshotPageBytes(store, page), sizeof(SnapshotPage));
+
+	*SnapshotRefCount(store, page) = 1;
+
+	return page;
+}
+
+function void ReleaseSnapshotPage(SnapshotStore *store, SnapshotPage page)
+{
+	if (page != SNAPSHOT_NO_PAGE && --*SnapshotRefCount(store, page) == 0)
+	{
+		memcpy(SnapshotPageBytes(store, page), &store->first_free, sizeof(SnapshotPage));
+		store->first_free = page;
+	}
+}
+
+function bool TakeSnapshot(SnapshotStore *store, Snapshot *snapshot)
+{
+	Simulator *sim = store->sim;
+
+	// Memory first, so running out of pages leaves nothing half done
+	u32 copied = 0;
+	for (u32 page = 0; page < SIM_PAGE_COUNT; page++)
+	{
+		if (sim->dirty_pages[page] || store->live[page] == SNAPSHOT_NO_PAGE)
+		{
+			SnapshotPage copy = AllocateSnapshotPage(store);
+			if (copy == SNAPSHOT_NO_PAGE)
+			{
+				// The pages copied so far stay live, they match memory
+				for (u32 index = 0; index < SIM_PAGE_COUNT; index++)
+				{
+					if (index < page)
+					{
+						ReleaseSnapshotPage(store, snapshot->pages[index]);
+					}
+					snapshot->pages[index] = SNAPSHOT_NO_PAGE;
+				}
+				return false;
+			}
+
+			memcpy(SnapshotPageBytes(store, copy), sim->memory + ((u64)page << SIM_PAGE_SHIFT), SIM_PAGE_SIZE);
+
+			ReleaseSnapshotPage(store, store->live[page]);
+			store->live[page]       = copy;
+			sim->dirty_pages[page]  = 0;
+			copied                 += 1;
+		}
+
+		snapshot->pages[page] = store->live[page];
+		*SnapshotRefCount(store, store->live[page]) += 1;
+	}
+
+	memcpy(snapshot->words, sim->regs.words, sizeof(snapshot->words));
+	snapshot->ip                = sim->ip;
+	snapshot->flags             = ReadFlags(sim, 0xFFFF);
+	snapshot->code_end          = sim->code_end;
+	snapshot->instruction_count = sim->instruction_count;
+
+	store->pages_copied = copied;
+
+	return true;
+}
+
+function void RestoreSnapshot(SnapshotStore *store, Snapshot *snapshot)
+{
+	Simulator *sim = store->sim;
+
+	u32 copied = 0;
+	for (u32 page = 0; page < SIM_PAGE_COUNT; page++)
+	{
+		// Mostly nothing to do, so skip over eight pages at a time while
+		// none of them are dirty or different
+		if (page % 8 == 0)
+		{
+			u64 dirty;
+			memcpy(&dirty, &sim->dirty_pages[page], sizeof(dirty));
+			if (!dirty && memcmp(&store->live[page], &snapshot->pages[page], 8*sizeof(SnapshotPage)) == 0)
+			{
+				page += 7;
+				continue;
+			}
+		}
+
+		SnapshotPage wanted = snapshot->pages[page];
+		if (sim->dirty_pages[page] || store->live[page] != wanted)
+		{
+			memcpy(sim->memory + ((u64)page << SIM_PAGE_SHIFT), SnapshotPageBytes(store, wanted), SIM_PAGE_SIZE);
+			if (sim->code_pages[page])
+			{
+				InvalidateCode(sim, page << SIM_PAGE_SHIFT, SIM_PAGE_SIZE);
+			}
+
+			*SnapshotRefCount(store, wanted) += 1;
+			ReleaseSnapshotPage(store, store->live[page]);
+			store->live[page]       = wanted;
+			sim->dirty_pages[page]  = 0;
+			copied                 += 1;
+		}
+	}
+
+	// Through WriteRegister for the segment bases
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		WriteRegister(sim, RegisterOfSlot(slot), snapshot->words[slot]);
+	}
+
+	sim->ip                = snapshot->ip;
+	sim->code_end          = snapshot->code_end;
+	sim->instruction_count = snapshot->instruction_count;
+	sim->error             = false;
+	sim->error_message     = (String){ 0 };
+	WriteFlags(sim, snapshot->flags);
+
+	store->pages_copied = copied;
+}
+
+function void FreeSnapshot(SnapshotStore *store, Snapshot *snapshot)
+{
+	for (u32 page = 0; page < SIM_PAGE_COUNT; page++)
+	{
+		ReleaseSnapshotPage(store, snapshot->pages[page]);
+		snapshot->pages[page] = SNAPSHOT_NO_PAGE;
+	}
+}
@@ -0,0 +1,70 @@
+// Snapshots of the whole machine, registers, flags and all 1MB of memory,
+// for running from the same state over and over.
+//
+// Memory is kept in pages of SIM_PAGE_SIZE bytes, shared between snapshots
+// and copied on write: a snapshot is a table of read-only page copies, and
+// taking one only copies the pages the simulator has written to since the
+// last snapshot or restore (Simulator.dirty_pages), the rest are the same
+// copies as before. Restoring only copies back the pages that differ from
+// the snapshot. Either way the cost is a pass over the page table plus a copy
+// per page that changed, rather than a copy of the full 1MB.
+//
+// Pages are referred to by number, and their reference counts are packed
+// together apart from the page contents, so the pass over the table doesn't
+// have to touch a cache line per page.
+
+#define SNAPSHOT_PAGES_PER_CHUNK 1024
+#define SNAPSHOT_MAX_CHUNKS      4096
+#define SNAPSHOT_NO_PAGE         0xFFFFFFFF
+
+typedef u32 SnapshotPage;
+
+typedef struct SnapshotChunk
+{
+	u32 ref_counts[SNAPSHOT_PAGES_PER_CHUNK];
+	u8  pages[SNAPSHOT_PAGES_PER_CHUNK][SIM_PAGE_SIZE];
+} SnapshotChunk;
+
+typedef struct Snapshot
+{
+	u16      words[Slot_Count];
+	u16      ip;
+	CPUFlags flags;
+	u32      code_end;
+	u64      instruction_count;
+
+	SnapshotPage pages[SIM_PAGE_COUNT];
+} Snapshot;
+
+typedef struct SnapshotStore
+{
+	Simulator *sim;
+
+	// The page each page of memory matches, as long as it isn't dirty. Holds
+	// a reference.
+	SnapshotPage live[SIM_PAGE_COUNT];
+
+	u32            chunk_count;
+	SnapshotChunk *chunks[SNAPSHOT_MAX_CHUNKS];
+
+	// Free pages are linked through their first four bytes
+	SnapshotPage first_free;
+
+	// How many pages the last snapshot or restore had to copy
+	u32 pages_copied;
+} SnapshotStore;
+
+function void InitializeSnapshots(SnapshotStore *store, Simulator *sim);
+
+// Releases every page, snapshots included
+function void FreeSnapshots(SnapshotStore *store);
+
+// Returns false if there was no memory for the page copies, which leaves
+// the snapshot empty, safe to free but not to restore
+function bool TakeSnapshot(SnapshotStore *store, Snapshot *snapshot);
+
+// Puts the machine back the way it was, with the error cleared. Caches are
+// kept, apart from code decoded from pages the restore changed.
+function void RestoreSnapshot(SnapshotStore *store, Snapshot *snapshot);
+
+function void FreeSnapshot(SnapshotStore *store, Snapshot *snapshot);
@@ -0,0 +1,318 @@
+function ModRMMod ModRMModOfInstruction(u8 *bytes, DecodeKind kind)
+{
+	ModRMMod result = ModRMMod_None;
+
+	switch (kind)
+	{
+		case Decode_RegMem:
+		case Decode_RegMemToFromReg:
+		case Decode_RegMemToFromSegReg:
+		case Decode_ImmToRegMem:
+		{
+			result = (ModRMMod)(bytes[1] >> 6);
+		} break;
+	}
+
+	return result;
+}
+
+function void CountStat(StatCounter *counter, u64 bytes)
+{
+	counter->count += 1;
+	counter->bytes += bytes;
+}
+
+function bool GatherDecodeStats(DecodeStats *stats, String input, String *error_message)
+{
+	Decoder *decoder = &(Decoder){ 0 };
+	InitializeDecoder(decoder, input);
+
+	Instruction inst;
+	while (DecodeNextInstruction(decoder, &inst))
+	{
+		u8        *bytes = OpcodeOfInstruction(decoder, &inst);
+		u64        count = inst.source_byte_count;
+		DecodeKind kind  = decode_params[bytes[0]].kind;
+
+		CountStat(&stats->total,                                      count);
+		CountStat(&stats->mnemonics[inst.mnemonic],                   count);
+		CountStat(&stats->kinds[kind],                                count);
+		CountStat(&stats->mods[ModRMModOfInstruction(bytes, kind)],   count);
+		CountStat(&stats->shapes[ShapeOfInstruction(&inst)],          count);
+	}
+
+	if (decoder->error)
+	{
+		*error_message = decoder->error_message;
+	}
+
+	return !decoder->error;
+}
+
+function void MergeStatCounters(size_t count, StatCounter *dest, StatCounter *source)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		dest[i].count += source[i].count;
+		dest[i].bytes += source[i].bytes;
+	}
+}
+
+function void MergeDecodeStats(DecodeStats *dest, DecodeStats *source)
+{
+	MergeStatCounters(1,                          &dest->total,    &source->total);
+	MergeStatCounters(ArrayCount(dest->mnemonics), dest->mnemonics, source->mnemonics);
+	MergeStatCounters(ArrayCount(dest->kinds),     dest->kinds,     source->kinds);
+	MergeStatCounters(ArrayCount(dest->mods),      dest->mods,      source->mods);
+	MergeStatCounters(ArrayCount(dest->shapes),    dest->shapes,    source->shapes);
+}
+
+//
+// Multi-threaded driver
+//
+
+typedef struct StatsRun
+{
+	u32              file_count;
+	StatsFileResult *files;
+	volatile u64     next_file;
+} StatsRun;
+
+typedef struct StatsWorker
+{
+	PlatformThread thread;
+	StatsRun      *run;
+	DecodeStats    stats;
+
+	// Workers sit next to each other in an array, keep their counters off each
+	// other's cache lines
+	u8 pad[64];
+} StatsWorker;
+
+function void StatsWorkerProc(void *param)
+{
+	StatsWorker *worker = param;
+	StatsRun    *run    = worker->run;
+
+	for (;;)
+	{
+		u64 file_index = AtomicAddU64(&run->next_file, 1);
+		if (file_index >= run->file_count)
+		{
+			break;
+		}
+
+		StatsFileResult *file = &run->files[file_index];
+
+		String input = MapEntireFile((const char *)file->file_name.bytes);
+		if (!input.count)
+		{
+			file->failed        = true;
+			file->error_message = StringLit("Could not open file (or it is empty)");
+			continue;
+		}
+
+		file->failed = !GatherDecodeStats(&worker->stats, input, &file->error_message);
+
+		UnmapEntireFile(input);
+	}
+}
+
+function void GatherDecodeStatsForFiles(DecodeStats *stats, u32 file_count, StatsFileResult *files, u32 thread_count)
+{
+	StatsRun run =
+	{
+		.file_count = file_count,
+		.files      = files,
+	};
+
+	thread_count = Max(1, Min(thread_count, file_count));
+
+	StatsWorker *workers = calloc(thread_count, sizeof(StatsWorker));
+	if (!workers)
+	{
+		for (u32 file_index = 0; file_index < file_count; file_index++)
+		{
+			files[file_index].failed        = true;
+			files[file_index].error_message = StringLit("Out of memory");
+		}
+		return;
+	}
+
+	for (u32 thread_index = 0; thread_index < thread_count; thread_index++)
+	{
+		workers[thread_index].run = &run;
+	}
+
+	// The calling thread is worker 0, so a single threaded run doesn't start
+	// any threads at all
+	u32 started_count = 1;
+	for (; started_count < thread_count; started_count++)
+	{
+		StatsWorker *worker = &workers[started_count];
+		if (!StartThread(&worker->thread, StatsWorkerProc, worker))
+		{
+			break;
+		}
+	}
+
+	StatsWorkerProc(&workers[0]);
+
+	for (u32 thread_index = 1; thread_index < started_count; thread_index++)
+	{
+		JoinThread(&workers[thread_index].thread);
+	}
+
+	for (u32 thread_index = 0; thread_index < started_count; thread_index++)
+	{
+		MergeDecodeStats(stats, &workers[thread_index].stats);
+	}
+
+	free(workers);
+}
+
+//
+// Reporting
+//
+
+function String FormatOperandShape(OperandShape shape, char *buffer, size_t buffer_size)
+{
+	OperandClass first  = shape / OperandClass_Count;
+	OperandClass second = shape % OperandClass_Count;
+
+	int count;
+	if (second == OperandClass_None)
+	{
+		count = snprintf(buffer, buffer_size, "%.*s", StringExpand(operand_class_names[first]));
+	}
+	else
+	{
+		count = snprintf(buffer, buffer_size, "%.*s, %.*s", StringExpand(operand_class_names[first]), StringExpand(operand_class_names[second]));
+	}
+
+	String result =
+	{
+		.count = (size_t)Max(0, Min(count, (int)buffer_size - 1)),
+		.bytes = (const u8 *)buffer,
+	};
+	return result;
+}
+
+function void PrintStatRow(FILE *out, String name, StatCounter *counter, StatCounter *total)
+{
+	double percent = total->count ? 100.0*(double)counter->count / (double)total->count : 0.0;
+	double average = counter->count ? (double)counter->bytes / (double)counter->count : 0.0;
+
+	fprintf(out, "  %-18.*s %12llu %6.2f%% %14llu %6.2f\n",
+			StringExpand(name), (unsigned long long)counter->count, percent, (unsigned long long)counter->bytes, average);
+}
+
+function void PrintStatHeader(FILE *out, const char *title)
+{
+	fprintf(out, "\n  %-18s %12s %7s %14s %6s\n", title, "count", "%", "bytes", "avg");
+}
+
+function void PrintDecodeStats(FILE *out, DecodeStats *stats)
+{
+	StatCounter *total = &stats->total;
+
+	fprintf(out, "%llu instructions, %llu bytes\n", (unsigned long long)total->count, (unsigned long long)total->bytes);
+
+	// Mnemonics most common first, it's a long list and the tail is the least
+	// interesting part of it
+	u32 order[Mnemonic_Count];
+	u32 order_count = 0;
+	for (u32 mnemonic = 0; mnemonic < Mnemonic_Count; mnemonic++)
+	{
+		u64 count = stats->mnemonics[mnemonic].count;
+		if (count)
+		{
+			u32 at = order_count++;
+			while (at > 0 && stats->mnemonics[order[at - 1]].count < count)
+			{
+				order[at] = order[at - 1];
+				at--;
+			}
+			order[at] = mnemonic;
+		}
+	}
+
+	PrintStatHeader(out, "mnemonic");
+	for (u32 i = 0; i < order_count; i++)
+	{
+		PrintStatRow(out, mnemonic_names[order[i]], &stats->mnemonics[order[i]], total);
+	}
+
+	PrintStatHeader(out, "decode kind");
+	for (u32 kind = 0; kind < Decode_Count; kind++)
+	{
+		if (stats->kinds[kind].count)
+		{
+			PrintStatRow(out, decode_kind_names[kind], &stats->kinds[kind], total);
+		}
+	}
+
+	PrintStatHeader(out, "modrm mod");
+	for (u32 mod = 0; mod < ModRMMod_Count; mod++)
+	{
+		if (stats->mods[mod].count)
+		{
+			PrintStatRow(out, modrm_mod_names[mod], &stats->mods[mod], total);
+		}
+	}
+
+	PrintStatHeader(out, "operand shape");
+	for (u32 shape = 0; shape < OperandShape_Count; shape++)
+	{
+		if (stats->shapes[shape].count)
+		{
+			char buffer[32];
+			PrintStatRow(out, FormatOperandShape((OperandShape)shape, buffer, sizeof(buffer)), &stats->shapes[shape], total);
+		}
+	}
+}
+
+function void WriteStatCSVRow(FILE *out, const char *category, String name, StatCounter *counter)
+{
+	fprintf(out, "%s,\"%.*s\",%llu,%llu\n", category, StringExpand(name), (unsigned long long)counter->count, (unsigned long long)counter->bytes);
+}
+
+function void WriteDecodeStatsCSV(FILE *out, DecodeStats *stats)
+{
+	fprintf(out, "category,name,count,bytes\n");
+
+	WriteStatCSVRow(out, "total", StringLit("total"), &stats->total);
+
+	for (u32 mnemonic = 0; mnemonic < Mnemonic_Count; mnemonic++)
+	{
+		if (stats->mnemonics[mnemonic].count)
+		{
+			WriteStatCSVRow(out, "mnemonic", mnemonic_names[mnemonic], &stats->mnemonics[mnemonic]);
+		}
+	}
+
+	for (u32 kind = 0; kind < Decode_Count; kind++)
+	{
+		if (stats->kinds[kind].count)
+		{
+			WriteStatCSVRow(out, "decode_kind", decode_kind_names[kind], &stats->kinds[kind]);
+		}
+	}
+
+	for (u32 mod = 0; mod < ModRMMod_Count; mod++)
+	{
+		if (stats->mods[mod].count)
+		{
+			WriteStatCSVRow(out, "modrm_mod", modrm_mod_names[mod], &stats->mods[mod]);
+		}
+	}
+
+	for (u32 shape = 0; shape < OperandShape_Count; shape++)
+	{
+		if (stats->shapes[shape].count)
+		{
+			char buffer[32];
+			WriteStatCSVRow(out, "operand_shape", FormatOperandShape((OperandShape)shape, buffer, sizeof(buffer)), &stats->shapes[shape]);
+		}
+	}
+}
@@ -0,0 +1,60 @@
+// Workload statistics: what an instruction stream is made of, gathered by
+// decoding alone. The counters are flat arrays indexed by the decoder's own
+// enums, so the whole set is a couple of kilobytes and stays in L1 while a
+// stream is being counted.
+
+typedef struct StatCounter
+{
+	u64 count;
+	u64 bytes;
+} StatCounter;
+
+typedef u8 ModRMMod;
+enum ModRMMod
+{
+	ModRMMod_Mem,
+	ModRMMod_MemDisp8,
+	ModRMMod_MemDisp16,
+	ModRMMod_Reg,
+	ModRMMod_None, // the instruction has no ModRM byte
+
+	ModRMMod_Count,
+};
+
+global String modrm_mod_names[ModRMMod_Count] =
+{
+	[ModRMMod_Mem]       = StringLitConst("00 mem"),
+	[ModRMMod_MemDisp8]  = StringLitConst("01 mem+d8"),
+	[ModRMMod_MemDisp16] = StringLitConst("10 mem+d16"),
+	[ModRMMod_Reg]       = StringLitConst("11 reg"),
+	[ModRMMod_None]      = StringLitConst("no modrm"),
+};
+
+typedef struct DecodeStats
+{
+	StatCounter total;
+	StatCounter mnemonics[Mnemonic_Count];
+	StatCounter kinds[Decode_Count];
+	StatCounter mods[ModRMMod_Count];
+	StatCounter shapes[OperandShape_Count];
+} DecodeStats;
+
+// Decodes all of input into stats. Returns false and fills in error_message if
+// the decoder hit something it didn't understand, the counts cover everything
+// up to that point.
+function bool GatherDecodeStats(DecodeStats *stats, String input, String *error_message);
+function void MergeDecodeStats(DecodeStats *dest, DecodeStats *source);
+
+typedef struct StatsFileResult
+{
+	String file_name;
+	bool   failed;
+	String error_message;
+} StatsFileResult;
+
+// Counts every file, spread over thread_count threads that each keep their own
+// counters, which are merged into stats at the end.
+function void GatherDecodeStatsForFiles(DecodeStats *stats, u32 file_count, StatsFileResult *files, u32 thread_count);
+
+function void PrintDecodeStats(FILE *out, DecodeStats *stats);
+function void WriteDecodeStatsCSV(FILE *out, DecodeStats *stats);
@@ -0,0 +1,459 @@
+//
+// Writer thread
+//
+
+function void TraceWriterThread(void *param)
+{
+	Tracer    *tracer = param;
+	TraceRing *ring   = &tracer->ring;
+
+	for (;;)
+	{
+		// done before write_at, so once it's seen, write_at covers every
+		// record there will ever be
+		u64 done     = AtomicLoadU64(&ring->done);
+		u64 write_at = AtomicLoadU64(&ring->write_at);
+		u64 read_at  = ring->read_at;
+
+		if (write_at == read_at)
+		{
+			if (done)
+			{
+				break;
+			}
+
+			SleepMilliseconds(1);
+			continue;
+		}
+
+		u64 at    = read_at & (TRACE_RING_SIZE - 1);
+		u64 count = write_at - read_at;
+		u64 first = Min(count, TRACE_RING_SIZE - at);
+
+		// Keep draining after a failed write, or the simulator would wait on
+		// room in the ring forever
+		if (fwrite(ring->bytes + at, 1, first, tracer->file) != first ||
+			fwrite(ring->bytes, 1, count - first, tracer->file) != count - first)
+		{
+			tracer->write_failed = 1;
+		}
+
+		AtomicStoreU64(&ring->read_at, write_at);
+	}
+}
+
+//
+// Simulator side
+//
+
+function void TraceAppend(Tracer *tracer, const u8 *bytes, u32 count)
+{
+	TraceRing *ring     = &tracer->ring;
+	u64        write_at = ring->write_at;
+
+	if (write_at + count - tracer->known_read_at > TRACE_RING_SIZE)
+	{
+		// The writer is a whole ring behind
+		for (;;)
+		{
+			tracer->known_read_at = AtomicLoadU64(&ring->read_at);
+			if (write_at + count - tracer->known_read_at <= TRACE_RING_SIZE)
+			{
+				break;
+			}
+
+			SleepMilliseconds(1);
+		}
+	}
+
+	u64 at    = write_at & (TRACE_RING_SIZE - 1);
+	u64 first = Min(count, TRACE_RING_SIZE - at);
+
+	memcpy(ring->bytes + at, bytes, first);
+	memcpy(ring->bytes, bytes + first, count - first);
+
+	AtomicStoreU64(&ring->write_at, write_at + count);
+
+	tracer->byte_count += count;
+}
+
+function bool StartTrace(Tracer *tracer, Simulator *sim, const char *file_name)
+{
+	ZeroStruct(tracer);
+
+	tracer->file = fopen(file_name, "wb");
+	if (!tracer->file)
+	{
+		return false;
+	}
+
+	tracer->ring.bytes = AllocatePages(TRACE_RING_SIZE);
+	if (!tracer->ring.bytes)
+	{
+		fclose(tracer->file);
+		return false;
+	}
+
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		tracer->words[slot] = sim->regs.words[slot];
+	}
+	tracer->flags   = ReadFlags(sim, 0xFFFF);
+	tracer->next_ip = sim->ip;
+
+	u8  header[16 + 2*Slot_Count + 4];
+	u32 size = 0;
+
+	memcpy(header, TRACE_MAGIC, 16);
+	size += 16;
+
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		header[size++] = (u8)tracer->words[slot];
+		header[size++] = (u8)(tracer->words[slot] >> 8);
+	}
+
+	header[size++] = (u8)tracer->flags;
+	header[size++] = (u8)(tracer->flags >> 8);
+	header[size++] = (u8)tracer->next_ip;
+	header[size++] = (u8)(tracer->next_ip >> 8);
+
+	TraceAppend(tracer, header, size);
+
+	if (!StartThread(&tracer->thread, TraceWriterThread, tracer))
+	{
+		FreePages(tracer->ring.bytes, TRACE_RING_SIZE);
+		fclose(tracer->file);
+		return false;
+	}
+
+	return true;
+}
+
+function void TracePutU8(Tracer *tracer, u8 value)
+{
+	tracer->record[tracer->record_size++] = value;
+}
+
+function void TracePutU16(Tracer *tracer, u16 value)
+{
+	tracer->record[tracer->record_size++] = (u8)value;
+	tracer->record[tracer->record_size++] = (u8)(value >> 8);
+}
+
+function void BeginTraceRecord(Tracer *tracer, Simulator *sim, Instruction *inst)
+{
+	tracer->record_size = 0;
+
+	u16 ip         = sim->ip;
+	u32 byte_count = inst->source_byte_count;
+	u32 skip       = 0;
+
+	// Only the last of a run of segment prefixes does anything, and the
+	// rest don't fit in the header
+	if (byte_count > TraceRecord_ByteCountMask)
+	{
+		skip       = byte_count - TraceRecord_ByteCountMask;
+		byte_count = TraceRecord_ByteCountMask;
+	}
+
+	u8 header = (u8)byte_count;
+	TracePutU8(tracer, header);
+
+	if (ip != tracer->next_ip || skip)
+	{
+		tracer->record[0] |= TraceRecord_IP;
+		TracePutU16(tracer, (u16)(ip + skip));
+	}
+
+	u32 code_base = sim->segment_bases[Slot_CS];
+	for (u32 index = 0; index < byte_count; index++)
+	{
+		TracePutU8(tracer, sim->memory[LinearAddress(code_base, (u16)(ip + skip + index))]);
+	}
+
+	tracer->next_ip = (u16)(ip + inst->source_byte_count);
+
+	tracer->pending_write_count = MemoryWritesOf(sim, inst, tracer->pending_writes);
+}
+
+function void EndTraceRecord(Tracer *tracer, Simulator *sim)
+{
+	if (sim->error)
+	{
+		// It didn't execute
+		return;
+	}
+
+	u16 changed_slots = 0;
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		if (sim->regs.words[slot] != tracer->words[slot])
+		{
+			changed_slots |= (u16)(1 << slot);
+		}
+	}
+
+	if (changed_slots)
+	{
+		tracer->record[0] |= TraceRecord_Registers;
+		TracePutU16(tracer, changed_slots);
+
+		for (u32 slot = 0; slot < Slot_Count; slot++)
+		{
+			if (changed_slots & (1 << slot))
+			{
+				tracer->words[slot] = sim->regs.words[slot];
+				TracePutU16(tracer, tracer->words[slot]);
+			}
+		}
+	}
+
+	CPUFlags flags = ReadFlags(sim, 0xFFFF);
+	if (flags != tracer->flags)
+	{
+		tracer->flags = flags;
+		tracer->record[0] |= TraceRecord_Flags;
+		TracePutU16(tracer, flags);
+	}
+
+	if (tracer->pending_write_count)
+	{
+		tracer->record[0] |= TraceRecord_Writes;
+
+		// A word at offset 0xFFFF goes in as two bytes, its halves aren't
+		// next to each other
+		u32 count_at = tracer->record_size;
+		TracePutU8(tracer, 0);
+
+		for (u32 index = 0; index < tracer->pending_write_count; index++)
+		{
+			MemoryWrite *write = &tracer->pending_writes[index];
+
+			u32 parts = (write->wide && write->offset == 0xFFFF) ? 2 : 1;
+			for (u32 part = 0; part < parts; part++)
+			{
+				u16  offset = (u16)(write->offset + part);
+				bool wide   = write->wide && parts == 1;
+
+				u32 address = LinearAddress(write->segment_base, offset);
+				u16 value   = ReadMemory(sim, write->segment_base, offset, wide);
+
+				if (wide)
+				{
+					address |= TRACE_WRITE_WIDE;
+				}
+
+				TracePutU8(tracer, (u8)address);
+				TracePutU8(tracer, (u8)(address >> 8));
+				TracePutU8(tracer, (u8)(address >> 16));
+
+				if (wide)
+				{
+					TracePutU16(tracer, value);
+				}
+				else
+				{
+					TracePutU8(tracer, (u8)value);
+				}
+
+				tracer->record[count_at]++;
+			}
+		}
+	}
+
+	TraceAppend(tracer, tracer->record, tracer->record_size);
+	tracer->record_count++;
+}
+
+function bool FinishTrace(Tracer *tracer)
+{
+	AtomicStoreU64(&tracer->ring.done, 1);
+	JoinThread(&tracer->thread);
+
+	bool result = !tracer->write_failed;
+
+	if (fclose(tracer->file) != 0)
+	{
+		result = false;
+	}
+
+	FreePages(tracer->ring.bytes, TRACE_RING_SIZE);
+	tracer->ring.bytes = NULL;
+
+	return result;
+}
+
+//
+// Offline decoding
+//
+
+typedef struct TraceReader
+{
+	const u8 *at;
+	const u8 *end;
+	bool      error;
+} TraceReader;
+
+function u8 TraceReadU8(TraceReader *reader)
+{
+	u8 result = 0;
+
+	if (reader->at < reader->end)
+	{
+		result = *reader->at++;
+	}
+	else
+	{
+		reader->error = true;
+	}
+
+	return result;
+}
+
+function u16 TraceReadU16(TraceReader *reader)
+{
+	u16 result = TraceReadU8(reader);
+	result |= (u16)(TraceReadU8(reader) << 8);
+	return result;
+}
+
+function bool PrintTrace(FILE *out, String trace)
+{
+	TraceReader reader =
+	{
+		.at  = trace.bytes,
+		.end = trace.bytes + trace.count,
+	};
+
+	if (trace.count < 16 || memcmp(trace.bytes, TRACE_MAGIC, 16) != 0)
+	{
+		fprintf(stderr, "Not a trace file\n");
+		return false;
+	}
+	reader.at += 16;
+
+	u16 words[Slot_Count];
+	for (u32 slot = 0; slot < Slot_Count; slot++)
+	{
+		words[slot] = TraceReadU16(&reader);
+	}
+
+	CPUFlags flags   = TraceReadU16(&reader);
+	u16      next_ip = TraceReadU16(&reader);
+
+	u8 output_bytes[256];
+	Buffer output =
+	{
+		.capacity = sizeof(output_bytes),
+		.bytes    = output_bytes,
+	};
+
+	u64 record_count = 0;
+
+	while (!reader.error && reader.at < reader.end)
+	{
+		u8 header = TraceReadU8(&reader);
+
+		u16 ip = next_ip;
+		if (header & TraceRecord_IP)
+		{
+			ip = TraceReadU16(&reader);
+		}
+
+		u8  code[TraceRecord_ByteCountMask];
+		u32 code_size = header & TraceRecord_ByteCountMask;
+		for (u32 index = 0; index < code_size; index++)
+		{
+			code[index] = TraceReadU8(&reader);
+		}
+
+		next_ip = (u16)(ip + code_size);
+
+		String code_string =
+		{
+			.count = code_size,
+			.bytes = code,
+		};
+
+		Decoder *decoder = &(Decoder){ 0 };
+		InitializeDecoder(decoder, code_string);
+
+		Instruction inst;
+		if (reader.error || !DecodeNextInstruction(decoder, &inst))
+		{
+			break;
+		}
+
+		Disassembler *disasm = &(Disassembler){ 0 };
+		DisassemblerParams disasm_params =
+		{
+			.input  = code_string,
+			.output = output,
+		};
+		InitializeDisassembler(disasm, &disasm_params);
+		DisassembleInstruction(disasm, &inst);
+
+		// Without its newline, the changes go on the same line
+		String text = DisassemblerResult(disasm);
+		fprintf(out, "%04x  %.*s ;", ip, (int)text.count - 1, text.bytes);
+
+		if (header & TraceRecord_Registers)
+		{
+			u16 changed_slots = TraceReadU16(&reader);
+			for (u32 slot = 0; slot < Slot_Count; slot++)
+			{
+				if (changed_slots & (1 << slot))
+				{
+					u16 value = TraceReadU16(&reader);
+					fprintf(out, " %.*s:0x%x->0x%x", StringExpand(register_names[RegisterOfSlot(slot)]), words[slot], value);
+					words[slot] = value;
+				}
+			}
+		}
+
+		if (header & TraceRecord_Flags)
+		{
+			CPUFlags new_flags = TraceReadU16(&reader);
+
+			fprintf(out, " flags:");
+			PrintFlags(out, flags);
+			fprintf(out, "->");
+			PrintFlags(out, new_flags);
+
+			flags = new_flags;
+		}
+
+		if (header & TraceRecord_Writes)
+		{
+			u32 count = TraceReadU8(&reader);
+			for (u32 index = 0; index < count; index++)
+			{
+				u32 address = TraceReadU8(&reader);
+				address |= (u32)TraceReadU8(&reader) << 8;
+				address |= (u32)TraceReadU8(&reader) << 16;
+
+				if (address & TRACE_WRITE_WIDE)
+				{
+					fprintf(out, " [0x%05x]:0x%04x", address & ~TRACE_WRITE_WIDE, TraceReadU16(&reader));
+				}
+				else
+				{
+					fprintf(out, " [0x%05x]:0x%02x", address, TraceReadU8(&reader));
+				}
+			}
+		}
+
+		fprintf(out, "\n");
+		record_count++;
+	}
+
+	if (reader.error || reader.at < reader.end)
+	{
+		fprintf(stderr, "Trace is cut short or corrupt after %llu instructions\n", (unsigned long long)record_count);
+		return false;
+	}
+
+	fprintf(out, "\n; %llu instructions\n", (unsigned long long)record_count);
+	return true;
+}
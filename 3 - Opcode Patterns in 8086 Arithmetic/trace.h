@@ -0,0 +1,107 @@
+// Binary execution trace: one record per executed instruction, holding its
+// bytes and only what it changed, so a step costs a few dozen bytes and no
+// formatting. Records go into a ring buffer that a writer thread drains to
+// the file, and the trace is turned into text afterwards by PrintTrace.
+//
+// The file starts with TRACE_MAGIC and the register file, flags and IP from
+// before the first instruction. Each record after that is:
+//
+//   u8  header      the instruction byte count in the low bits, TraceRecord_*
+//   u16 ip          with TraceRecord_IP, when the instruction isn't the one
+//                   right after the previous record's
+//   u8  bytes[]     the instruction as it was in memory
+//   u16 slots       with TraceRecord_Registers, a bit per changed register
+//                   slot, followed by the new u16 of each, lowest slot first
+//   u16 flags       with TraceRecord_Flags
+//   u8  count       with TraceRecord_Writes, followed by the writes: a 3 byte
+//                   linear address with TRACE_WRITE_WIDE set for a word, and
+//                   the new byte or word
+//
+// Everything is little endian.
+
+#define TRACE_MAGIC "SIM8086TRACE\0\0\0\1"
+
+#define TRACE_RING_SIZE Megabytes(4)
+
+enum TraceRecordFlags
+{
+	TraceRecord_ByteCountMask = 0x07,
+
+	TraceRecord_IP        = 0x08,
+	TraceRecord_Registers = 0x10,
+	TraceRecord_Flags     = 0x20,
+	TraceRecord_Writes    = 0x40,
+};
+
+#define TRACE_WRITE_WIDE (1u << 23)
+
+// Big enough for any record: header, ip, 7 instruction bytes, every
+// register, flags and two word writes
+#define TRACE_MAX_RECORD_SIZE 64
+
+// Single producer, single consumer. The simulator only moves write_at and
+// the writer thread only moves read_at, and each side publishes its cursor
+// with a release store that the other reads with an acquire load, so the
+// bytes in between are never touched by both at once. The cursors are
+// running totals, masked to index the ring, and sit on cache lines of their
+// own so the two threads don't keep taking the line from each other.
+typedef struct TraceRing
+{
+	u8 *bytes;
+
+	u8 pad0[56];
+	volatile u64 write_at;
+	u8 pad1[56];
+	volatile u64 read_at;
+	u8 pad2[56];
+
+	// Set once the simulator is done, the writer drains what's left and exits
+	volatile u64 done;
+} TraceRing;
+
+typedef struct Tracer
+{
+	TraceRing ring;
+
+	// Simulator side: how far the writer had got when last checked, so the
+	// ring only has to be asked when that doesn't leave enough room
+	u64 known_read_at;
+
+	// The state as of the last record, to diff against
+	u16      words[Slot_Count];
+	CPUFlags flags;
+	u16      next_ip;
+
+	// The record being put together. BeginTraceRecord writes up to the
+	// instruction bytes and works out which memory the instruction writes,
+	// EndTraceRecord adds what changed.
+	u8          record[TRACE_MAX_RECORD_SIZE];
+	u32         record_size;
+	u32         pending_write_count;
+	MemoryWrite pending_writes[MAX_MEMORY_WRITES];
+
+	u64 record_count;
+	u64 byte_count;
+
+	// Writer side
+	FILE          *file;
+	PlatformThread thread;
+	volatile u64   write_failed;
+} Tracer;
+
+// Writes the header and starts the writer thread. The simulator should have
+// its program loaded, the trace starts from its current state.
+function bool StartTrace(Tracer *tracer, Simulator *sim, const char *file_name);
+
+// Around ExecuteInstruction: the memory the instruction writes is worked out
+// from the registers before it runs, and everything is diffed after
+function void BeginTraceRecord(Tracer *tracer, Simulator *sim, Instruction *inst);
+function void EndTraceRecord(Tracer *tracer, Simulator *sim);
+
+// Waits for the writer to drain the ring, then closes the file. Returns false
+// if any of the trace failed to write.
+function bool FinishTrace(Tracer *tracer);
+
+// Renders a trace file as disassembly, one instruction per line, with the
+// registers, flags and memory it changed
+function bool PrintTrace(FILE *out, String trace);